@@ -0,0 +1,121 @@
+/** <header>
+
+ * This file is part of preBowt -- a prefix-based BWT-like transform of
+ * genetic data.
+ *
+ * Copyright 2014 David Eccles (gringer) <bioinformatics@gringene.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * without any warranty; without even the implied warranty of
+ * merchantability or fitness for a particular purpose. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+</header> **/
+
+// Counts heap allocations and peak memory use while building a
+// transform, first by sorting and then by dynamic insertion
+// usage: allocbench [static bases] [inserted bases]
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <random>
+#include <atomic>
+#include <new>
+#include <cstdlib>
+
+#include <sys/resource.h>
+
+#include "prebowt.hpp"
+#include "prebowtconfig.hpp"
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+static atomic<uint64_t> allocCount(0);
+static atomic<uint64_t> allocBytes(0);
+
+void* operator new(size_t size){
+  allocCount.fetch_add(1, memory_order_relaxed);
+  allocBytes.fetch_add(size, memory_order_relaxed);
+  void* retVal = malloc(size ? size : 1);
+  if(retVal == NULL){
+    throw bad_alloc();
+  }
+  return retVal;
+}
+
+void operator delete(void* ptr) noexcept{
+  free(ptr);
+}
+
+static double secondsSince(const Clock::time_point& start){
+  chrono::duration<double> elapsed = Clock::now() - start;
+  return elapsed.count();
+}
+
+// peak resident set size, in MiB
+static double peakRSS(){
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss / 1024.0;
+}
+
+static vector<PackedSeq> randomReads(size_t totalLength, mt19937_64& rng){
+  static const char BASES[] = "ACGT";
+  static const size_t READ_LENGTH = 150;
+  vector<PackedSeq> retVal;
+  for(size_t pos = 0; pos < totalLength; pos += READ_LENGTH){
+    string read(READ_LENGTH, 'A');
+    for(size_t i = 0; i < READ_LENGTH; i++){
+      read[i] = BASES[rng() & 3];
+    }
+    retVal.push_back(PackedSeq(read));
+  }
+  return retVal;
+}
+
+static void report(const string& stage, const Clock::time_point& start,
+                   uint64_t bases){
+  double elapsed = secondsSince(start);
+  cout << setw(8) << stage << fixed << setprecision(3)
+       << setw(10) << elapsed << setw(14) << allocCount.load()
+       << setw(12) << setprecision(1) << (allocBytes.load() / 1048576.0)
+       << setw(10) << peakRSS()
+       << setw(12) << setprecision(2)
+       << ((double)allocCount.load() / bases) << endl;
+  allocCount = 0;
+  allocBytes = 0;
+}
+
+int main(int argc, char** argv){
+  size_t staticLength = (argc > 1) ? strtoull(argv[1], NULL, 10) : 4000000;
+  size_t insertLength = (argc > 2) ? strtoull(argv[2], NULL, 10) : 200000;
+  mt19937_64 rng(1);
+  vector<PackedSeq> reads = randomReads(staticLength, rng);
+  vector<PackedSeq> extra = randomReads(insertLength, rng);
+  cout << setw(8) << "stage" << setw(10) << "seconds" << setw(14) << "allocs"
+       << setw(12) << "MiB" << setw(10) << "peak RSS" << setw(12)
+       << "allocs/base" << endl;
+  allocCount = 0;
+  allocBytes = 0;
+  Clock::time_point start = Clock::now();
+  Prebowt index(reads);
+  report("sort", start, staticLength);
+  start = Clock::now();
+  for(size_t i = 0; i < extra.size(); i++){
+    index.addSequence(extra[i]);
+  }
+  report("insert", start, insertLength);
+  cout << "final length: " << index.length() << "; tree height "
+       << index.transform().height() << endl;
+}
@@ -0,0 +1,90 @@
+/** <header>
+
+ * This file is part of preBowt -- a prefix-based BWT-like transform of
+ * genetic data.
+ *
+ * Copyright 2014 David Eccles (gringer) <bioinformatics@gringene.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * without any warranty; without even the implied warranty of
+ * merchantability or fitness for a particular purpose. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+</header> **/
+
+// Times quality-aware mismatch search for reads with sequencing errors,
+// and checks how often the best hit is the read's true origin
+// usage: approxbench [genome length] [reads] [read length] [mismatches]
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <random>
+#include <cstdlib>
+
+#include "prebowt.hpp"
+#include "prebowtconfig.hpp"
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+static double secondsSince(const Clock::time_point& start){
+  chrono::duration<double> elapsed = Clock::now() - start;
+  return elapsed.count();
+}
+
+int main(int argc, char** argv){
+  size_t genomeLength = (argc > 1) ? strtoull(argv[1], NULL, 10) : 1000000;
+  size_t readCount = (argc > 2) ? strtoull(argv[2], NULL, 10) : 2000;
+  size_t readLength = (argc > 3) ? strtoull(argv[3], NULL, 10) : 30;
+  uint32_t maxMismatches = (argc > 4) ? strtoul(argv[4], NULL, 10) : 2;
+  static const char BASES[] = "ACGT";
+  mt19937_64 rng(1);
+  string genome(genomeLength, 'A');
+  for(size_t i = 0; i < genomeLength; i++){
+    genome[i] = BASES[rng() & 3];
+  }
+  vector<PackedSeq> seqs(1, PackedSeq(genome));
+  Prebowt index(seqs);
+  // reads with up to maxMismatches errors, each at a low-quality base
+  vector<PackedSeq> reads;
+  vector<uint64_t> origins;
+  for(size_t r = 0; r < readCount; r++){
+    uint64_t origin = rng() % (genomeLength - readLength);
+    string read = genome.substr(origin, readLength);
+    string quals(readLength, 'I');
+    for(size_t e = rng() % (maxMismatches + 1); e > 0; e--){
+      size_t pos = rng() % readLength;
+      read[pos] = BASES[(string(BASES).find(read[pos]) + 1 + rng() % 3) & 3];
+      quals[pos] = '#';
+    }
+    reads.push_back(PackedSeq(read, quals));
+    origins.push_back(origin);
+  }
+  cout << setw(10) << "max hits" << setw(14) << "us/read"
+       << setw(12) << "found" << endl;
+  static const uint64_t MAX_HITS[] = {1, 0};
+  for(size_t h = 0; h < 2; h++){
+    ApproxOptions options(maxMismatches, numeric_limits<uint32_t>::max(),
+                          MAX_HITS[h]);
+    size_t found = 0;
+    Clock::time_point start = Clock::now();
+    for(size_t r = 0; r < readCount; r++){
+      vector<ApproxMatch> matches = index.locateApprox(reads[r], options);
+      found += (!matches.empty()) && (matches[0].pos.offset == origins[r]);
+    }
+    double elapsed = secondsSince(start);
+    cout << setw(10) << MAX_HITS[h] << fixed << setprecision(1)
+         << setw(14) << (elapsed * 1e6 / readCount)
+         << setw(11) << (found * 100.0 / readCount) << "%" << endl;
+  }
+}
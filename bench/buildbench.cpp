@@ -0,0 +1,115 @@
+/** <header>
+
+ * This file is part of preBowt -- a prefix-based BWT-like transform of
+ * genetic data.
+ *
+ * Copyright 2014 David Eccles (gringer) <bioinformatics@gringene.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * without any warranty; without even the implied warranty of
+ * merchantability or fitness for a particular purpose. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+</header> **/
+
+// Times parallel FASTA/FASTQ parsing, multithreaded transform
+// construction and FASTQ export, and checks that every thread count
+// gives the same transform
+// usage: buildbench [FASTA/FASTQ file | synthetic bases] [max threads]
+//                   [synthetic read length; 0 for a single sequence]
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <algorithm>
+#include <random>
+#include <thread>
+#include <cstdlib>
+
+#include "prebowt.hpp"
+#include "fastxreader.hpp"
+#include "prebowtconfig.hpp"
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+static double secondsSince(const Clock::time_point& start){
+  chrono::duration<double> elapsed = Clock::now() - start;
+  return elapsed.count();
+}
+
+static PackedSeq transformBases(const Prebowt& index){
+  PackedSeq retVal;
+  index.transform().appendTo(retVal, 0, index.length());
+  return retVal;
+}
+
+int main(int argc, char** argv){
+  vector<PackedSeq> reads;
+  string source = (argc > 1) ? argv[1] : "2000000";
+  ifstream inFile(source.c_str());
+  if(inFile){
+    QueryExecutor executor;
+    Clock::time_point start = Clock::now();
+    reads = ParallelFastxReader(source).readAll(executor);
+    cout << "parsed in " << fixed << setprecision(3)
+         << secondsSince(start) << " s on " << executor.threadCount()
+         << " threads" << endl;
+  } else {
+    static const char BASES[] = "ACGT";
+    size_t totalLength = strtoull(source.c_str(), NULL, 10);
+    size_t readLength = (argc > 3) ? strtoull(argv[3], NULL, 10) : 150;
+    if(readLength == 0){
+      readLength = totalLength;
+    }
+    mt19937_64 rng(1);
+    for(size_t pos = 0; pos < totalLength; pos += readLength){
+      string read(min(readLength, totalLength - pos), 'A');
+      for(size_t i = 0; i < read.length(); i++){
+        read[i] = BASES[rng() & 3];
+      }
+      reads.push_back(PackedSeq(read));
+    }
+  }
+  size_t maxThreads = (argc > 2) ? strtoull(argv[2], NULL, 10) :
+    max(thread::hardware_concurrency(), 1u);
+  cout << reads.size() << " sequences from " << source << endl;
+  cout << setw(8) << "threads" << setw(12) << "seconds"
+       << setw(10) << "speedup" << setw(10) << "same"
+       << setw(12) << "export s" << endl;
+  PackedSeq reference;
+  double baseTime = 0;
+  for(size_t threads = 1; threads <= maxThreads; threads *= 2){
+    Clock::time_point start = Clock::now();
+    Prebowt index = Prebowt::build(reads, threads);
+    double buildTime = secondsSince(start);
+    PackedSeq result = transformBases(index);
+    if(threads == 1){
+      reference = result;
+      baseTime = buildTime;
+    }
+    bool same = (result.length() == reference.length()) &&
+      equal(result.data(), result.data() + result.length(),
+            reference.data());
+    QueryExecutor executor(threads);
+    ostringstream fastq;
+    start = Clock::now();
+    index.writeFastq(fastq, executor);
+    double exportTime = secondsSince(start);
+    cout << setw(8) << threads << fixed << setprecision(3)
+         << setw(12) << buildTime << setw(10) << (baseTime / buildTime)
+         << setw(10) << (same ? "yes" : "NO")
+         << setw(12) << exportTime << endl;
+  }
+}
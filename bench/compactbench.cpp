@@ -0,0 +1,110 @@
+/** <header>
+
+ * This file is part of preBowt -- a prefix-based BWT-like transform of
+ * genetic data.
+ *
+ * Copyright 2014 David Eccles (gringer) <bioinformatics@gringene.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * without any warranty; without even the implied warranty of
+ * merchantability or fitness for a particular purpose. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+</header> **/
+
+// Compares the heap used by a transform and its compressed copy
+// (CompactPrebowt), and their pattern count throughput
+// usage: compactbench [genome length] [queries] [query length]
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <random>
+#include <cstdlib>
+
+#include <malloc.h>
+
+#include "prebowt.hpp"
+#include "prebowtconfig.hpp"
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+static double secondsSince(const Clock::time_point& start){
+  chrono::duration<double> elapsed = Clock::now() - start;
+  return elapsed.count();
+}
+
+// bytes of heap currently allocated
+static size_t heapBytes(){
+  return mallinfo2().uordblks;
+}
+
+template<class Index>
+static void report(const string& name, const Index& index,
+                   size_t memoryBytes, const vector<string>& queries){
+  Clock::time_point start = Clock::now();
+  vector<uint64_t> counts = index.countBatch(queries);
+  double elapsed = secondsSince(start);
+  uint64_t hits = 0;
+  for(size_t i = 0; i < counts.size(); i++){
+    hits += counts[i];
+  }
+  cout << setw(8) << name << fixed << setprecision(3)
+       << setw(14) << ((double)memoryBytes / index.length())
+       << setw(14) << setprecision(1)
+       << (elapsed * 1e9 / queries.size()) << setw(12) << hits << endl;
+}
+
+int main(int argc, char** argv){
+  size_t genomeLength = (argc > 1) ? strtoull(argv[1], NULL, 10) : 4000000;
+  size_t queryCount = (argc > 2) ? strtoull(argv[2], NULL, 10) : 200000;
+  size_t queryLength = (argc > 3) ? strtoull(argv[3], NULL, 10) : 20;
+  static const char BASES[] = "ACGT";
+  static const size_t READ_LENGTH = 1000;
+  mt19937_64 rng(1);
+  // a genome with repeats, so that the transform has runs
+  string genome;
+  while(genome.length() < genomeLength){
+    if((genome.length() > 10000) && ((rng() % 4) == 0)){
+      genome += genome.substr(rng() % (genome.length() - 5000), 5000);
+    } else {
+      for(size_t i = 0; i < 5000; i++){
+        genome += BASES[rng() & 3];
+      }
+    }
+  }
+  genome.resize(genomeLength);
+  vector<PackedSeq> reads;
+  for(size_t i = 0; i < genomeLength; i += READ_LENGTH){
+    reads.push_back(PackedSeq(genome.substr(i, READ_LENGTH)));
+  }
+  size_t baseHeap = heapBytes();
+  Prebowt index(reads);
+  size_t indexBytes = heapBytes() - baseHeap;
+  baseHeap = heapBytes();
+  Clock::time_point start = Clock::now();
+  CompactPrebowt compact(index);
+  double compressTime = secondsSince(start);
+  size_t compactBytes = heapBytes() - baseHeap;
+  cout << "genome: " << genomeLength << " bases; compressed in "
+       << setprecision(3) << compressTime << " s" << endl;
+  vector<string> queries;
+  for(size_t i = 0; i < queryCount; i++){
+    queries.push_back(genome.substr(rng() % (genomeLength - queryLength),
+                                    queryLength));
+  }
+  cout << setw(8) << "index" << setw(14) << "bytes/base" << setw(14)
+       << "ns/query" << setw(12) << "hits" << endl;
+  report("packed", index, indexBytes, queries);
+  report("compact", compact, compactBytes, queries);
+}
@@ -0,0 +1,87 @@
+/** <header>
+
+ * This file is part of preBowt -- a prefix-based BWT-like transform of
+ * genetic data.
+ *
+ * Copyright 2014 David Eccles (gringer) <bioinformatics@gringene.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * without any warranty; without even the implied warranty of
+ * merchantability or fitness for a particular purpose. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+</header> **/
+
+// Compares in-leaf base counting kernels (cycles per base)
+// usage: countbench [bases counted per test]
+
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <cstdlib>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define CYCLES() __rdtsc()
+#else
+#include <chrono>
+#define CYCLES() ((uint64_t)std::chrono::steady_clock::now(). \
+                  time_since_epoch().count())
+#endif
+
+#include "basecount.hpp"
+#include "prebowtconfig.hpp"
+
+using namespace std;
+
+int main(int argc, char** argv){
+  size_t totalBases = (argc > 1) ? strtoull(argv[1], NULL, 10) : 100000000;
+  static const size_t LEAF_SIZES[] = {64, 256, 1024, 4096, 16384};
+  static const char BASES[] = "ACGTACGTACGTACGTN$"; // mostly unambiguous
+  mt19937_64 rng(1);
+  string leafBases(16384, 'A');
+  for(size_t i = 0; i < leafBases.length(); i++){
+    leafBases[i] = BASES[rng() % (sizeof(BASES) - 1)];
+  }
+  PackedSeq leaf(leafBases);
+  cout << "best kernel: " << BaseCounter::kernelName(BaseCounter::bestKernel())
+       << "; cycles per base for " << totalBases << " bases" << endl;
+  cout << setw(8) << "kernel" << setw(8) << "leaf"
+       << setw(12) << "count(G)" << setw(12) << "countAll" << endl;
+  for(int k = BaseCounter::SCALAR; k <= BaseCounter::AVX2; k++){
+    if(!BaseCounter::setKernel((BaseCounter::Kernel)k)){
+      continue;
+    }
+    for(size_t s = 0; s < sizeof(LEAF_SIZES) / sizeof(LEAF_SIZES[0]); s++){
+      size_t leafSize = LEAF_SIZES[s];
+      size_t reps = totalBases / leafSize;
+      uint64_t checkSum = 0;
+      uint64_t start = CYCLES();
+      for(size_t r = 0; r < reps; r++){
+        // vary the length slightly so the work is not hoisted
+        checkSum += BaseCounter::count(leaf.data(), leafSize - (r & 1),
+                                       PackedSeq::G);
+      }
+      double countCycles = (double)(CYCLES() - start) / (reps * leafSize);
+      uint64_t counts[PackedSeq::ALL + 1] = {0};
+      start = CYCLES();
+      for(size_t r = 0; r < reps; r++){
+        BaseCounter::countAll(leaf.data(), leafSize - (r & 1), counts);
+      }
+      double countAllCycles = (double)(CYCLES() - start) / (reps * leafSize);
+      checkSum += counts[PackedSeq::AMBIG];
+      cout << setw(8) << BaseCounter::kernelName((BaseCounter::Kernel)k)
+           << setw(8) << leafSize << fixed << setprecision(3)
+           << setw(12) << countCycles << setw(12) << countAllCycles
+           << "   (" << checkSum << ")" << endl;
+    }
+  }
+}
@@ -0,0 +1,117 @@
+/** <header>
+
+ * This file is part of preBowt -- a prefix-based BWT-like transform of
+ * genetic data.
+ *
+ * Copyright 2014 David Eccles (gringer) <bioinformatics@gringene.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * without any warranty; without even the implied warranty of
+ * merchantability or fitness for a particular purpose. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+</header> **/
+
+// Compares D-Tree edit and rank latency across node fan-out and leaf sizes
+// usage: dtreebench [genome length] [operations per test]
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <random>
+#include <cstdlib>
+
+#include "dtree.hpp"
+#include "prebowtconfig.hpp"
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+// mean nanoseconds per operation since a given start time
+static double nsPerOp(const Clock::time_point& start, size_t ops){
+  chrono::duration<double, nano> elapsed = Clock::now() - start;
+  return elapsed.count() / ops;
+}
+
+static PackedSeq randomSeq(mt19937_64& rng, size_t len){
+  static const char BASES[] = "ACGT";
+  string retVal(len, 'A');
+  for(size_t i = 0; i < len; i++){
+    retVal[i] = BASES[rng() & 3];
+  }
+  return PackedSeq(retVal);
+}
+
+template<size_t Fanout, size_t LeafBytes>
+void runConfig(const PackedSeq& genome, size_t ops){
+  mt19937_64 rng(42);
+  uint64_t checkSum = 0; // keeps results live
+  Clock::time_point start = Clock::now();
+  DTree<Fanout, LeafBytes> tree(genome);
+  double buildNs = nsPerOp(start, genome.length());
+  start = Clock::now();
+  for(size_t i = 0; i < ops; i++){
+    checkSum += tree.split(rng() % tree.length()).left.length();
+  }
+  double splitNs = nsPerOp(start, ops);
+  DSplit<Fanout, LeafBytes> halves = tree.split(tree.length() / 2);
+  start = Clock::now();
+  for(size_t i = 0; i < ops; i++){
+    checkSum += halves.left.append(halves.right).length();
+  }
+  double appendNs = nsPerOp(start, ops);
+  DTree<Fanout, LeafBytes> read(randomSeq(rng, 150));
+  start = Clock::now();
+  for(size_t i = 0; i < ops; i++){
+    checkSum += tree.insert(rng() % tree.length(), read).length();
+  }
+  double insertNs = nsPerOp(start, ops);
+  start = Clock::now();
+  for(size_t i = 0; i < ops; i++){
+    checkSum += tree.substr(rng() % (tree.length() - 1000), 1000).length();
+  }
+  double substrNs = nsPerOp(start, ops);
+  start = Clock::now();
+  for(size_t i = 0; i < ops; i++){
+    checkSum += tree.rank(PackedSeq::G, rng() % tree.length());
+  }
+  double rankNs = nsPerOp(start, ops);
+  cout << setw(6) << Fanout << setw(8) << LeafBytes
+       << setw(8) << sizeof(DTree<Fanout, LeafBytes>)
+       << setw(7) << tree.height()
+       << fixed << setprecision(1)
+       << setw(10) << buildNs << setw(10) << splitNs
+       << setw(10) << appendNs << setw(10) << insertNs
+       << setw(10) << substrNs << setw(10) << rankNs
+       << "   (" << checkSum << ")" << endl;
+}
+
+int main(int argc, char** argv){
+  size_t genomeLength = (argc > 1) ? strtoull(argv[1], NULL, 10) : 4000000;
+  size_t ops = (argc > 2) ? strtoull(argv[2], NULL, 10) : 10000;
+  mt19937_64 rng(1);
+  PackedSeq genome = randomSeq(rng, genomeLength);
+  cout << "genome: " << genomeLength << " bases; "
+       << ops << " operations per test; times are ns/op (build: ns/base)"
+       << endl;
+  cout << setw(6) << "fanout" << setw(8) << "leaf" << setw(8) << "node B"
+       << setw(7) << "height"
+       << setw(10) << "build" << setw(10) << "split"
+       << setw(10) << "append" << setw(10) << "insert"
+       << setw(10) << "substr" << setw(10) << "rank" << endl;
+  runConfig<4, 64>(genome, ops);
+  runConfig<8, 1024>(genome, ops);
+  runConfig<16, 1024>(genome, ops);
+  runConfig<16, 4096>(genome, ops);
+  runConfig<32, 4096>(genome, ops);
+  runConfig<64, 16384>(genome, ops);
+}
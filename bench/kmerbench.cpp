@@ -0,0 +1,105 @@
+/** <header>
+
+ * This file is part of preBowt -- a prefix-based BWT-like transform of
+ * genetic data.
+ *
+ * Copyright 2014 David Eccles (gringer) <bioinformatics@gringene.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * without any warranty; without even the implied warranty of
+ * merchantability or fitness for a particular purpose. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+</header> **/
+
+// Times the k-mer spectrum of a set of reads taken from the index,
+// against counting the same k-mers in a hash table
+// usage: kmerbench [genome length] [reads] [read length] [k] [threads]
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <random>
+#include <cstdlib>
+#include <unordered_map>
+
+#include "prebowt.hpp"
+#include "queryexecutor.hpp"
+#include "prebowtconfig.hpp"
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+static double secondsSince(const Clock::time_point& start){
+  chrono::duration<double> elapsed = Clock::now() - start;
+  return elapsed.count();
+}
+
+int main(int argc, char** argv){
+  size_t genomeLength = (argc > 1) ? strtoull(argv[1], NULL, 10) : 100000;
+  size_t readCount = (argc > 2) ? strtoull(argv[2], NULL, 10) : 10000;
+  size_t readLength = (argc > 3) ? strtoull(argv[3], NULL, 10) : 100;
+  size_t k = (argc > 4) ? strtoull(argv[4], NULL, 10) : 21;
+  size_t threads = (argc > 5) ? strtoull(argv[5], NULL, 10) : 4;
+  static const char BASES[] = "ACGT";
+  mt19937_64 rng(1);
+  string genome(genomeLength, 'A');
+  for(size_t i = 0; i < genomeLength; i++){
+    genome[i] = BASES[rng() & 3];
+  }
+  vector<string> reads;
+  vector<PackedSeq> seqs;
+  for(size_t r = 0; r < readCount; r++){
+    reads.push_back(genome.substr(rng() % (genomeLength - readLength),
+                                  readLength));
+    seqs.push_back(PackedSeq(reads.back()));
+  }
+  Prebowt index = Prebowt::build(seqs, threads);
+  QueryExecutor executor(threads);
+  cout << setw(10) << "min count" << setw(12) << "method"
+       << setw(12) << "k-mers" << setw(12) << "s" << endl;
+  static const uint64_t MIN_COUNTS[] = {1, 10};
+  for(size_t m = 0; m < 2; m++){
+    // 2-bit k-mer codes (k <= 32) in an unordered_map
+    Clock::time_point start = Clock::now();
+    unordered_map<uint64_t, uint64_t> table;
+    uint64_t mask = (k >= 32) ? ~(uint64_t)0 : (((uint64_t)1 << (2 * k)) - 1);
+    for(size_t r = 0; r < readCount; r++){
+      uint64_t code = 0;
+      for(size_t i = 0; i < reads[r].length(); i++){
+        code = ((code << 2) | string(BASES).find(reads[r][i])) & mask;
+        if((i + 1) >= k){
+          table[code]++;
+        }
+      }
+    }
+    uint64_t tableKmers = 0;
+    for(unordered_map<uint64_t, uint64_t>::const_iterator it = table.begin();
+        it != table.end(); ++it){
+      tableKmers += (it->second >= MIN_COUNTS[m]);
+    }
+    double elapsed = secondsSince(start);
+    cout << setw(10) << MIN_COUNTS[m] << setw(12) << "hash"
+         << setw(12) << tableKmers << fixed << setprecision(3)
+         << setw(12) << elapsed << endl;
+    start = Clock::now();
+    uint64_t indexKmers = 0;
+    index.kmerSpectrum(k, MIN_COUNTS[m], executor,
+                       [&](const KmerCount&){
+                         indexKmers++;
+                       });
+    elapsed = secondsSince(start);
+    cout << setw(10) << MIN_COUNTS[m] << setw(12) << "index"
+         << setw(12) << indexKmers << fixed << setprecision(3)
+         << setw(12) << elapsed << endl;
+  }
+}
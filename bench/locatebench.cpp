@@ -0,0 +1,89 @@
+/** <header>
+
+ * This file is part of preBowt -- a prefix-based BWT-like transform of
+ * genetic data.
+ *
+ * Copyright 2014 David Eccles (gringer) <bioinformatics@gringene.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * without any warranty; without even the implied warranty of
+ * merchantability or fitness for a particular purpose. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+</header> **/
+
+// Measures locate() time and position sample memory at several
+// sampling rates
+// usage: locatebench [genome length] [queries] [query length]
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <random>
+#include <cstdlib>
+
+#include <malloc.h>
+
+#include "prebowt.hpp"
+#include "prebowtconfig.hpp"
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+static double secondsSince(const Clock::time_point& start){
+  chrono::duration<double> elapsed = Clock::now() - start;
+  return elapsed.count();
+}
+
+// bytes of heap currently allocated
+static size_t heapBytes(){
+  return mallinfo2().uordblks;
+}
+
+int main(int argc, char** argv){
+  size_t genomeLength = (argc > 1) ? strtoull(argv[1], NULL, 10) : 1000000;
+  size_t queryCount = (argc > 2) ? strtoull(argv[2], NULL, 10) : 2000;
+  size_t queryLength = (argc > 3) ? strtoull(argv[3], NULL, 10) : 20;
+  static const char BASES[] = "ACGT";
+  static const size_t READ_LENGTH = 1000;
+  static const uint64_t RATES[] = {0, 4, 16, 32, 64, 256};
+  mt19937_64 rng(1);
+  string genome(genomeLength, 'A');
+  for(size_t i = 0; i < genomeLength; i++){
+    genome[i] = BASES[rng() & 3];
+  }
+  vector<PackedSeq> reads;
+  for(size_t i = 0; i < genomeLength; i += READ_LENGTH){
+    reads.push_back(PackedSeq(genome.substr(i, READ_LENGTH)));
+  }
+  vector<string> queries;
+  for(size_t i = 0; i < queryCount; i++){
+    queries.push_back(genome.substr(rng() % (genomeLength - queryLength),
+                                    queryLength));
+  }
+  cout << setw(6) << "rate" << setw(14) << "bytes/row" << setw(14)
+       << "us/hit" << setw(10) << "hits" << endl;
+  for(size_t r = 0; r < sizeof(RATES) / sizeof(RATES[0]); r++){
+    size_t baseHeap = heapBytes();
+    Prebowt index(reads, RATES[r]);
+    size_t indexBytes = heapBytes() - baseHeap;
+    uint64_t hits = 0;
+    Clock::time_point start = Clock::now();
+    for(size_t i = 0; i < queryCount; i++){
+      hits += index.locate(queries[i]).size();
+    }
+    double elapsed = secondsSince(start);
+    cout << setw(6) << RATES[r] << fixed << setprecision(3)
+         << setw(14) << ((double)indexBytes / index.length())
+         << setw(14) << (elapsed * 1e6 / hits) << setw(10) << hits << endl;
+  }
+}
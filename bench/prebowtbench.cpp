@@ -0,0 +1,339 @@
+/** <header>
+
+ * This file is part of preBowt -- a prefix-based BWT-like transform of
+ * genetic data.
+ *
+ * Copyright 2014 David Eccles (gringer) <bioinformatics@gringene.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * without any warranty; without even the implied warranty of
+ * merchantability or fitness for a particular purpose. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+</header> **/
+
+// Benchmark suite for the D-Tree, the rope and the transform index, on
+// synthetic genomes from 1 Mb up to --genome_max bases (4 Mb by
+// default; 1 Gb needs several GB of memory). Use
+// --benchmark_format=json, or --benchmark_out=<file>
+// --benchmark_out_format=json, for results that can be compared
+// between builds.
+// usage: prebowtbench [--genome_max=<bases>] [benchmark options]
+
+#include <map>
+#include <random>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <thread>
+
+#include <benchmark/benchmark.h>
+
+#include "dtree.hpp"
+#include "rope.hpp"
+#include "prebowt.hpp"
+#include "prebowtconfig.hpp"
+
+using namespace std;
+
+static const uint64_t GENOME_MIN = 1 << 20;
+static const uint64_t GENOME_STEP = 4;
+static const uint64_t CHUNK_LENGTH = 1 << 16; // bases per indexed sequence
+static const size_t PATTERN_LENGTH = 20;
+static const size_t SUBSTR_LENGTH = 1000;
+static const size_t ROPE_LEAF_LENGTH = 1000; // characters per rope leaf
+
+// A random genome of a given length. Genomes, and the trees and
+// indexes made from them, are made once and shared by all benchmarks.
+static const PackedSeq& genome(uint64_t length){
+  static const char BASES[] = "ACGT";
+  static map<uint64_t, PackedSeq> genomes;
+  map<uint64_t, PackedSeq>::iterator it = genomes.find(length);
+  if(it == genomes.end()){
+    mt19937_64 rng(length);
+    string bases(length, 'A');
+    for(uint64_t i = 0; i < length; i++){
+      bases[i] = BASES[rng() & 3];
+    }
+    it = genomes.insert(make_pair(length, PackedSeq(bases))).first;
+  }
+  return it->second;
+}
+
+static const DTree<>& genomeTree(uint64_t length){
+  static map<uint64_t, DTree<> > trees;
+  map<uint64_t, DTree<> >::iterator it = trees.find(length);
+  if(it == trees.end()){
+    it = trees.insert(make_pair(length, DTree<>(genome(length)))).first;
+  }
+  return it->second;
+}
+
+// the genome as a rope, concatenated from ROPE_LEAF_LENGTH pieces
+static Rope makeRope(const string& bases){
+  Rope retVal("");
+  for(size_t pos = 0; pos < bases.length(); pos += ROPE_LEAF_LENGTH){
+    retVal = Rope::concat(retVal, Rope(bases.substr(pos, ROPE_LEAF_LENGTH)));
+  }
+  return retVal;
+}
+
+static const Rope& genomeRope(uint64_t length){
+  static map<uint64_t, Rope> ropes;
+  map<uint64_t, Rope>::iterator it = ropes.find(length);
+  if(it == ropes.end()){
+    it = ropes.insert(make_pair(length,
+                                makeRope(genome(length).bases()))).first;
+  }
+  return it->second;
+}
+
+// the genome, split into sequences that can be sorted in parallel
+static vector<PackedSeq> genomeChunks(uint64_t length){
+  vector<PackedSeq> retVal;
+  const PackedSeq& src = genome(length);
+  for(uint64_t pos = 0; pos < length; pos += CHUNK_LENGTH){
+    retVal.push_back(src.substr(pos, CHUNK_LENGTH));
+  }
+  return retVal;
+}
+
+static size_t threadCount(){
+  return max(thread::hardware_concurrency(), 1u);
+}
+
+static const Prebowt& genomeIndex(uint64_t length){
+  static map<uint64_t, Prebowt> indexes;
+  map<uint64_t, Prebowt>::iterator it = indexes.find(length);
+  if(it == indexes.end()){
+    it = indexes.insert(make_pair(length, Prebowt::build(
+      genomeChunks(length), threadCount()))).first;
+  }
+  return it->second;
+}
+
+// Reports the tree operations per iteration since before, when they
+// are counted (cmake -DPREBOWT_STATS=ON)
+static void addTreeCounters(benchmark::State& state,
+                            const TreeStats& before){
+  static const char* NAMES[] = {"nodes_visited", "leaf_bytes_scanned",
+                                "node_allocations"};
+  static const TreeStats::Counter COUNTERS[] = {
+    TreeStats::NODES_VISITED, TreeStats::LEAF_BYTES_SCANNED,
+    TreeStats::NODE_ALLOCATIONS
+  };
+  if(!TreeStats::enabled()){
+    return;
+  }
+  TreeStats after = TreeStats::snapshot();
+  for(size_t i = 0; i < 3; i++){
+    state.counters[NAMES[i]] = benchmark::Counter(
+      after.counters[COUNTERS[i]] - before.counters[COUNTERS[i]],
+      benchmark::Counter::kAvgIterations);
+  }
+}
+
+// benchmarks; state.range(0) is the genome length
+
+static void BM_TreeConstruct(benchmark::State& state){
+  const PackedSeq& src = genome(state.range(0));
+  for(auto _ : state){
+    DTree<> tree(src);
+    benchmark::DoNotOptimize(tree.length());
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+static void BM_TreeSplit(benchmark::State& state){
+  const DTree<>& tree = genomeTree(state.range(0));
+  mt19937_64 rng(1);
+  TreeStats before = TreeStats::snapshot();
+  for(auto _ : state){
+    DSplit<> parts = tree.split(rng() % tree.length());
+    benchmark::DoNotOptimize(parts.left.length());
+  }
+  addTreeCounters(state, before);
+}
+
+static void BM_TreeAppend(benchmark::State& state){
+  const DTree<>& tree = genomeTree(state.range(0));
+  for(auto _ : state){
+    DTree<> joined = tree.append(tree);
+    benchmark::DoNotOptimize(joined.length());
+  }
+}
+
+static void BM_TreeInsert(benchmark::State& state){
+  const DTree<>& tree = genomeTree(state.range(0));
+  mt19937_64 rng(1);
+  uint8_t code = PackedSeq::encode('G');
+  TreeStats before = TreeStats::snapshot();
+  for(auto _ : state){
+    DTree<> inserted = tree.insertBase(rng() % tree.length(), code);
+    benchmark::DoNotOptimize(inserted.length());
+  }
+  addTreeCounters(state, before);
+}
+
+static void BM_TreeSubstr(benchmark::State& state){
+  const DTree<>& tree = genomeTree(state.range(0));
+  mt19937_64 rng(1);
+  for(auto _ : state){
+    DTree<> part = tree.substr(rng() % (tree.length() - SUBSTR_LENGTH),
+                               SUBSTR_LENGTH);
+    benchmark::DoNotOptimize(part.length());
+  }
+}
+
+static void BM_TreeRank(benchmark::State& state){
+  const DTree<>& tree = genomeTree(state.range(0));
+  mt19937_64 rng(1);
+  TreeStats before = TreeStats::snapshot();
+  for(auto _ : state){
+    PackedSeq::Base base = (PackedSeq::Base)(PackedSeq::A + (rng() & 3));
+    benchmark::DoNotOptimize(tree.rank(base, rng() % tree.length()));
+  }
+  addTreeCounters(state, before);
+}
+
+static void BM_RopeConstruct(benchmark::State& state){
+  string bases = genome(state.range(0)).bases();
+  for(auto _ : state){
+    Rope rope = makeRope(bases);
+    benchmark::DoNotOptimize(rope.length());
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+static void BM_RopeConcat(benchmark::State& state){
+  const Rope& rope = genomeRope(state.range(0));
+  for(auto _ : state){
+    Rope joined = Rope::concat(rope, rope);
+    benchmark::DoNotOptimize(joined.length());
+  }
+}
+
+static void BM_RopeSubstr(benchmark::State& state){
+  const Rope& rope = genomeRope(state.range(0));
+  mt19937_64 rng(1);
+  TreeStats before = TreeStats::snapshot();
+  for(auto _ : state){
+    Rope part = Rope::substr(rope, rng() % (rope.length() - SUBSTR_LENGTH),
+                             SUBSTR_LENGTH);
+    benchmark::DoNotOptimize(part.length());
+  }
+  addTreeCounters(state, before);
+}
+
+static void BM_RopeCharAt(benchmark::State& state){
+  const Rope& rope = genomeRope(state.range(0));
+  mt19937_64 rng(1);
+  TreeStats before = TreeStats::snapshot();
+  for(auto _ : state){
+    benchmark::DoNotOptimize(rope.charAt(rng() % rope.length()));
+  }
+  addTreeCounters(state, before);
+}
+
+static void BM_IndexConstruct(benchmark::State& state){
+  vector<PackedSeq> chunks = genomeChunks(state.range(0));
+  for(auto _ : state){
+    Prebowt index = Prebowt::build(chunks, threadCount());
+    benchmark::DoNotOptimize(index.length());
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+static void BM_IndexCount(benchmark::State& state){
+  const PackedSeq& src = genome(state.range(0));
+  const Prebowt& index = genomeIndex(state.range(0));
+  mt19937_64 rng(1);
+  TreeStats before = TreeStats::snapshot();
+  for(auto _ : state){
+    PackedSeq pattern = src.substr(rng() % (src.length() - PATTERN_LENGTH),
+                                   PATTERN_LENGTH);
+    benchmark::DoNotOptimize(index.count(pattern.bases()));
+  }
+  addTreeCounters(state, before);
+}
+
+static void BM_IndexLocate(benchmark::State& state){
+  const PackedSeq& src = genome(state.range(0));
+  const Prebowt& index = genomeIndex(state.range(0));
+  mt19937_64 rng(1);
+  TreeStats before = TreeStats::snapshot();
+  for(auto _ : state){
+    PackedSeq pattern = src.substr(rng() % (src.length() - PATTERN_LENGTH),
+                                   PATTERN_LENGTH);
+    benchmark::DoNotOptimize(index.locate(pattern.bases()));
+  }
+  addTreeCounters(state, before);
+}
+
+int main(int argc, char** argv){
+  uint64_t genomeMax = 4 * GENOME_MIN;
+  // take --genome_max out of the arguments before the library sees them
+  int argCount = 1;
+  for(int i = 1; i < argc; i++){
+    if(strncmp(argv[i], "--genome_max=", 13) == 0){
+      genomeMax = strtoull(argv[i] + 13, NULL, 10);
+    } else {
+      argv[argCount++] = argv[i];
+    }
+  }
+  argc = argCount;
+  benchmark::Initialize(&argc, argv);
+  if(benchmark::ReportUnrecognizedArguments(argc, argv)){
+    return 1;
+  }
+  benchmark::AddCustomContext("prebowt_version",
+                              to_string(prebowt_VERSION_MAJOR) + "." +
+                              to_string(prebowt_VERSION_MINOR));
+  benchmark::AddCustomContext("genome_max", to_string(genomeMax));
+  vector<benchmark::internal::Benchmark*> suite;
+  suite.push_back(benchmark::RegisterBenchmark("tree_construct",
+                                               BM_TreeConstruct)
+                  ->Unit(benchmark::kMillisecond));
+  suite.push_back(benchmark::RegisterBenchmark("tree_split", BM_TreeSplit));
+  suite.push_back(benchmark::RegisterBenchmark("tree_append",
+                                               BM_TreeAppend));
+  suite.push_back(benchmark::RegisterBenchmark("tree_insert",
+                                               BM_TreeInsert));
+  suite.push_back(benchmark::RegisterBenchmark("tree_substr",
+                                               BM_TreeSubstr));
+  suite.push_back(benchmark::RegisterBenchmark("tree_rank", BM_TreeRank));
+  suite.push_back(benchmark::RegisterBenchmark("rope_construct",
+                                               BM_RopeConstruct)
+                  ->Unit(benchmark::kMillisecond));
+  suite.push_back(benchmark::RegisterBenchmark("rope_concat",
+                                               BM_RopeConcat));
+  suite.push_back(benchmark::RegisterBenchmark("rope_substr",
+                                               BM_RopeSubstr));
+  suite.push_back(benchmark::RegisterBenchmark("rope_char_at",
+                                               BM_RopeCharAt));
+  // construction runs on worker threads, so only wall time is useful
+  suite.push_back(benchmark::RegisterBenchmark("index_construct",
+                                               BM_IndexConstruct)
+                  ->Unit(benchmark::kMillisecond)->UseRealTime());
+  suite.push_back(benchmark::RegisterBenchmark("index_count",
+                                               BM_IndexCount));
+  suite.push_back(benchmark::RegisterBenchmark("index_locate",
+                                               BM_IndexLocate));
+  for(size_t i = 0; i < suite.size(); i++){
+    for(uint64_t length = GENOME_MIN; length <= genomeMax;
+        length *= GENOME_STEP){
+      suite[i]->Arg(length);
+    }
+  }
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
@@ -0,0 +1,91 @@
+/** <header>
+
+ * This file is part of preBowt -- a prefix-based BWT-like transform of
+ * genetic data.
+ *
+ * Copyright 2014 David Eccles (gringer) <bioinformatics@gringene.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * without any warranty; without even the implied warranty of
+ * merchantability or fitness for a particular purpose. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+</header> **/
+
+// Query throughput of one shared index from 1 to N threads, using the
+// work-stealing query executor
+// usage: scalebench [genome length] [queries] [max threads]
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <cstdlib>
+
+#include "prebowt.hpp"
+#include "queryexecutor.hpp"
+#include "prebowtconfig.hpp"
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+static double secondsSince(const Clock::time_point& start){
+  chrono::duration<double> elapsed = Clock::now() - start;
+  return elapsed.count();
+}
+
+int main(int argc, char** argv){
+  size_t genomeLength = (argc > 1) ? strtoull(argv[1], NULL, 10) : 4000000;
+  size_t queryCount = (argc > 2) ? strtoull(argv[2], NULL, 10) : 400000;
+  size_t maxThreads = (argc > 3) ? strtoull(argv[3], NULL, 10) :
+    max(thread::hardware_concurrency(), 1u);
+  static const char BASES[] = "ACGT";
+  static const size_t READ_LENGTH = 1000;
+  static const size_t QUERY_LENGTH = 20;
+  mt19937_64 rng(1);
+  string genome(genomeLength, 'A');
+  for(size_t i = 0; i < genomeLength; i++){
+    genome[i] = BASES[rng() & 3];
+  }
+  vector<PackedSeq> reads;
+  for(size_t i = 0; i < genomeLength; i += READ_LENGTH){
+    reads.push_back(PackedSeq(genome.substr(i, READ_LENGTH)));
+  }
+  Prebowt index(reads);
+  vector<string> queries;
+  for(size_t i = 0; i < queryCount; i++){
+    queries.push_back(genome.substr(rng() % (genomeLength - QUERY_LENGTH),
+                                    QUERY_LENGTH));
+  }
+  cout << "genome: " << genomeLength << " bases; " << queryCount
+       << " queries; " << thread::hardware_concurrency() << " cores"
+       << endl;
+  cout << setw(8) << "threads" << setw(14) << "queries/s"
+       << setw(10) << "speedup" << setw(10) << "same" << endl;
+  vector<uint64_t> reference;
+  double baseRate = 0;
+  for(size_t threads = 1; threads <= maxThreads; threads *= 2){
+    QueryExecutor executor(threads);
+    Clock::time_point start = Clock::now();
+    vector<uint64_t> counts = index.countParallel(queries, executor);
+    double rate = queryCount / secondsSince(start);
+    if(threads == 1){
+      reference = counts;
+      baseRate = rate;
+    }
+    cout << setw(8) << threads << fixed << setprecision(0)
+         << setw(14) << rate << setprecision(2)
+         << setw(10) << (rate / baseRate)
+         << setw(10) << ((counts == reference) ? "yes" : "NO") << endl;
+  }
+}
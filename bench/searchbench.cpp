@@ -0,0 +1,118 @@
+/** <header>
+
+ * This file is part of preBowt -- a prefix-based BWT-like transform of
+ * genetic data.
+ *
+ * Copyright 2014 David Eccles (gringer) <bioinformatics@gringene.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * without any warranty; without even the implied warranty of
+ * merchantability or fitness for a particular purpose. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+</header> **/
+
+// Compares one-at-a-time and batched pattern search throughput, on the
+// live index and on the same index mapped from disk
+// usage: searchbench [genome length] [queries] [query length]
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <random>
+#include <cstdlib>
+#include <cstdio>
+
+#include "prebowt.hpp"
+#include "prebowtconfig.hpp"
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+static double secondsSince(const Clock::time_point& start){
+  chrono::duration<double> elapsed = Clock::now() - start;
+  return elapsed.count();
+}
+
+int main(int argc, char** argv){
+  size_t genomeLength = (argc > 1) ? strtoull(argv[1], NULL, 10) : 4000000;
+  size_t queryCount = (argc > 2) ? strtoull(argv[2], NULL, 10) : 200000;
+  size_t queryLength = (argc > 3) ? strtoull(argv[3], NULL, 10) : 20;
+  static const char BASES[] = "ACGT";
+  static const size_t READ_LENGTH = 1000;
+  mt19937_64 rng(1);
+  string genome(genomeLength, 'A');
+  for(size_t i = 0; i < genomeLength; i++){
+    genome[i] = BASES[rng() & 3];
+  }
+  vector<PackedSeq> reads;
+  for(size_t i = 0; i < genomeLength; i += READ_LENGTH){
+    reads.push_back(PackedSeq(genome.substr(i, READ_LENGTH)));
+  }
+  Clock::time_point start = Clock::now();
+  Prebowt index(reads);
+  cout << "genome: " << genomeLength << " bases; built in "
+       << secondsSince(start) << " s; tree height "
+       << index.transform().height() << endl;
+  // half of the probes are taken from the genome, half are random
+  vector<string> queries;
+  for(size_t i = 0; i < queryCount; i++){
+    if(i & 1){
+      queries.push_back(genome.substr(rng() % (genomeLength - queryLength),
+                                      queryLength));
+    } else {
+      string query(queryLength, 'A');
+      for(size_t j = 0; j < queryLength; j++){
+        query[j] = BASES[rng() & 3];
+      }
+      queries.push_back(query);
+    }
+  }
+  uint64_t singleHits = 0;
+  start = Clock::now();
+  for(size_t i = 0; i < queryCount; i++){
+    singleHits += index.count(queries[i]);
+  }
+  double singleTime = secondsSince(start);
+  uint64_t batchHits = 0;
+  start = Clock::now();
+  vector<uint64_t> counts = index.countBatch(queries);
+  double batchTime = secondsSince(start);
+  for(size_t i = 0; i < queryCount; i++){
+    batchHits += counts[i];
+  }
+  cout << fixed << setprecision(1);
+  cout << "single: " << (singleTime * 1e9 / queryCount) << " ns/query, "
+       << (queryCount / singleTime) << " queries/s (" << singleHits
+       << " hits)" << endl;
+  cout << " batch: " << (batchTime * 1e9 / queryCount) << " ns/query, "
+       << (queryCount / batchTime) << " queries/s (" << batchHits
+       << " hits)" << endl;
+  start = Clock::now();
+  index.save("searchbench.pbi");
+  double saveTime = secondsSince(start);
+  start = Clock::now();
+  MappedPrebowt mapped("searchbench.pbi");
+  double mapTime = secondsSince(start);
+  start = Clock::now();
+  counts = mapped.countBatch(queries);
+  double mappedTime = secondsSince(start);
+  remove("searchbench.pbi");
+  uint64_t mappedHits = 0;
+  for(size_t i = 0; i < queryCount; i++){
+    mappedHits += counts[i];
+  }
+  cout << "mapped: " << (mappedTime * 1e9 / queryCount) << " ns/query, "
+       << (queryCount / mappedTime) << " queries/s (" << mappedHits
+       << " hits); saved in " << setprecision(3) << saveTime
+       << " s, mapped in " << (mapTime * 1e3) << " ms" << endl;
+}
@@ -0,0 +1,149 @@
+/** <header>
+
+ * This file is part of preBowt -- a prefix-based BWT-like transform of
+ * genetic data.
+ *
+ * Copyright 2014 David Eccles (gringer) <bioinformatics@gringene.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * without any warranty; without even the implied warranty of
+ * merchantability or fitness for a particular purpose. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+</header> **/
+
+// Times ingest, count and locate on a single transform against a set of
+// shards in this process, and a set of shards served by child
+// processes over Unix sockets, and checks that all give the same hits
+// usage: shardbench [bases] [shards] [patterns] [threads]
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <random>
+#include <cstdlib>
+#include <sstream>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "shardset.hpp"
+#include "prebowtconfig.hpp"
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+static double secondsSince(const Clock::time_point& start){
+  chrono::duration<double> elapsed = Clock::now() - start;
+  return elapsed.count();
+}
+
+// times ingest and queries on a set, adding its hit count to totalHits
+static void runSet(const string& name, ShardSet& shardSet,
+                   const vector<PackedSeq>& reads,
+                   const vector<string>& patterns, QueryExecutor& executor,
+                   uint64_t& totalHits){
+  Clock::time_point start = Clock::now();
+  shardSet.addSequences(reads, executor);
+  double ingestTime = secondsSince(start);
+  start = Clock::now();
+  vector<uint64_t> counts = shardSet.countBatch(patterns, executor);
+  double countTime = secondsSince(start);
+  start = Clock::now();
+  vector<vector<SeqPos> > hits = shardSet.locateBatch(patterns, executor);
+  double locateTime = secondsSince(start);
+  totalHits = 0;
+  uint64_t checksum = 0;
+  for(size_t i = 0; i < patterns.size(); i++){
+    totalHits += counts[i];
+    for(size_t h = 0; h < hits[i].size(); h++){
+      checksum += hits[i][h].seqId * 1000003 + hits[i][h].offset;
+    }
+  }
+  cout << setw(10) << name << setw(8) << shardSet.shardCount()
+       << fixed << setprecision(3) << setw(10) << ingestTime
+       << setw(10) << countTime << setw(10) << locateTime
+       << setw(10) << totalHits << setw(22) << checksum << endl;
+}
+
+int main(int argc, char** argv){
+  size_t totalLength = (argc > 1) ? strtoull(argv[1], NULL, 10) : 4000000;
+  size_t shardCount = (argc > 2) ? strtoull(argv[2], NULL, 10) : 4;
+  size_t patternCount = (argc > 3) ? strtoull(argv[3], NULL, 10) : 10000;
+  size_t threads = (argc > 4) ? strtoull(argv[4], NULL, 10) : 4;
+  static const char BASES[] = "ACGT";
+  static const size_t READ_LENGTH = 150;
+  static const size_t PATTERN_LENGTH = 12;
+  mt19937_64 rng(1);
+  vector<PackedSeq> reads;
+  vector<string> readBases;
+  for(size_t pos = 0; pos < totalLength; pos += READ_LENGTH){
+    string read(READ_LENGTH, 'A');
+    for(size_t i = 0; i < READ_LENGTH; i++){
+      read[i] = BASES[rng() & 3];
+    }
+    readBases.push_back(read);
+    reads.push_back(PackedSeq(read));
+  }
+  vector<string> patterns;
+  for(size_t i = 0; i < patternCount; i++){
+    const string& read = readBases[rng() % readBases.size()];
+    patterns.push_back(read.substr(rng() % (READ_LENGTH - PATTERN_LENGTH),
+                                   PATTERN_LENGTH));
+  }
+  // shard servers are forked before any threads are started; the
+  // parent keeps its copy of each server until the end, as its
+  // destructor removes the socket
+  vector<string> socketPaths;
+  vector<unique_ptr<ShardServer> > servers;
+  vector<pid_t> children;
+  for(size_t s = 0; s < shardCount; s++){
+    ostringstream path;
+    path << "/tmp/shardbench." << getpid() << "." << s << ".sock";
+    socketPaths.push_back(path.str());
+    servers.emplace_back(new ShardServer(make_shared<LocalShard>(),
+                                         socketPaths.back()));
+    pid_t child = fork();
+    if(child == 0){
+      servers.back()->serve();
+      _exit(0);
+    }
+    children.push_back(child);
+  }
+  QueryExecutor executor(threads);
+  cout << reads.size() << " reads of " << READ_LENGTH << " bases, "
+       << patterns.size() << " patterns of " << PATTERN_LENGTH
+       << " bases" << endl;
+  cout << setw(10) << "set" << setw(8) << "shards" << setw(10) << "ingest s"
+       << setw(10) << "count s" << setw(10) << "locate s"
+       << setw(10) << "hits" << setw(22) << "checksum" << endl;
+  uint64_t hitTotal;
+  ShardSet single;
+  single.addShard(make_shared<LocalShard>(threads));
+  runSet("single", single, reads, patterns, executor, hitTotal);
+  ShardSet local;
+  for(size_t s = 0; s < shardCount; s++){
+    local.addShard(make_shared<LocalShard>());
+  }
+  runSet("local", local, reads, patterns, executor, hitTotal);
+  ShardSet remote;
+  vector<shared_ptr<RemoteShard> > remoteShards;
+  for(size_t s = 0; s < shardCount; s++){
+    remoteShards.push_back(make_shared<RemoteShard>(socketPaths[s]));
+    remote.addShard(remoteShards.back());
+  }
+  runSet("processes", remote, reads, patterns, executor, hitTotal);
+  for(size_t s = 0; s < shardCount; s++){
+    remoteShards[s]->shutdown();
+    waitpid(children[s], NULL, 0);
+  }
+}
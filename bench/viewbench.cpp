@@ -0,0 +1,103 @@
+/** <header>
+
+ * This file is part of preBowt -- a prefix-based BWT-like transform of
+ * genetic data.
+ *
+ * Copyright 2014 David Eccles (gringer) <bioinformatics@gringene.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * without any warranty; without even the implied warranty of
+ * merchantability or fitness for a particular purpose. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+</header> **/
+
+// Times extracting flanking windows around random hits from a tree, as
+// materialized substrings against views read in place
+// usage: viewbench [tree length] [hits] [window length]
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <random>
+#include <cstdlib>
+
+#include "dtree.hpp"
+#include "prebowtconfig.hpp"
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+typedef DTree<> Tree;
+
+static double secondsSince(const Clock::time_point& start){
+  chrono::duration<double> elapsed = Clock::now() - start;
+  return elapsed.count();
+}
+
+int main(int argc, char** argv){
+  size_t treeLength = (argc > 1) ? strtoull(argv[1], NULL, 10) : 8000000;
+  size_t hitCount = (argc > 2) ? strtoull(argv[2], NULL, 10) : 1000000;
+  size_t windowLength = (argc > 3) ? strtoull(argv[3], NULL, 10) : 100;
+  static const char BASES[] = "ACGT";
+  mt19937_64 rng(1);
+  string bases(treeLength, 'A');
+  for(size_t i = 0; i < treeLength; i++){
+    bases[i] = BASES[rng() & 3];
+  }
+  Tree tree(bases);
+  vector<uint64_t> hits(hitCount);
+  for(size_t i = 0; i < hitCount; i++){
+    hits[i] = rng() % treeLength;
+  }
+  cout << hitCount << " windows of " << windowLength << " bases from "
+       << treeLength << " bases" << endl;
+  cout << setw(12) << "method" << setw(12) << "s" << setw(14) << "checksum"
+       << endl;
+  // materialized: a new tree per window, copied out to packed bases
+  Clock::time_point start = Clock::now();
+  uint64_t checksum = 0;
+  for(size_t i = 0; i < hitCount; i++){
+    Tree window = tree.substr(hits[i], windowLength);
+    PackedSeq windowBases;
+    window.appendTo(windowBases, 0, window.length());
+    for(size_t p = 0; p < windowBases.length(); p++){
+      checksum += windowBases[p];
+    }
+  }
+  cout << setw(12) << "substr" << fixed << setprecision(3)
+       << setw(12) << secondsSince(start) << setw(14) << checksum << endl;
+  // views: leaf runs read in place
+  start = Clock::now();
+  checksum = 0;
+  for(size_t i = 0; i < hitCount; i++){
+    tree.view(hits[i], windowLength).forEachLeaf(
+        [&](const PackedSeq& leaf, size_t leafStart, size_t len){
+          const uint8_t* codes = leaf.data() + leafStart;
+          for(size_t p = 0; p < len; p++){
+            checksum += codes[p];
+          }
+        });
+  }
+  cout << setw(12) << "view spans" << setw(12) << secondsSince(start)
+       << setw(14) << checksum << endl;
+  // views: one base at a time
+  start = Clock::now();
+  checksum = 0;
+  for(size_t i = 0; i < hitCount; i++){
+    Tree::View window = tree.view(hits[i], windowLength);
+    for(Tree::View::Iterator it = window.begin(); it != window.end(); ++it){
+      checksum += *it;
+    }
+  }
+  cout << setw(12) << "view iter" << setw(12) << secondsSince(start)
+       << setw(14) << checksum << endl;
+}
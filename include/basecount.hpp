@@ -0,0 +1,70 @@
+/** <header>
+
+ * This file is part of preBowt -- a prefix-based BWT-like transform of
+ * genetic data.
+ *
+ * Copyright 2014 David Eccles (gringer) <bioinformatics@gringene.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * without any warranty; without even the implied warranty of
+ * merchantability or fitness for a particular purpose. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+</header> **/
+
+#ifndef __BASECOUNT_HPP__
+#define __BASECOUNT_HPP__
+
+#include <cstdint>
+#include <cstddef>
+
+#include "packedseq.hpp"
+
+using namespace std;
+
+// In-leaf counting kernels for packed bases. The fastest kernel that
+// the CPU supports (AVX2, SSE2, or a scalar fallback) is chosen on
+// first use; the vector kernels classify every base in a single pass.
+// Bases stored as 2-bit symbols (see CompactSeq) are counted with
+// popcount, using the hardware instruction where available.
+class BaseCounter{
+public:
+  // constants
+  enum Kernel {SCALAR, SSE2, AVX2};
+  // static public methods
+  static uint64_t count(const uint8_t* codes, size_t len,
+                        PackedSeq::Base base);
+  static void countAll(const uint8_t* codes, size_t len, uint64_t* counts);
+  static size_t select(const uint8_t* codes, size_t len,
+                       PackedSeq::Base base, uint64_t nth);
+  static uint64_t countSymbols(const uint64_t* words, size_t len,
+                               unsigned symbol);
+  static Kernel bestKernel();
+  static Kernel kernel();
+  static bool setKernel(Kernel newKernel);
+  static const char* kernelName(Kernel kernel);
+private:
+  // kernel entry points
+  typedef uint64_t (*CountFn)(const uint8_t*, size_t, uint8_t);
+  typedef void (*CountAllFn)(const uint8_t*, size_t, uint64_t*);
+  typedef uint64_t (*CountSymbolsFn)(const uint64_t*, size_t, unsigned);
+  struct Dispatch{
+    Kernel kernel;
+    CountFn count;
+    CountAllFn countAll;
+    CountSymbolsFn countSymbols;
+  };
+  // static accessory methods
+  static Dispatch& active();
+  static Dispatch dispatchFor(Kernel kernel);
+};
+
+#endif //__BASECOUNT_HPP__
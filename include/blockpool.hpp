@@ -0,0 +1,221 @@
+/** <header>
+
+ * This file is part of preBowt -- a prefix-based BWT-like transform of
+ * genetic data.
+ *
+ * Copyright 2014 David Eccles (gringer) <bioinformatics@gringene.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * without any warranty; without even the implied warranty of
+ * merchantability or fitness for a particular purpose. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+</header> **/
+
+#ifndef __BLOCKPOOL_HPP__
+#define __BLOCKPOOL_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <mutex>
+#include <vector>
+
+using namespace std;
+
+// Fixed-size block allocation for tree nodes. Blocks are carved from
+// large slabs and recycled through a free list held by each thread,
+// so allocating a node takes a few instructions with no locking or
+// atomic operations. A thread holding too many free blocks (or
+// exiting) hands a batch back to a shared list for other threads.
+// Nodes can be shared by any number of trees and indexes, so slabs
+// are kept for the life of the program.
+template<size_t BlockBytes, size_t BlockAlign>
+class BlockPool{
+public:
+  // constants
+  static const size_t SLAB_BYTES = 1 << 20;
+  static const size_t BATCH_BLOCKS = 64; // moved to/from the shared list
+  // static public methods
+  static void* allocate();
+  static void release(void* block);
+  static size_t slabCount();
+private:
+  class FreeBlock{
+  public:
+    FreeBlock* next;
+  };
+  // the free blocks of one thread
+  class LocalCache{
+  public:
+    FreeBlock* head;
+    size_t count;
+    LocalCache() : head(NULL), count(0){}
+    ~LocalCache(){ giveBack(*this, count); }
+  };
+  // the free blocks shared between threads
+  class SharedPool{
+  public:
+    mutex lock;
+    FreeBlock* head;
+    size_t count;
+    vector<void*> slabs;
+    SharedPool() : head(NULL), count(0){}
+  };
+  // constants
+  static_assert(BlockAlign <= alignof(max_align_t),
+                "slabs are only aligned for fundamental types");
+  static const size_t BLOCK_SIZE =
+    (((BlockBytes > sizeof(FreeBlock)) ? BlockBytes : sizeof(FreeBlock))
+     + BlockAlign - 1) / BlockAlign * BlockAlign;
+  static const size_t SLAB_BLOCKS = SLAB_BYTES / BLOCK_SIZE;
+  static_assert(SLAB_BLOCKS >= BATCH_BLOCKS,
+                "blocks are too large to be pooled");
+  // static accessory methods
+  static LocalCache& localCache();
+  static SharedPool& sharedPool();
+  static void refill(LocalCache& cache);
+  static void giveBack(LocalCache& cache, size_t blockCount);
+};
+
+// An allocator for node-based containers and allocate_shared: single
+// objects come from the BlockPool for their size, arrays from the heap.
+template<class T>
+class PoolAllocator{
+public:
+  typedef T value_type;
+  // constructors
+  PoolAllocator(){}
+  template<class U>
+  PoolAllocator(const PoolAllocator<U>&){}
+  // public methods
+  T* allocate(size_t n){
+    if(n == 1){
+      return static_cast<T*>(BlockPool<sizeof(T), alignof(T)>::allocate());
+    }
+    return static_cast<T*>(::operator new(n * sizeof(T)));
+  }
+  void deallocate(T* ptr, size_t n){
+    if(n == 1){
+      BlockPool<sizeof(T), alignof(T)>::release(ptr);
+    } else {
+      ::operator delete(ptr);
+    }
+  }
+};
+
+template<class T, class U>
+bool operator==(const PoolAllocator<T>&, const PoolAllocator<U>&){
+  return true;
+}
+
+template<class T, class U>
+bool operator!=(const PoolAllocator<T>&, const PoolAllocator<U>&){
+  return false;
+}
+
+// static public methods
+
+template<size_t BlockBytes, size_t BlockAlign>
+void* BlockPool<BlockBytes, BlockAlign>::allocate(){
+  LocalCache& cache = localCache();
+  if(cache.head == NULL){
+    refill(cache);
+  }
+  FreeBlock* retVal = cache.head;
+  cache.head = retVal->next;
+  cache.count--;
+  return retVal;
+}
+
+template<size_t BlockBytes, size_t BlockAlign>
+void BlockPool<BlockBytes, BlockAlign>::release(void* block){
+  LocalCache& cache = localCache();
+  FreeBlock* freed = static_cast<FreeBlock*>(block);
+  freed->next = cache.head;
+  cache.head = freed;
+  cache.count++;
+  if(cache.count >= 2 * BATCH_BLOCKS){
+    giveBack(cache, BATCH_BLOCKS);
+  }
+}
+
+// number of slabs allocated so far, for all threads
+template<size_t BlockBytes, size_t BlockAlign>
+size_t BlockPool<BlockBytes, BlockAlign>::slabCount(){
+  SharedPool& shared = sharedPool();
+  lock_guard<mutex> guard(shared.lock);
+  return shared.slabs.size();
+}
+
+// private static accessory methods
+
+template<size_t BlockBytes, size_t BlockAlign>
+typename BlockPool<BlockBytes, BlockAlign>::LocalCache&
+BlockPool<BlockBytes, BlockAlign>::localCache(){
+  static thread_local LocalCache retVal;
+  return retVal;
+}
+
+// never destroyed, so that blocks can be released during exit
+template<size_t BlockBytes, size_t BlockAlign>
+typename BlockPool<BlockBytes, BlockAlign>::SharedPool&
+BlockPool<BlockBytes, BlockAlign>::sharedPool(){
+  static SharedPool* retVal = new SharedPool();
+  return *retVal;
+}
+
+// moves a batch of blocks from the shared list to an empty cache,
+// carving a new slab if the shared list has run out
+template<size_t BlockBytes, size_t BlockAlign>
+void BlockPool<BlockBytes, BlockAlign>::refill(LocalCache& cache){
+  SharedPool& shared = sharedPool();
+  lock_guard<mutex> guard(shared.lock);
+  if(shared.head == NULL){
+    uint8_t* slab = static_cast<uint8_t*>(::operator new(SLAB_BYTES));
+    shared.slabs.push_back(slab);
+    for(size_t i = SLAB_BLOCKS; i-- > 0;){
+      FreeBlock* block = reinterpret_cast<FreeBlock*>(slab + i * BLOCK_SIZE);
+      block->next = shared.head;
+      shared.head = block;
+    }
+    shared.count += SLAB_BLOCKS;
+  }
+  for(size_t i = 0; (i < BATCH_BLOCKS) && (shared.head != NULL); i++){
+    FreeBlock* block = shared.head;
+    shared.head = block->next;
+    shared.count--;
+    block->next = cache.head;
+    cache.head = block;
+    cache.count++;
+  }
+}
+
+// moves blockCount blocks from a cache to the shared list
+template<size_t BlockBytes, size_t BlockAlign>
+void BlockPool<BlockBytes, BlockAlign>::giveBack(LocalCache& cache,
+                                                 size_t blockCount){
+  if(blockCount == 0){
+    return;
+  }
+  SharedPool& shared = sharedPool();
+  lock_guard<mutex> guard(shared.lock);
+  for(size_t i = 0; i < blockCount; i++){
+    FreeBlock* block = cache.head;
+    cache.head = block->next;
+    cache.count--;
+    block->next = shared.head;
+    shared.head = block;
+    shared.count++;
+  }
+}
+
+#endif //__BLOCKPOOL_HPP__
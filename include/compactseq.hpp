@@ -0,0 +1,94 @@
+/** <header>
+
+ * This file is part of preBowt -- a prefix-based BWT-like transform of
+ * genetic data.
+ *
+ * Copyright 2014 David Eccles (gringer) <bioinformatics@gringene.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * without any warranty; without even the implied warranty of
+ * merchantability or fitness for a particular purpose. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+</header> **/
+
+#ifndef __COMPACTSEQ_HPP__
+#define __COMPACTSEQ_HPP__
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <ostream>
+
+#include "packedseq.hpp"
+
+using namespace std;
+
+// A compressed run of bases in the prebowt encoding, for use as a
+// D-Tree leaf (DTree<Fanout, LeafBytes, CompactSeq>). Each sequence is
+// stored in whichever of two forms is smaller:
+//  - 2-bit symbols for A/C/G/T, with end markers and ambiguous bases
+//    in a sorted exception list (their symbol slot holds A), and
+//    quality nibbles in a side array that is omitted when all
+//    qualities are zero;
+//  - runs of identical codes, for the long runs of sorted transforms.
+// rank, occ, select and at run directly on the compressed form. The
+// encoded form is immutable and shared between copies; edits decode,
+// change and re-encode the sequence.
+class CompactSeq{
+  friend ostream& operator<<(ostream& out, const CompactSeq& src);
+public:
+  typedef PackedSeq::Base Base;
+  // constructors
+  CompactSeq(); // create empty sequence
+  CompactSeq(const PackedSeq& src); // encode bases
+  // public methods
+  CompactSeq substr(size_t start, size_t len = string::npos) const;
+  void append(const CompactSeq& src);
+  void append(const PackedSeq& src);
+  void insert(size_t pos, uint8_t code);
+  size_t length() const;
+  uint8_t operator[](size_t pos) const;
+  uint64_t rank(Base base, size_t pos) const;
+  void occ(size_t pos, uint64_t* counts) const;
+  size_t select(Base base, uint64_t nth) const;
+  void prefetch(size_t pos) const;
+  void appendTo(PackedSeq& dest, size_t start, size_t len) const;
+  PackedSeq decode() const;
+  size_t memoryBytes() const;
+  bool isRunEncoded() const;
+private:
+  // a base that is not stored as a 2-bit symbol
+  class Exception{
+  public:
+    uint32_t pos;
+    uint8_t code;
+  };
+  // the encoded form, shared between copies
+  class Encoded{
+  public:
+    uint32_t length;
+    bool runEncoded;
+    vector<uint64_t> symbols; // 2-bit symbols, 32 per word
+    vector<Exception> exceptions; // sorted by position
+    vector<uint8_t> quals; // quality nibbles, two per byte
+    vector<uint8_t> runCodes;
+    vector<uint32_t> runEnds; // end position of each run
+  };
+  // fields
+  shared_ptr<const Encoded> encoded; // NULL for empty sequences
+  // accessory methods
+  size_t exceptionsBefore(size_t pos) const;
+  size_t runAt(size_t pos) const;
+};
+
+#endif //__COMPACTSEQ_HPP__
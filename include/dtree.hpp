@@ -26,57 +26,1222 @@
 #include <string>
 #include <memory>
 #include <limits>
+#include <ostream>
+#include <vector>
+#include <algorithm>
+#include <iterator>
+
+#include "packedseq.hpp"
+#include "blockpool.hpp"
+#include "nodenumber.hpp"
+#include "treestats.hpp"
 
 using namespace std;
 
-class DSplit;
+template<size_t Fanout, size_t LeafBytes, class Leaf> class DSplit;
 
+// A D-Tree is a B+-Tree over a packed base sequence. Internal nodes
+// hold up to Fanout children together with the base counts (deltas)
+// of each child; leaves hold up to LeafBytes packed bases. Rank
+// queries sum deltas on the way down, so only one leaf is scanned. All
+// operations are non-destructive: results share unchanged nodes with
+// their sources. Leaves store their bases as a Leaf sequence
+// (PackedSeq, or the compressed CompactSeq). Every node below the root
+// is at least half full (SEQ_MIN bases, or PTR_MIN children), so a
+// query visits at most log_{Fanout/2}(n) nodes.
+template<size_t Fanout = 16, size_t LeafBytes = 4096, class Leaf = PackedSeq>
 class DTree{
-  friend ostream& operator<<(ostream& out, const DTree& src);
+  template<size_t F, size_t L, class S>
+  friend ostream& operator<<(ostream& out, const DTree<F,L,S>& src);
+  friend class MappedTree; // writes node records directly
+  static_assert(Fanout >= 2, "D-Tree nodes need at least two children");
+  static_assert(LeafBytes >= 1, "D-Tree leaves need at least one base");
 public:
   // constants
-  enum Base : size_t {END, A, C, G, T, AMBIG, ALL};
-  enum Limits {
-    SEQ_MIN = 2,
-    SEQ_MAX = 4,
-    PTR_MAX = 5
+  typedef PackedSeq::Base Base;
+  // an incremental rank query, advanced one tree level per rankStep()
+  // so that many queries can be interleaved to hide memory latency
+  class RankCursor{
+  public:
+    const DTree* node; // NULL once the query is complete
+    uint64_t pos;
+    uint64_t rank;
+    Base base;
+    bool leafReady; // leaf bases have been prefetched
+  };
+  enum Limits : size_t {
+    SEQ_MAX = LeafBytes, // bases per leaf
+    PTR_MAX = Fanout, // children per internal node
+    SEQ_MIN = (LeafBytes + 1) / 2, // below the root
+    PTR_MIN = (Fanout + 1) / 2
+  };
+  // Builds a tree bottom-up from bases added in order. Leaves are
+  // filled to SEQ_MAX and nodes to PTR_MAX; finish() evens out the last
+  // two nodes of each level, so that all are at least half full. The
+  // nodes of each level are held until they fill a parent, so only a
+  // few nodes per level (and less than a leaf of bases) are pending.
+  class Loader{
+  public:
+    Loader();
+    void push_back(uint8_t code);
+    void append(const uint8_t* src, size_t len);
+    void append(const PackedSeq& src);
+    void append(const DTree& src, uint64_t start, uint64_t len);
+    DTree finish(); // the loaded tree; the loader is left empty
+  private:
+    PackedSeq pending; // fewer than SEQ_MAX bases
+    // nodes not yet in a parent, by height; each level keeps at least
+    // one node back, so that finish() can even out the last two
+    vector<vector<shared_ptr<DTree> > > levels;
+    void addLeaves(bool all);
+    void addNode(size_t level, const shared_ptr<DTree>& node);
+  };
+  // A read-only window [start,start+len) of a tree. A view points to
+  // the tree without copying it, so the tree must outlive the view;
+  // making, reading and narrowing views allocates nothing. Bases are
+  // read by position, by iterating in either direction, or a leaf at
+  // a time; materialize() builds a tree only when one is needed.
+  class View{
+  public:
+    // a read-only bidirectional iterator over the encoded bases of a
+    // view; it keeps the current leaf, so each step is amortised O(1)
+    class Iterator{
+    public:
+      typedef bidirectional_iterator_tag iterator_category;
+      typedef uint8_t value_type;
+      typedef ptrdiff_t difference_type;
+      typedef const uint8_t* pointer;
+      typedef uint8_t reference;
+      Iterator();
+      Iterator(const View& src, uint64_t viewPos);
+      uint8_t operator*() const;
+      Iterator& operator++();
+      Iterator& operator--();
+      bool operator==(const Iterator& other) const;
+      bool operator!=(const Iterator& other) const;
+      uint64_t position() const; // in the view
+    private:
+      const DTree* root;
+      const DTree* leaf; // the leaf holding pos, or NULL
+      uint64_t leafStart; // tree position of the first base of leaf
+      uint64_t first; // tree positions of the view
+      uint64_t last;
+      uint64_t pos; // tree position
+      void findLeaf();
+    };
+    typedef reverse_iterator<Iterator> ReverseIterator;
+    View(); // an empty view
+    View(const DTree& src, uint64_t start, uint64_t len);
+    uint64_t length() const;
+    uint8_t at(uint64_t pos) const;
+    View substr(uint64_t start,
+                 uint64_t len = numeric_limits<uint64_t>::max()) const;
+    Iterator begin() const;
+    Iterator end() const;
+    ReverseIterator rbegin() const;
+    ReverseIterator rend() const;
+    template<class Visit>
+    void forEachLeaf(Visit visit) const;
+    void appendTo(PackedSeq& dest) const;
+    DTree materialize() const;
+  private:
+    const DTree* root; // NULL for empty views
+    uint64_t start;
+    uint64_t len;
   };
   // constructors
   DTree(); // create empty tree
   DTree(const string& src); // create initial tree from string
+  DTree(const PackedSeq& src); // create initial tree from encoded bases
   DTree(const DTree& src); // copy constructor
+  DTree(DTree&& src); // move constructor
   // operators
   DTree& operator=(const DTree& src); // assignment operator
+  DTree& operator=(DTree&& src); // move assignment operator
   // public methods
   DTree substr(const uint64_t& start, const uint64_t& len) const;
-  DSplit split(const uint64_t& splitPos) const;
+  DSplit<Fanout, LeafBytes, Leaf> split(const uint64_t& splitPos) const;
   DTree append(const DTree& src) const;
   DTree insert(const uint64_t& pos, const DTree& src) const;
+  DTree insertBase(uint64_t pos, uint8_t code) const;
   uint64_t length() const;
+  size_t height() const;
+  uint64_t count(Base base) const;
+  uint64_t rank(Base base, uint64_t pos) const;
+  void occ(uint64_t pos, uint64_t* counts) const;
+  uint64_t select(Base base, uint64_t nth) const;
+  uint8_t at(uint64_t pos) const;
+  uint64_t rankAt(uint64_t pos, uint8_t& code) const;
+  void appendTo(PackedSeq& dest, uint64_t start, uint64_t len) const;
+  RankCursor rankCursor(Base base, uint64_t pos) const;
+  View view(uint64_t start = 0,
+            uint64_t len = numeric_limits<uint64_t>::max()) const;
+  void addShape(TreeStats& dest, size_t level = 0) const;
+  // static public methods
+  static bool rankStep(RankCursor& cursor);
+  static DTree fromLeaf(const Leaf& src);
 protected:
 private:
-  // shared fields
-  static size_t leafDepth;
-  static size_t nextNodeNum;
+  // constants
+  typedef PoolAllocator<DTree> NodeAllocator;
   // personal fields
-  uint64_t deltas[PTR_MAX];
+  // per-child base counts, stored by base so that a rank query reads
+  // one contiguous row; deltas[ALL] holds the child lengths
+  uint64_t deltas[PackedSeq::ALL + 1][PTR_MAX];
   shared_ptr<DTree> nodes[PTR_MAX];
-  string sequences[SEQ_MAX];
+  Leaf sequence;
   size_t nodeCount;
   size_t depth;
   size_t nodeNum;
-  uint64_t seqLength;
+  uint64_t totals[PackedSeq::ALL + 1];
+  // static accessory methods
+  static DTree join(const DTree& left, const DTree& right);
+  static DTree fromNodes(const shared_ptr<DTree>* src, size_t count);
+  static shared_ptr<DTree> parentOf(const shared_ptr<DTree>* src,
+                                    size_t count);
+  static void addBalanced(vector<shared_ptr<DTree> >& dest,
+                          const shared_ptr<DTree>* src, size_t count);
+  template<class... Args>
+  static shared_ptr<DTree> newNode(Args&&... args);
   // accessory methods
   void initialise();
+  void takeFrom(DTree& src);
+  bool isLeaf() const;
+  const DTree* leafAt(uint64_t& pos) const;
+  template<class Visit>
+  void visitLeaves(uint64_t start, uint64_t len, Visit& visit) const;
+  void inplaceAppend(const shared_ptr<DTree>& src);
   void inplaceAppend(const DTree& src, size_t fromNode = 0,
                      size_t toNode = numeric_limits<size_t>::max());
   void inplaceAppend(const string& src);
+  void inplaceAppend(const PackedSeq& src);
 };
 
+template<size_t Fanout = 16, size_t LeafBytes = 4096, class Leaf = PackedSeq>
 class DSplit{
 public:
-  DTree left;
-  DTree right;
+  DTree<Fanout, LeafBytes, Leaf> left;
+  DTree<Fanout, LeafBytes, Leaf> right;
 };
 
+template<size_t F, size_t L, class S>
+ostream& operator<<(ostream& out, const DTree<F,L,S>& src){
+#if NODE_DEBUG
+  out << "{";
+#if MEMORY_DEBUG
+  out << "#" << src.nodeNum;
+#endif
+#endif
+  if(src.isLeaf()){
+#if NODE_DEBUG
+    out << "[";
+#endif
+    out << src.sequence;
+#if NODE_DEBUG
+    out << "]";
+#endif
+  }
+  for(size_t i = 0; i < src.nodeCount; i++){
+#if NODE_DEBUG
+    out << "<" << src.deltas[PackedSeq::ALL][i] << ">";
+#endif
+    out << *(src.nodes[i]);
+  }
+#if NODE_DEBUG
+  out << "}";
+#endif
+  return out;
+}
+
+// constructors
+
+template<size_t Fanout, size_t LeafBytes, class Leaf>
+DTree<Fanout, LeafBytes, Leaf>::DTree(){
+  initialise();
+}
+
+template<size_t Fanout, size_t LeafBytes, class Leaf>
+DTree<Fanout, LeafBytes, Leaf>::DTree(const string& src){
+  initialise();
+  inplaceAppend(src);
+#if MEMORY_DEBUG
+  cerr << "%% " << *this << endl;
+#endif
+}
+
+template<size_t Fanout, size_t LeafBytes, class Leaf>
+DTree<Fanout, LeafBytes, Leaf>::DTree(const PackedSeq& src){
+  initialise();
+  inplaceAppend(src);
+}
+
+// Copy constructor (shallow copy)
+template<size_t Fanout, size_t LeafBytes, class Leaf>
+DTree<Fanout, LeafBytes, Leaf>::DTree(const DTree& src){
+  initialise();
+  depth = src.depth;
+  sequence = src.sequence;
+  if(src.isLeaf()){
+    copy(src.totals, src.totals + PackedSeq::ALL + 1, totals);
+  }
+  inplaceAppend(src);
+}
+
+// Move constructor: takes the children and bases of src, which is
+// left empty
+template<size_t Fanout, size_t LeafBytes, class Leaf>
+DTree<Fanout, LeafBytes, Leaf>::DTree(DTree&& src){
+  initialise();
+  takeFrom(src);
+}
+
+// Assignment operator (shallow copy)
+template<size_t Fanout, size_t LeafBytes, class Leaf>
+DTree<Fanout, LeafBytes, Leaf>&
+DTree<Fanout, LeafBytes, Leaf>::operator=(const DTree& src){
+  if(this != &src){ // gracefully handle self assignment
+    // src may be owned by one of our own nodes, so they are kept
+    // until the copy is complete
+    shared_ptr<DTree> oldNodes[PTR_MAX];
+    for(size_t i = 0; i < nodeCount; i++){
+      oldNodes[i] = move(nodes[i]);
+    }
+    initialise();
+    depth = src.depth;
+    sequence = src.sequence;
+    if(src.isLeaf()){
+      copy(src.totals, src.totals + PackedSeq::ALL + 1, totals);
+    }
+    inplaceAppend(src);
+  }
+  return *this;
+}
+
+// Move assignment operator
+template<size_t Fanout, size_t LeafBytes, class Leaf>
+DTree<Fanout, LeafBytes, Leaf>&
+DTree<Fanout, LeafBytes, Leaf>::operator=(DTree&& src){
+  if(this != &src){
+    shared_ptr<DTree> oldNodes[PTR_MAX];
+    for(size_t i = 0; i < nodeCount; i++){
+      oldNodes[i] = move(nodes[i]);
+    }
+    initialise();
+    takeFrom(src);
+  }
+  return *this;
+}
+
+// public methods
+
+// The bases in [start,start+len), truncated to the end of the tree.
+// Children entirely within the range are shared; only the nodes along
+// the two edges of the range are rebuilt, and leaves at the edges
+// become views of the original bases.
+template<size_t Fanout, size_t LeafBytes, class Leaf>
+DTree<Fanout, LeafBytes, Leaf>
+DTree<Fanout, LeafBytes, Leaf>::substr(const uint64_t& start,
+                                       const uint64_t& len) const{
+  if((start >= length()) || (len == 0)){
+    return DTree();
+  }
+  uint64_t subLen = min(len, length() - start);
+  if(subLen == length()){
+    return *this;
+  }
+  if(isLeaf()){
+    return fromLeaf(sequence.substr(start, subLen));
+  }
+  const uint64_t* lengths = deltas[PackedSeq::ALL];
+  size_t first = 0;
+  uint64_t firstStart = start;
+  for(; firstStart >= lengths[first]; first++){
+    firstStart -= lengths[first];
+  }
+  uint64_t firstLen = min(subLen, lengths[first] - firstStart);
+  DTree retVal = nodes[first]->substr(firstStart, firstLen);
+  subLen -= firstLen;
+  size_t last = first + 1;
+  for(; (last < nodeCount) && (subLen >= lengths[last]); last++){
+    subLen -= lengths[last];
+  }
+  if(last > (first + 1)){
+    retVal = join(retVal, fromNodes(nodes + first + 1, last - first - 1));
+  }
+  if(subLen > 0){
+    retVal = join(retVal, nodes[last]->substr(0, subLen));
+  }
+  return retVal;
+}
+
+// splits a tree into two component DTrees at location pos
+// retVal.left: this[0,pos)
+// retVal.right: this[pos,this->length())
+template<size_t Fanout, size_t LeafBytes, class Leaf>
+DSplit<Fanout, LeafBytes, Leaf>
+DTree<Fanout, LeafBytes, Leaf>::split(const uint64_t& splitPos) const{
+  TREE_STAT(SPLITS, 1);
+  DSplit<Fanout, LeafBytes, Leaf> retVal;
+  if(splitPos == 0){
+    retVal.right = *this;
+    return retVal;
+  }
+  if(splitPos >= length()){
+    retVal.left = *this;
+    return retVal;
+  }
+  if(isLeaf()){
+    retVal.left = fromLeaf(sequence.substr(0, splitPos));
+    retVal.right = fromLeaf(sequence.substr(splitPos));
+    return retVal;
+  }
+  // find the child containing the split point
+  size_t splitNode = 0;
+  uint64_t startPosSplit = 0;
+  while((startPosSplit + deltas[PackedSeq::ALL][splitNode]) <= splitPos){
+    startPosSplit += deltas[PackedSeq::ALL][splitNode++];
+  }
+  DSplit<Fanout, LeafBytes, Leaf> childSplit =
+    nodes[splitNode]->split(splitPos - startPosSplit);
+  retVal.left = join(fromNodes(nodes, splitNode), childSplit.left);
+  retVal.right = join(childSplit.right,
+                      fromNodes(nodes + splitNode + 1,
+                                nodeCount - splitNode - 1));
+  return retVal;
+}
+
+template<size_t Fanout, size_t LeafBytes, class Leaf>
+DTree<Fanout, LeafBytes, Leaf>
+DTree<Fanout, LeafBytes, Leaf>::append(const DTree& src) const{
+  TREE_STAT(APPENDS, 1);
+  return join(*this, src);
+}
+
+template<size_t Fanout, size_t LeafBytes, class Leaf>
+DTree<Fanout, LeafBytes, Leaf>
+DTree<Fanout, LeafBytes, Leaf>::insert(const uint64_t& pos,
+                                       const DTree& src) const{
+  DSplit<Fanout, LeafBytes, Leaf> insertSplit = split(pos);
+  return insertSplit.left.append(src).append(insertSplit.right);
+}
+
+// Inserts a single encoded base before position pos. Only the nodes on
+// the path to the leaf are copied; a leaf (or node) that overflows is
+// split in half, and the extra node is passed up to its parent.
+template<size_t Fanout, size_t LeafBytes, class Leaf>
+DTree<Fanout, LeafBytes, Leaf>
+DTree<Fanout, LeafBytes, Leaf>::insertBase(uint64_t pos, uint8_t code) const{
+  shared_ptr<DTree> children[PTR_MAX + 1];
+  size_t childCount = 0;
+  if(isLeaf()){
+    Leaf newSequence = sequence;
+    newSequence.insert(pos, code);
+    if(newSequence.length() <= SEQ_MAX){
+      return fromLeaf(newSequence); // shares the new bases
+    }
+    TREE_STAT(OVERFLOWS, 1);
+    size_t half = newSequence.length() / 2;
+    children[childCount++] = newNode(fromLeaf(newSequence.substr(0, half)));
+    children[childCount++] = newNode(fromLeaf(newSequence.substr(half)));
+    return fromNodes(children, childCount);
+  }
+  const uint64_t* lengths = deltas[PackedSeq::ALL];
+  size_t insertNode = 0;
+  for(; ((insertNode + 1) < nodeCount) && (pos > lengths[insertNode]);
+      insertNode++){
+    pos -= lengths[insertNode];
+  }
+  for(size_t i = 0; i < insertNode; i++){
+    children[childCount++] = nodes[i];
+  }
+  DTree child = nodes[insertNode]->insertBase(pos, code);
+  if(child.depth < depth){
+    children[childCount++] = newNode(move(child));
+  } else {
+    for(size_t i = 0; i < child.nodeCount; i++){
+      children[childCount++] = move(child.nodes[i]);
+    }
+  }
+  for(size_t i = insertNode + 1; i < nodeCount; i++){
+    children[childCount++] = nodes[i];
+  }
+  return fromNodes(children, childCount);
+}
+
+template<size_t Fanout, size_t LeafBytes, class Leaf>
+uint64_t DTree<Fanout, LeafBytes, Leaf>::length() const{
+  return totals[PackedSeq::ALL];
+}
+
+// number of internal levels above the leaves
+template<size_t Fanout, size_t LeafBytes, class Leaf>
+size_t DTree<Fanout, LeafBytes, Leaf>::height() const{
+  return depth;
+}
+
+// number of bases of a given class in the tree
+template<size_t Fanout, size_t LeafBytes, class Leaf>
+uint64_t DTree<Fanout, LeafBytes, Leaf>::count(Base base) const{
+  return totals[base];
+}
+
+// number of bases of a given class in [0,pos). Deltas of the children
+// to the left of the path are summed on the way down, so only the
+// final leaf is scanned.
+template<size_t Fanout, size_t LeafBytes, class Leaf>
+uint64_t DTree<Fanout, LeafBytes, Leaf>::rank(Base base, uint64_t pos) const{
+  if(pos >= length()){
+    return totals[base];
+  }
+  TREE_STAT(QUERIES, 1);
+  TREE_STAT(NODES_VISITED, depth + 1);
+  uint64_t retVal = 0;
+  const DTree* node = this;
+  while(!node->isLeaf()){
+    const uint64_t* lengths = node->deltas[PackedSeq::ALL];
+    size_t i = 0;
+    for(; pos >= lengths[i]; i++){
+      pos -= lengths[i];
+      retVal += node->deltas[base][i];
+    }
+    node = node->nodes[i].get();
+  }
+  TREE_STAT(LEAF_BYTES_SCANNED, pos);
+  return retVal + node->sequence.rank(base, pos);
+}
+
+// fills counts[END..N] with the number of bases of each class in
+// [0,pos), and counts[ALL] with min(pos, length())
+template<size_t Fanout, size_t LeafBytes, class Leaf>
+void DTree<Fanout, LeafBytes, Leaf>::occ(uint64_t pos, uint64_t* counts) const{
+  if(pos >= length()){
+    copy(totals, totals + PackedSeq::ALL + 1, counts);
+    return;
+  }
+  TREE_STAT(QUERIES, 1);
+  TREE_STAT(NODES_VISITED, depth + 1);
+  fill(counts, counts + PackedSeq::ALL + 1, 0);
+  const DTree* node = this;
+  while(!node->isLeaf()){
+    const uint64_t* lengths = node->deltas[PackedSeq::ALL];
+    size_t i = 0;
+    for(; pos >= lengths[i]; i++){
+      pos -= lengths[i];
+      for(size_t b = 0; b <= PackedSeq::ALL; b++){
+        counts[b] += node->deltas[b][i];
+      }
+    }
+    node = node->nodes[i].get();
+  }
+  TREE_STAT(LEAF_BYTES_SCANNED, pos);
+  node->sequence.occ(pos, counts);
+}
+
+// appends the bases in [start,start+len) to dest
+template<size_t Fanout, size_t LeafBytes, class Leaf>
+void DTree<Fanout, LeafBytes, Leaf>::appendTo(PackedSeq& dest,
+                                              uint64_t start,
+                                              uint64_t len) const{
+  if(isLeaf()){
+    sequence.appendTo(dest, start, len);
+    return;
+  }
+  for(size_t i = 0; (i < nodeCount) && (len > 0); i++){
+    uint64_t childLength = deltas[PackedSeq::ALL][i];
+    if(start >= childLength){
+      start -= childLength;
+      continue;
+    }
+    uint64_t childLen = min(len, childLength - start);
+    nodes[i]->appendTo(dest, start, childLen);
+    len -= childLen;
+    start = 0;
+  }
+}
+
+// a view of the bases in [start,start+len), truncated to the end of
+// the tree
+template<size_t Fanout, size_t LeafBytes, class Leaf>
+typename DTree<Fanout, LeafBytes, Leaf>::View
+DTree<Fanout, LeafBytes, Leaf>::view(uint64_t start, uint64_t len) const{
+  return View(*this, start, len);
+}
+
+// Starts an incremental rank(base, pos) query. The root is
+// prefetched; the result is in cursor.rank once rankStep() returns true.
+template<size_t Fanout, size_t LeafBytes, class Leaf>
+typename DTree<Fanout, LeafBytes, Leaf>::RankCursor
+DTree<Fanout, LeafBytes, Leaf>::rankCursor(Base base, uint64_t pos) const{
+  RankCursor retVal = {this, pos, 0, base, false};
+  if(pos >= length()){
+    retVal.node = NULL;
+    retVal.rank = totals[base];
+  } else {
+    TREE_STAT(QUERIES, 1);
+    TREE_STAT(NODES_VISITED, depth + 1);
+    __builtin_prefetch(deltas[PackedSeq::ALL]);
+    __builtin_prefetch(deltas[base]);
+  }
+  return retVal;
+}
+
+// Advances a rank query by one level, prefetching the next node (or
+// the leaf bases) for the following step. Returns true when done.
+template<size_t Fanout, size_t LeafBytes, class Leaf>
+bool DTree<Fanout, LeafBytes, Leaf>::rankStep(RankCursor& cursor){
+  const DTree* node = cursor.node;
+  if(node == NULL){
+    return true;
+  }
+  if(node->isLeaf()){
+    if(!cursor.leafReady){
+      node->sequence.prefetch(cursor.pos);
+      cursor.leafReady = true;
+      return false;
+    }
+    TREE_STAT(LEAF_BYTES_SCANNED, cursor.pos);
+    cursor.rank += node->sequence.rank(cursor.base, cursor.pos);
+    cursor.node = NULL;
+    return true;
+  }
+  const uint64_t* lengths = node->deltas[PackedSeq::ALL];
+  size_t i = 0;
+  for(; cursor.pos >= lengths[i]; i++){
+    cursor.pos -= lengths[i];
+    cursor.rank += node->deltas[cursor.base][i];
+  }
+  cursor.node = node->nodes[i].get();
+  __builtin_prefetch(cursor.node);
+  __builtin_prefetch(cursor.node->deltas[PackedSeq::ALL]);
+  __builtin_prefetch(cursor.node->deltas[cursor.base]);
+  return false;
+}
+
+// adds the depth and fill of each node below this one (at the given
+// level below the root) to dest
+template<size_t Fanout, size_t LeafBytes, class Leaf>
+void DTree<Fanout, LeafBytes, Leaf>::addShape(TreeStats& dest,
+                                              size_t level) const{
+  if(isLeaf()){
+    dest.addLeaf(level, length(), SEQ_MAX);
+    return;
+  }
+  dest.addNode(nodeCount, PTR_MAX);
+  for(size_t i = 0; i < nodeCount; i++){
+    nodes[i]->addShape(dest, level + 1);
+  }
+}
+
+// position of the nth (0-based) base of a given class, or length() if
+// there are not that many
+template<size_t Fanout, size_t LeafBytes, class Leaf>
+uint64_t DTree<Fanout, LeafBytes, Leaf>::select(Base base, uint64_t nth) const{
+  if(nth >= totals[base]){
+    return length();
+  }
+  TREE_STAT(QUERIES, 1);
+  TREE_STAT(NODES_VISITED, depth + 1);
+  uint64_t retVal = 0;
+  const DTree* node = this;
+  while(!node->isLeaf()){
+    const uint64_t* counts = node->deltas[base];
+    size_t i = 0;
+    for(; nth >= counts[i]; i++){
+      nth -= counts[i];
+      retVal += node->deltas[PackedSeq::ALL][i];
+    }
+    node = node->nodes[i].get();
+  }
+  size_t leafPos = node->sequence.select(base, nth);
+  TREE_STAT(LEAF_BYTES_SCANNED, leafPos);
+  return retVal + leafPos;
+}
+
+// encoded base at a given position
+template<size_t Fanout, size_t LeafBytes, class Leaf>
+uint8_t DTree<Fanout, LeafBytes, Leaf>::at(uint64_t pos) const{
+  TREE_STAT(QUERIES, 1);
+  TREE_STAT(NODES_VISITED, depth + 1);
+  const DTree* leaf = leafAt(pos);
+  return leaf->sequence[pos];
+}
+
+// Sets code to the encoded base at pos, and returns the number of
+// bases of its class in [0,pos): at() and rank() in one descent
+template<size_t Fanout, size_t LeafBytes, class Leaf>
+uint64_t DTree<Fanout, LeafBytes, Leaf>::rankAt(uint64_t pos,
+                                                uint8_t& code) const{
+  TREE_STAT(QUERIES, 1);
+  TREE_STAT(NODES_VISITED, depth + 1);
+  uint64_t counts[PackedSeq::ALL + 1] = {0};
+  const DTree* node = this;
+  while(!node->isLeaf()){
+    const uint64_t* lengths = node->deltas[PackedSeq::ALL];
+    size_t i = 0;
+    for(; pos >= lengths[i]; i++){
+      pos -= lengths[i];
+      for(size_t b = 0; b < PackedSeq::ALL; b++){
+        counts[b] += node->deltas[b][i];
+      }
+    }
+    node = node->nodes[i].get();
+  }
+  code = node->sequence[pos];
+  Base base = PackedSeq::baseClass(code);
+  TREE_STAT(LEAF_BYTES_SCANNED, pos);
+  return counts[base] + node->sequence.rank(base, pos);
+}
+
+// private static accessory methods
+
+// Concatenates two trees. The shallower tree is joined onto the
+// facing edge of the deeper one, so all leaves stay at the same
+// depth; nodes that overflow are split in two and passed upwards.
+template<size_t Fanout, size_t LeafBytes, class Leaf>
+DTree<Fanout, LeafBytes, Leaf>
+DTree<Fanout, LeafBytes, Leaf>::join(const DTree& left, const DTree& right){
+  if(right.length() == 0){
+    return left;
+  }
+  if(left.length() == 0){
+    return right;
+  }
+  shared_ptr<DTree> children[2 * PTR_MAX];
+  size_t childCount = 0;
+  if(left.depth == right.depth){
+    if(left.isLeaf()){
+      if((left.length() + right.length()) <= SEQ_MAX){
+        Leaf merged = left.sequence;
+        merged.append(right.sequence);
+        return fromLeaf(merged);
+      }
+      if((left.length() >= SEQ_MIN) && (right.length() >= SEQ_MIN)){
+        children[childCount++] = newNode(left);
+        children[childCount++] = newNode(right);
+      } else {
+        // an underfull leaf takes bases from its neighbour
+        Leaf merged = left.sequence;
+        merged.append(right.sequence);
+        size_t half = merged.length() / 2;
+        children[childCount++] = newNode(fromLeaf(merged.substr(0, half)));
+        children[childCount++] = newNode(fromLeaf(merged.substr(half)));
+      }
+    } else {
+      for(size_t i = 0; i < left.nodeCount; i++){
+        children[childCount++] = left.nodes[i];
+      }
+      for(size_t i = 0; i < right.nodeCount; i++){
+        children[childCount++] = right.nodes[i];
+      }
+    }
+  } else if(left.depth > right.depth){
+    for(size_t i = 0; (i + 1) < left.nodeCount; i++){
+      children[childCount++] = left.nodes[i];
+    }
+    DTree edge = join(*left.nodes[left.nodeCount-1], right);
+    if(edge.depth < left.depth){
+      children[childCount++] = newNode(move(edge));
+    } else {
+      for(size_t i = 0; i < edge.nodeCount; i++){
+        children[childCount++] = move(edge.nodes[i]);
+      }
+    }
+  } else {
+    DTree edge = join(left, *right.nodes[0]);
+    if(edge.depth < right.depth){
+      children[childCount++] = newNode(move(edge));
+    } else {
+      for(size_t i = 0; i < edge.nodeCount; i++){
+        children[childCount++] = move(edge.nodes[i]);
+      }
+    }
+    for(size_t i = 1; i < right.nodeCount; i++){
+      children[childCount++] = right.nodes[i];
+    }
+  }
+  return fromNodes(children, childCount);
+}
+
+// Creates a tree from up to 2*PTR_MAX sibling nodes, adding a level
+// if they will not fit in a single node. A single node is returned
+// as-is, rather than being wrapped in a parent.
+template<size_t Fanout, size_t LeafBytes, class Leaf>
+DTree<Fanout, LeafBytes, Leaf>
+DTree<Fanout, LeafBytes, Leaf>::fromNodes(const shared_ptr<DTree>* src,
+                                          size_t count){
+  DTree retVal;
+  if(count == 1){
+    retVal = *src[0];
+  } else if(count <= PTR_MAX){
+    for(size_t i = 0; i < count; i++){
+      retVal.inplaceAppend(src[i]);
+    }
+  } else {
+    TREE_STAT(OVERFLOWS, 1);
+    size_t leftCount = count / 2;
+    shared_ptr<DTree> leftNode = newNode();
+    shared_ptr<DTree> rightNode = newNode();
+    for(size_t i = 0; i < count; i++){
+      ((i < leftCount) ? leftNode : rightNode)->inplaceAppend(src[i]);
+    }
+    retVal.inplaceAppend(leftNode);
+    retVal.inplaceAppend(rightNode);
+  }
+  return retVal;
+}
+
+// a leaf holding src
+template<size_t Fanout, size_t LeafBytes, class Leaf>
+DTree<Fanout, LeafBytes, Leaf>
+DTree<Fanout, LeafBytes, Leaf>::fromLeaf(const Leaf& src){
+  DTree retVal;
+  retVal.sequence = src;
+  src.occ(src.length(), retVal.totals);
+  return retVal;
+}
+
+// a new node with the given children
+template<size_t Fanout, size_t LeafBytes, class Leaf>
+shared_ptr<DTree<Fanout, LeafBytes, Leaf> >
+DTree<Fanout, LeafBytes, Leaf>::parentOf(const shared_ptr<DTree>* src,
+                                         size_t count){
+  shared_ptr<DTree> retVal = newNode();
+  for(size_t i = 0; i < count; i++){
+    retVal->inplaceAppend(src[i]);
+  }
+  return retVal;
+}
+
+// Adds parents for up to 2*PTR_MAX sibling nodes to dest: one parent
+// if they fit, otherwise two parents with half the nodes each
+template<size_t Fanout, size_t LeafBytes, class Leaf>
+void DTree<Fanout, LeafBytes, Leaf>::addBalanced(
+  vector<shared_ptr<DTree> >& dest, const shared_ptr<DTree>* src,
+  size_t count){
+  if(count <= PTR_MAX){
+    dest.push_back(parentOf(src, count));
+    return;
+  }
+  TREE_STAT(OVERFLOWS, 1);
+  dest.push_back(parentOf(src, count / 2));
+  dest.push_back(parentOf(src + count / 2, count - count / 2));
+}
+
+// a new shared node; the node and its reference counts are allocated
+// together as one block from the node pool
+template<size_t Fanout, size_t LeafBytes, class Leaf>
+template<class... Args>
+shared_ptr<DTree<Fanout, LeafBytes, Leaf> >
+DTree<Fanout, LeafBytes, Leaf>::newNode(Args&&... args){
+  TREE_STAT(NODE_ALLOCATIONS, 1);
+  return allocate_shared<DTree>(NodeAllocator(), forward<Args>(args)...);
+}
+
+// private accessory methods
+
+template<size_t Fanout, size_t LeafBytes, class Leaf>
+void DTree<Fanout, LeafBytes, Leaf>::initialise(){
+  nodeCount = 0;
+  depth = 0;
+  nodeNum = NodeNumber<DTree>::next();
+  fill(totals, totals + PackedSeq::ALL + 1, 0);
+  sequence = Leaf();
+}
+
+// takes the children (or bases) of src, leaving it as an empty leaf;
+// this node should be freshly initialised
+template<size_t Fanout, size_t LeafBytes, class Leaf>
+void DTree<Fanout, LeafBytes, Leaf>::takeFrom(DTree& src){
+  depth = src.depth;
+  nodeCount = src.nodeCount;
+  for(size_t b = 0; b <= PackedSeq::ALL; b++){
+    copy(src.deltas[b], src.deltas[b] + nodeCount, deltas[b]);
+  }
+  copy(src.totals, src.totals + PackedSeq::ALL + 1, totals);
+  for(size_t i = 0; i < nodeCount; i++){
+    nodes[i] = move(src.nodes[i]);
+  }
+  sequence = move(src.sequence);
+  src.nodeCount = 0;
+  src.depth = 0;
+  fill(src.totals, src.totals + PackedSeq::ALL + 1, 0);
+}
+
+template<size_t Fanout, size_t LeafBytes, class Leaf>
+bool DTree<Fanout, LeafBytes, Leaf>::isLeaf() const{
+  return(depth == 0);
+}
+
+// the leaf holding the base at pos (which should be less than
+// length()); pos becomes the position of the base in that leaf
+template<size_t Fanout, size_t LeafBytes, class Leaf>
+const DTree<Fanout, LeafBytes, Leaf>*
+DTree<Fanout, LeafBytes, Leaf>::leafAt(uint64_t& pos) const{
+  const DTree* node = this;
+  while(!node->isLeaf()){
+    const uint64_t* lengths = node->deltas[PackedSeq::ALL];
+    size_t i = 0;
+    for(; pos >= lengths[i]; i++){
+      pos -= lengths[i];
+    }
+    node = node->nodes[i].get();
+  }
+  return node;
+}
+
+// calls visit(leaf bases, start, len) for the part of each leaf in
+// [start,start+len), in order
+template<size_t Fanout, size_t LeafBytes, class Leaf>
+template<class Visit>
+void DTree<Fanout, LeafBytes, Leaf>::visitLeaves(uint64_t start,
+                                                 uint64_t len,
+                                                 Visit& visit) const{
+  if(isLeaf()){
+    visit(sequence, start, len);
+    return;
+  }
+  for(size_t i = 0; (i < nodeCount) && (len > 0); i++){
+    uint64_t childLength = deltas[PackedSeq::ALL][i];
+    if(start >= childLength){
+      start -= childLength;
+      continue;
+    }
+    uint64_t childLen = min(len, childLength - start);
+    nodes[i]->visitLeaves(start, childLen, visit);
+    len -= childLen;
+    start = 0;
+  }
+}
+
+// append a child node in-place
+template<size_t Fanout, size_t LeafBytes, class Leaf>
+void DTree<Fanout, LeafBytes, Leaf>::inplaceAppend(
+  const shared_ptr<DTree>& src){
+  depth = src->depth + 1;
+  for(size_t b = 0; b <= PackedSeq::ALL; b++){
+    deltas[b][nodeCount] = src->totals[b];
+    totals[b] += src->totals[b];
+  }
+  nodes[nodeCount++] = src;
+}
+
+// append child nodes in-place from another DTree
+template<size_t Fanout, size_t LeafBytes, class Leaf>
+void DTree<Fanout, LeafBytes, Leaf>::inplaceAppend(const DTree& src,
+                                                   size_t fromNode,
+                                                   size_t toNode){
+  for(size_t i = fromNode; (i < toNode) && (i < src.nodeCount); i++){
+    inplaceAppend(src.nodes[i]);
+  }
+}
+
+// append sequence in-place (bases only, quality unknown)
+template<size_t Fanout, size_t LeafBytes, class Leaf>
+void DTree<Fanout, LeafBytes, Leaf>::inplaceAppend(const string& src){
+  inplaceAppend(PackedSeq(src));
+}
+
+// append encoded sequence in-place, adding leaves (and levels) for
+// sequence that will not fit in the current leaf
+template<size_t Fanout, size_t LeafBytes, class Leaf>
+void DTree<Fanout, LeafBytes, Leaf>::inplaceAppend(const PackedSeq& src){
+  if(isLeaf() && ((length() + src.length()) <= SEQ_MAX)){
+    sequence.append(src);
+    src.occ(src.length(), totals);
+    return;
+  }
+  Loader loader;
+  loader.append(src);
+  *this = join(*this, loader.finish());
+}
+
+// DTree::Loader
+
+// constructors
+
+template<size_t Fanout, size_t LeafBytes, class Leaf>
+DTree<Fanout, LeafBytes, Leaf>::Loader::Loader(){
+}
+
+// public methods
+
+template<size_t Fanout, size_t LeafBytes, class Leaf>
+void DTree<Fanout, LeafBytes, Leaf>::Loader::push_back(uint8_t code){
+  pending.push_back(code);
+  if(pending.length() >= SEQ_MAX){
+    addLeaves(false);
+  }
+}
+
+template<size_t Fanout, size_t LeafBytes, class Leaf>
+void DTree<Fanout, LeafBytes, Leaf>::Loader::append(const uint8_t* src,
+                                                    size_t len){
+  pending.append(src, len);
+  addLeaves(false);
+}
+
+template<size_t Fanout, size_t LeafBytes, class Leaf>
+void DTree<Fanout, LeafBytes, Leaf>::Loader::append(const PackedSeq& src){
+  pending.append(src);
+  addLeaves(false);
+}
+
+// adds the bases in src[start,start+len)
+template<size_t Fanout, size_t LeafBytes, class Leaf>
+void DTree<Fanout, LeafBytes, Leaf>::Loader::append(const DTree& src,
+                                                    uint64_t start,
+                                                    uint64_t len){
+  src.appendTo(pending, start, len);
+  addLeaves(false);
+}
+
+// Adds the last leaf, then gives each level a parent from the bottom
+// up. A last node that is less than half full is evened out with the
+// node before it, which is taken back from its parent.
+template<size_t Fanout, size_t LeafBytes, class Leaf>
+DTree<Fanout, LeafBytes, Leaf>
+DTree<Fanout, LeafBytes, Leaf>::Loader::finish(){
+  addLeaves(true);
+  DTree retVal;
+  for(size_t level = 0; level < levels.size(); level++){
+    vector<shared_ptr<DTree> > nodes;
+    nodes.swap(levels[level]);
+    bool top = ((level + 1) == levels.size());
+    if(top && (nodes.size() == 1)){
+      retVal = move(*nodes[0]);
+      break;
+    }
+    if(top){
+      levels.push_back(vector<shared_ptr<DTree> >());
+    }
+    vector<shared_ptr<DTree> >& parents = levels[level + 1];
+    if((nodes.size() < PTR_MIN) && !parents.empty()){
+      shared_ptr<DTree> previous = parents.back();
+      parents.pop_back();
+      nodes.insert(nodes.begin(), previous->nodes,
+                   previous->nodes + previous->nodeCount);
+    }
+    addBalanced(parents, nodes.data(), nodes.size());
+  }
+  levels.clear();
+  return retVal;
+}
+
+// private methods
+
+// Turns pending bases into leaves: whole leaves only, or all of them.
+// A last leaf that would be less than half full is evened out with
+// the leaf before it.
+template<size_t Fanout, size_t LeafBytes, class Leaf>
+void DTree<Fanout, LeafBytes, Leaf>::Loader::addLeaves(bool all){
+  if(all && (pending.length() > 0) && (pending.length() < SEQ_MIN)
+     && !levels.empty() && !levels[0].empty()){
+    shared_ptr<DTree> previous = levels[0].back();
+    levels[0].pop_back();
+    PackedSeq merged;
+    previous->sequence.appendTo(merged, 0, previous->length());
+    merged.append(pending);
+    pending = merged;
+    size_t half = pending.length() / 2;
+    DTree leaf;
+    leaf.inplaceAppend(pending.substr(0, half));
+    addNode(0, newNode(move(leaf)));
+    pending = pending.substr(half);
+  }
+  size_t pos = 0;
+  for(; ((pos + SEQ_MAX) <= pending.length()) ||
+        (all && (pos < pending.length())); pos += SEQ_MAX){
+    DTree leaf;
+    leaf.inplaceAppend(pending.substr(pos, SEQ_MAX));
+    addNode(0, newNode(move(leaf)));
+  }
+  if(pos > 0){
+    pending = pending.substr(pos);
+  }
+}
+
+// Adds a node at a given height. Once a level has more than PTR_MAX
+// nodes, the first PTR_MAX are given a parent one level up.
+template<size_t Fanout, size_t LeafBytes, class Leaf>
+void DTree<Fanout, LeafBytes, Leaf>::Loader::addNode(
+  size_t level, const shared_ptr<DTree>& node){
+  if(levels.size() <= level){
+    levels.resize(level + 1);
+  }
+  vector<shared_ptr<DTree> >& nodes = levels[level];
+  nodes.push_back(node);
+  if(nodes.size() > PTR_MAX){
+    shared_ptr<DTree> parent = parentOf(nodes.data(), PTR_MAX);
+    nodes.erase(nodes.begin(), nodes.begin() + PTR_MAX);
+    addNode(level + 1, parent);
+  }
+}
+
+// DTree::View
+
+// constructors
+
+template<size_t Fanout, size_t LeafBytes, class Leaf>
+DTree<Fanout, LeafBytes, Leaf>::View::View()
+  : root(NULL), start(0), len(0){
+}
+
+template<size_t Fanout, size_t LeafBytes, class Leaf>
+DTree<Fanout, LeafBytes, Leaf>::View::View(const DTree& src,
+                                           uint64_t start, uint64_t len)
+  : root(&src), start(min(start, src.length())),
+    len(min(len, src.length() - this->start)){
+}
+
+// public methods
+
+template<size_t Fanout, size_t LeafBytes, class Leaf>
+uint64_t DTree<Fanout, LeafBytes, Leaf>::View::length() const{
+  return len;
+}
+
+// encoded base at a given position of the view
+template<size_t Fanout, size_t LeafBytes, class Leaf>
+uint8_t DTree<Fanout, LeafBytes, Leaf>::View::at(uint64_t pos) const{
+  return root->at(start + pos);
+}
+
+// a view of [start,start+len) of this view, truncated to its end
+template<size_t Fanout, size_t LeafBytes, class Leaf>
+typename DTree<Fanout, LeafBytes, Leaf>::View
+DTree<Fanout, LeafBytes, Leaf>::View::substr(uint64_t start,
+                                             uint64_t len) const{
+  View retVal;
+  if(start < this->len){
+    retVal.root = root;
+    retVal.start = this->start + start;
+    retVal.len = min(len, this->len - start);
+  }
+  return retVal;
+}
+
+template<size_t Fanout, size_t LeafBytes, class Leaf>
+typename DTree<Fanout, LeafBytes, Leaf>::View::Iterator
+DTree<Fanout, LeafBytes, Leaf>::View::begin() const{
+  return Iterator(*this, 0);
+}
+
+template<size_t Fanout, size_t LeafBytes, class Leaf>
+typename DTree<Fanout, LeafBytes, Leaf>::View::Iterator
+DTree<Fanout, LeafBytes, Leaf>::View::end() const{
+  return Iterator(*this, len);
+}
+
+template<size_t Fanout, size_t LeafBytes, class Leaf>
+typename DTree<Fanout, LeafBytes, Leaf>::View::ReverseIterator
+DTree<Fanout, LeafBytes, Leaf>::View::rbegin() const{
+  return ReverseIterator(end());
+}
+
+template<size_t Fanout, size_t LeafBytes, class Leaf>
+typename DTree<Fanout, LeafBytes, Leaf>::View::ReverseIterator
+DTree<Fanout, LeafBytes, Leaf>::View::rend() const{
+  return ReverseIterator(begin());
+}
+
+// Calls visit(const Leaf& bases, size_t start, size_t len) for each
+// run of the view that lies within one leaf, in order. PackedSeq runs
+// can be read directly from bases.data() + start.
+template<size_t Fanout, size_t LeafBytes, class Leaf>
+template<class Visit>
+void DTree<Fanout, LeafBytes, Leaf>::View::forEachLeaf(Visit visit) const{
+  if(len > 0){
+    root->visitLeaves(start, len, visit);
+  }
+}
+
+// appends the bases of the view to dest
+template<size_t Fanout, size_t LeafBytes, class Leaf>
+void DTree<Fanout, LeafBytes, Leaf>::View::appendTo(PackedSeq& dest) const{
+  if(len > 0){
+    root->appendTo(dest, start, len);
+  }
+}
+
+// a tree of the bases in the view, sharing the nodes of the original
+// (see DTree::substr)
+template<size_t Fanout, size_t LeafBytes, class Leaf>
+DTree<Fanout, LeafBytes, Leaf>
+DTree<Fanout, LeafBytes, Leaf>::View::materialize() const{
+  return (len > 0) ? root->substr(start, len) : DTree();
+}
+
+// DTree::View::Iterator
+
+// constructors
+
+template<size_t Fanout, size_t LeafBytes, class Leaf>
+DTree<Fanout, LeafBytes, Leaf>::View::Iterator::Iterator()
+  : root(NULL), leaf(NULL), leafStart(0), first(0), last(0), pos(0){
+}
+
+template<size_t Fanout, size_t LeafBytes, class Leaf>
+DTree<Fanout, LeafBytes, Leaf>::View::Iterator::Iterator(const View& src,
+                                                         uint64_t viewPos)
+  : root(src.root), leaf(NULL), leafStart(0), first(src.start),
+    last(src.start + src.len), pos(src.start + viewPos){
+  if(pos < last){
+    findLeaf();
+  }
+}
+
+// public methods
+
+template<size_t Fanout, size_t LeafBytes, class Leaf>
+uint8_t DTree<Fanout, LeafBytes, Leaf>::View::Iterator::operator*() const{
+  return leaf->sequence[pos - leafStart];
+}
+
+template<size_t Fanout, size_t LeafBytes, class Leaf>
+typename DTree<Fanout, LeafBytes, Leaf>::View::Iterator&
+DTree<Fanout, LeafBytes, Leaf>::View::Iterator::operator++(){
+  pos++;
+  if((pos < last) && ((pos - leafStart) >= leaf->length())){
+    findLeaf();
+  }
+  return *this;
+}
+
+template<size_t Fanout, size_t LeafBytes, class Leaf>
+typename DTree<Fanout, LeafBytes, Leaf>::View::Iterator&
+DTree<Fanout, LeafBytes, Leaf>::View::Iterator::operator--(){
+  pos--;
+  if((leaf == NULL) || (pos < leafStart) ||
+     ((pos - leafStart) >= leaf->length())){
+    findLeaf();
+  }
+  return *this;
+}
+
+template<size_t Fanout, size_t LeafBytes, class Leaf>
+bool DTree<Fanout, LeafBytes, Leaf>::View::Iterator::operator==(
+    const Iterator& other) const{
+  return (pos == other.pos) && (root == other.root);
+}
+
+template<size_t Fanout, size_t LeafBytes, class Leaf>
+bool DTree<Fanout, LeafBytes, Leaf>::View::Iterator::operator!=(
+    const Iterator& other) const{
+  return !(*this == other);
+}
+
+template<size_t Fanout, size_t LeafBytes, class Leaf>
+uint64_t DTree<Fanout, LeafBytes, Leaf>::View::Iterator::position() const{
+  return pos - first;
+}
+
+// private accessory methods
+
+template<size_t Fanout, size_t LeafBytes, class Leaf>
+void DTree<Fanout, LeafBytes, Leaf>::View::Iterator::findLeaf(){
+  uint64_t leafPos = pos;
+  leaf = root->leafAt(leafPos);
+  leafStart = pos - leafPos;
+}
+
 #endif //__DTREE_HPP_
@@ -0,0 +1,97 @@
+/** <header>
+
+ * This file is part of preBowt -- a prefix-based BWT-like transform of
+ * genetic data.
+ *
+ * Copyright 2014 David Eccles (gringer) <bioinformatics@gringene.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * without any warranty; without even the implied warranty of
+ * merchantability or fitness for a particular purpose. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+</header> **/
+
+#ifndef __FASTXREADER_HPP__
+#define __FASTXREADER_HPP__
+
+#include <string>
+#include <vector>
+#include <istream>
+#include <memory>
+
+#include "packedseq.hpp"
+#include "queryexecutor.hpp"
+
+using namespace std;
+
+// Reads FASTA or FASTQ records (detected per record from the '>' or
+// '@' header) and encodes them into packed bases. FASTA sequences may
+// span several lines; FASTA bases are given unknown quality.
+class FastxReader{
+public:
+  // constructors
+  FastxReader(istream& in);
+  // public methods
+  bool next(PackedSeq& seq, string& name);
+  vector<PackedSeq> readAll();
+private:
+  // fields
+  istream& in;
+  string line; // the next unprocessed line
+  bool haveLine;
+  // accessory methods
+  bool nextLine();
+};
+
+// Reads a FASTA or FASTQ file, plain or gzip-compressed, in windows
+// that are parsed on the threads of an executor. Plain files are
+// memory-mapped and parsed in place; gzip files are inflated into a
+// window buffer. Each window is split into pieces at record starts,
+// and each piece encodes its bases and qualities straight into one
+// packed buffer; the records are views of that buffer. A record start
+// is a '>' line in FASTA files, and in FASTQ files a '@' line with a
+// '+' line two lines later, so FASTQ records must be four lines each.
+// The format is set by the first character of the file.
+class ParallelFastxReader{
+public:
+  // constants
+  static const size_t WINDOW_BYTES = 64 << 20; // grown for long records
+  static const size_t PIECE_BYTES = 1 << 20; // parsed by one thread
+  // constructors
+  ParallelFastxReader(const string& fileName);
+  // public methods
+  bool next(vector<PackedSeq>& dest, QueryExecutor& executor);
+  vector<PackedSeq> readAll(QueryExecutor& executor);
+private:
+  // fields
+  string fileName;
+  shared_ptr<const char> mapping; // a plain file, or NULL
+  size_t mappedLength;
+  size_t mappedPos; // start of the next window
+  shared_ptr<void> gzipFile; // a gzip file, or NULL
+  vector<char> buffer; // inflated bases, for gzip files
+  size_t bufferLength; // bases in buffer
+  bool inputDone; // all of the gzip file is in buffer
+  char format; // '>' or '@'; 0 before the first window
+  size_t windowBytes;
+  // static accessory methods
+  static size_t recordStart(const char* data, size_t pos, size_t length,
+                            char format);
+  static size_t parsePiece(const char* data, size_t start, size_t end,
+                           bool last, char format, PackedSeq& bases,
+                           vector<size_t>& lengths);
+  // accessory methods
+  bool loadWindow(const char*& data, size_t& length, bool& last);
+  void consume(size_t bytes);
+};
+
+#endif //__FASTXREADER_HPP__
@@ -0,0 +1,83 @@
+/** <header>
+
+ * This file is part of preBowt -- a prefix-based BWT-like transform of
+ * genetic data.
+ *
+ * Copyright 2014 David Eccles (gringer) <bioinformatics@gringene.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * without any warranty; without even the implied warranty of
+ * merchantability or fitness for a particular purpose. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+</header> **/
+
+#ifndef __MAPPEDSAMPLES_HPP__
+#define __MAPPEDSAMPLES_HPP__
+
+#include <string>
+#include <memory>
+#include <ostream>
+#include <cstdint>
+
+#include "positionsamples.hpp"
+
+using namespace std;
+
+// Header of the position samples section of an index file. It starts
+// on a record boundary, and is followed by
+//   uint64_t marks[(rowCount + 63) / 64]: bit (row % 64) of word
+//            (row / 64) is set for sampled rows;
+//   uint64_t blockRanks[rowCount / BLOCK_ROWS + 1]: sampled rows
+//            before each block of BLOCK_ROWS rows;
+//   uint64_t values[2 * sampleCount]: seqId and offset of each
+//            sampled row, in row order.
+class MappedSampleHeader{
+public:
+  uint64_t rate;
+  uint64_t rowCount;
+  uint64_t sampleCount;
+  uint64_t reserved[5];
+};
+
+// Position samples (see PositionSamples) stored in a memory-mapped
+// index file, written by MappedTree::write. The marks are a bit vector
+// with a sampled row count for every block, so finding a sample scans
+// at most one block of words; it has the same query methods as
+// PositionSamples. Copies share the mapping.
+class MappedSamples{
+public:
+  // constants
+  static const uint64_t BLOCK_ROWS = 512; // rows per rank block
+  // constructors
+  MappedSamples(); // rate 0 (none)
+  MappedSamples(const shared_ptr<const uint8_t>& mapping,
+                uint64_t fileLength, uint64_t offset,
+                const string& fileName);
+  // static public methods
+  static uint64_t write(ostream& out, const PositionSamples& src);
+  // public methods
+  uint64_t rate() const;
+  uint64_t length() const;
+  bool find(uint64_t row, SeqPos& pos) const;
+  uint64_t sampleCount() const;
+private:
+  // fields
+  shared_ptr<const uint8_t> mapping;
+  uint64_t sampleRate;
+  uint64_t rowCount;
+  uint64_t samples;
+  const uint64_t* marks;
+  const uint64_t* blockRanks;
+  const uint64_t* values;
+};
+
+#endif //__MAPPEDSAMPLES_HPP__
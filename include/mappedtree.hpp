@@ -0,0 +1,209 @@
+/** <header>
+
+ * This file is part of preBowt -- a prefix-based BWT-like transform of
+ * genetic data.
+ *
+ * Copyright 2014 David Eccles (gringer) <bioinformatics@gringene.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * without any warranty; without even the implied warranty of
+ * merchantability or fitness for a particular purpose. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+</header> **/
+
+#ifndef __MAPPEDTREE_HPP__
+#define __MAPPEDTREE_HPP__
+
+#include <string>
+#include <memory>
+#include <fstream>
+#include <stdexcept>
+#include <cstdint>
+
+#include "dtree.hpp"
+#include "packedseq.hpp"
+#include "positionsamples.hpp"
+#include "mappedsamples.hpp"
+
+using namespace std;
+
+// Header at the start of an index file. All fields are in the byte
+// order of the machine that wrote the file (checked on loading).
+class MappedHeader{
+public:
+  // 2: position samples; 3: N counted apart from other ambiguous bases
+  static const uint32_t VERSION = 3;
+  static const uint32_t ORDER_MARK = 0x01020304;
+  char magic[8]; // "PREBOWT"
+  uint32_t version;
+  uint32_t byteOrder;
+  uint64_t rootOffset;
+  uint64_t fileLength;
+  uint64_t nodeCount;
+  uint64_t fanout; // stride of the per-child arrays of internal nodes
+  uint64_t samplesOffset; // MappedSampleHeader, or 0 if not sampled
+  uint64_t reserved;
+};
+
+// Header of a node record in an index file. Records start on a cache
+// line, the header fills two, and it is followed by
+//   internal nodes: uint64_t deltas[ALL+1][fanout] (as in DTree),
+//                   uint64_t children[fanout] (file offsets)
+//   leaves: uint8_t codes[totals[ALL]]
+class MappedNode{
+public:
+  uint32_t depth; // 0 for leaves
+  uint32_t count; // number of children
+  uint64_t totals[PackedSeq::ALL + 1];
+  uint64_t reserved[7];
+  const uint64_t* deltas(size_t base, size_t fanout) const{
+    return reinterpret_cast<const uint64_t*>(this + 1) + base * fanout;
+  }
+  const uint64_t* children(size_t fanout) const{
+    return deltas(PackedSeq::ALL + 1, fanout);
+  }
+  const uint8_t* codes() const{
+    return reinterpret_cast<const uint8_t*>(this + 1);
+  }
+};
+
+// A read-only D-Tree stored in a memory-mapped index file. Nodes refer
+// to each other by file offset, so queries run directly on the mapped
+// pages with no deserialisation; it has the same query methods as
+// DTree. The file may also hold the position samples of the rows
+// (see MappedSamples). Copies share the mapping.
+class MappedTree{
+public:
+  typedef PackedSeq::Base Base;
+  // constants
+  static const size_t RECORD_ALIGN = 64;
+  // an incremental rank query (see DTree::RankCursor)
+  class RankCursor{
+  public:
+    const MappedNode* node; // NULL once the query is complete
+    uint64_t pos;
+    uint64_t rank;
+    Base base;
+    bool leafReady;
+    const uint8_t* file;
+    size_t fanout;
+  };
+  // constructors
+  MappedTree(); // create empty tree
+  MappedTree(const string& fileName); // map an index file
+  // static public methods
+  template<size_t Fanout, size_t LeafBytes>
+  static void write(const DTree<Fanout, LeafBytes>& tree,
+                    const string& fileName,
+                    const PositionSamples& samples = PositionSamples());
+  static bool rankStep(RankCursor& cursor);
+  // public methods
+  uint64_t length() const;
+  size_t height() const;
+  uint64_t count(Base base) const;
+  uint64_t rank(Base base, uint64_t pos) const;
+  void occ(uint64_t pos, uint64_t* counts) const;
+  uint64_t select(Base base, uint64_t nth) const;
+  uint8_t at(uint64_t pos) const;
+  uint64_t rankAt(uint64_t pos, uint8_t& code) const;
+  void appendTo(PackedSeq& dest, uint64_t start, uint64_t len) const;
+  RankCursor rankCursor(Base base, uint64_t pos) const;
+  const MappedSamples& samples() const;
+private:
+  // fields
+  shared_ptr<const uint8_t> mapping;
+  const MappedNode* root;
+  size_t fanout;
+  MappedSamples positions;
+  // static accessory methods
+  static void writePadding(ostream& out, uint64_t& fileLength);
+  template<size_t Fanout, size_t LeafBytes>
+  static uint64_t writeNode(ostream& out,
+                            const DTree<Fanout, LeafBytes>& src,
+                            uint64_t& fileLength, uint64_t& nodeCount);
+  // accessory methods
+  const MappedNode* child(const MappedNode* node, size_t i) const;
+  void appendTo(const MappedNode* node, PackedSeq& dest,
+                uint64_t start, uint64_t len) const;
+};
+
+// static public methods
+
+// Writes a tree, and the finished rows of its position samples (if
+// any), to an index file that can be mapped by MappedTree
+template<size_t Fanout, size_t LeafBytes>
+void MappedTree::write(const DTree<Fanout, LeafBytes>& tree,
+                       const string& fileName,
+                       const PositionSamples& samples){
+  ofstream out(fileName.c_str(), ios::out | ios::binary | ios::trunc);
+  if(!out){
+    throw runtime_error("cannot open index file for writing: " + fileName);
+  }
+  MappedHeader header = {{'P', 'R', 'E', 'B', 'O', 'W', 'T', '\0'},
+                         MappedHeader::VERSION, MappedHeader::ORDER_MARK,
+                         0, sizeof(MappedHeader), 0, Fanout, 0, 0};
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  header.rootOffset = writeNode(out, tree, header.fileLength,
+                                header.nodeCount);
+  if(samples.rate() > 0){
+    writePadding(out, header.fileLength);
+    header.samplesOffset = header.fileLength;
+    header.fileLength += MappedSamples::write(out, samples);
+  }
+  out.seekp(0);
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  out.close();
+  if(!out){
+    throw runtime_error("cannot write index file: " + fileName);
+  }
+}
+
+// private static accessory methods
+
+// Writes the records of a subtree, children first, and returns the
+// file offset of its root record
+template<size_t Fanout, size_t LeafBytes>
+uint64_t MappedTree::writeNode(ostream& out,
+                               const DTree<Fanout, LeafBytes>& src,
+                               uint64_t& fileLength, uint64_t& nodeCount){
+  uint64_t childOffsets[Fanout] = {0};
+  for(size_t i = 0; i < src.nodeCount; i++){
+    childOffsets[i] = writeNode(out, *src.nodes[i], fileLength, nodeCount);
+  }
+  writePadding(out, fileLength);
+  uint64_t retVal = fileLength;
+  MappedNode record = MappedNode();
+  record.depth = src.depth;
+  record.count = src.nodeCount;
+  copy(src.totals, src.totals + PackedSeq::ALL + 1, record.totals);
+  out.write(reinterpret_cast<const char*>(&record), sizeof(record));
+  fileLength += sizeof(record);
+  if(src.isLeaf()){
+    out.write(reinterpret_cast<const char*>(src.sequence.data()),
+              src.sequence.length());
+    fileLength += src.sequence.length();
+  } else {
+    // unused slots are written too, so every row has the same stride
+    for(size_t b = 0; b <= PackedSeq::ALL; b++){
+      uint64_t deltas[Fanout] = {0};
+      copy(src.deltas[b], src.deltas[b] + src.nodeCount, deltas);
+      out.write(reinterpret_cast<const char*>(deltas), sizeof(deltas));
+    }
+    out.write(reinterpret_cast<const char*>(childOffsets),
+              sizeof(childOffsets));
+    fileLength += (PackedSeq::ALL + 2) * sizeof(childOffsets);
+  }
+  nodeCount++;
+  return retVal;
+}
+
+#endif //__MAPPEDTREE_HPP__
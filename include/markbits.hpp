@@ -0,0 +1,77 @@
+/** <header>
+
+ * This file is part of preBowt -- a prefix-based BWT-like transform of
+ * genetic data.
+ *
+ * Copyright 2014 David Eccles (gringer) <bioinformatics@gringene.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * without any warranty; without even the implied warranty of
+ * merchantability or fitness for a particular purpose. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+</header> **/
+
+#ifndef __MARKBITS_HPP__
+#define __MARKBITS_HPP__
+
+#include <string>
+#include <cstdint>
+#include <ostream>
+
+#include "packedseq.hpp"
+
+using namespace std;
+
+// A run of row marks stored one bit per row, for use as a D-Tree leaf
+// (DTree<Fanout, MarkBits::LEAF_ROWS, MarkBits>). A set bit is read as
+// an A (0x10) and a clear bit as a C (0x20); codes of any other class
+// are stored as C. The bits are held inside the sequence rather than
+// in a shared buffer, so copying a leaf (as insertion does on the path
+// it changes) allocates nothing beyond the tree node itself. A leaf
+// holds up to CAPACITY rows, enough for the overflowing or merged
+// leaves of a tree of LEAF_ROWS rows per leaf.
+class MarkBits{
+  friend ostream& operator<<(ostream& out, const MarkBits& src);
+public:
+  typedef PackedSeq::Base Base;
+  // constants
+  static const size_t LEAF_ROWS = 2048;
+  static const size_t CAPACITY = 2 * LEAF_ROWS;
+  static const uint8_t SET_CODE = 0x10; // A
+  static const uint8_t CLEAR_CODE = 0x20; // C
+  // constructors
+  MarkBits(); // create empty sequence
+  MarkBits(const PackedSeq& src); // A codes set, others clear
+  // public methods
+  MarkBits substr(size_t start, size_t len = string::npos) const;
+  void append(const MarkBits& src);
+  void append(const PackedSeq& src);
+  void insert(size_t pos, uint8_t code);
+  size_t length() const;
+  uint8_t operator[](size_t pos) const;
+  uint64_t rank(Base base, size_t pos) const;
+  void occ(size_t pos, uint64_t* counts) const;
+  size_t select(Base base, uint64_t nth) const;
+  void prefetch(size_t pos) const;
+  void appendTo(PackedSeq& dest, size_t start, size_t len) const;
+private:
+  // constants
+  static const size_t WORDS = CAPACITY / 64;
+  // fields
+  uint64_t words[WORDS]; // bits at length() and beyond are clear
+  size_t len;
+  // accessory methods
+  uint64_t onesBefore(size_t pos) const;
+  void appendBits(const uint64_t* src, size_t start, size_t count);
+};
+
+#endif //__MARKBITS_HPP__
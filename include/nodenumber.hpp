@@ -0,0 +1,58 @@
+/** <header>
+
+ * This file is part of preBowt -- a prefix-based BWT-like transform of
+ * genetic data.
+ *
+ * Copyright 2014 David Eccles (gringer) <bioinformatics@gringene.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * without any warranty; without even the implied warranty of
+ * merchantability or fitness for a particular purpose. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+</header> **/
+
+#ifndef __NODENUMBER_HPP__
+#define __NODENUMBER_HPP__
+
+#include <cstddef>
+#include <atomic>
+
+using namespace std;
+
+// Unique node numbers (used in debugging output) for nodes created on
+// any thread. Each thread reserves a block of numbers at a time, so
+// creating or copying a node does not write to a shared cache line.
+// Node is only used to keep separate counters for each node type.
+template<class Node>
+class NodeNumber{
+public:
+  // constants
+  static const size_t BLOCK_SIZE = 4096;
+  // static public methods
+  static size_t next(){
+    static thread_local size_t nextNum = 0;
+    static thread_local size_t blockEnd = 0;
+    if(nextNum == blockEnd){
+      nextNum = nextBlock.fetch_add(BLOCK_SIZE, memory_order_relaxed);
+      blockEnd = nextNum + BLOCK_SIZE;
+    }
+    return nextNum++;
+  }
+private:
+  // shared fields
+  static atomic<size_t> nextBlock;
+};
+
+template<class Node>
+atomic<size_t> NodeNumber<Node>::nextBlock(0);
+
+#endif //__NODENUMBER_HPP__
@@ -0,0 +1,96 @@
+/** <header>
+
+ * This file is part of preBowt -- a prefix-based BWT-like transform of
+ * genetic data.
+ *
+ * Copyright 2014 David Eccles (gringer) <bioinformatics@gringene.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * without any warranty; without even the implied warranty of
+ * merchantability or fitness for a particular purpose. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+</header> **/
+
+#ifndef __PACKEDSEQ_HPP__
+#define __PACKEDSEQ_HPP__
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <ostream>
+#include <memory>
+
+using namespace std;
+
+// A run of bases stored in the 8-bit prebowt encoding: IUPAC
+// ambiguity bits in the high nibble (A=4,C=5,G=6,T=7), and quality/4
+// in the low nibble. An all-zero base nibble is an end marker ($).
+// Sequences are views of a shared buffer, so copies and substrings
+// copy no bases; a buffer is only written to when no other sequence
+// can see it.
+class PackedSeq{
+  friend ostream& operator<<(ostream& out, const PackedSeq& src);
+public:
+  // constants
+  // base classes counted by the delta index; end markers, N (no-call)
+  // and the other ambiguous bases are counted separately from A/C/G/T
+  enum Base : size_t {END, A, C, G, T, AMBIG, N, ALL};
+  static const uint8_t QUAL_MAX = 15;
+  static const char PHRED_OFFSET = 33;
+  // static public methods
+  static uint8_t encode(char base, char qual = PHRED_OFFSET);
+  static char decodeBase(uint8_t code);
+  static char decodeQual(uint8_t code);
+  static void encode(const char* bases, const char* quals, size_t len,
+                     uint8_t* dest);
+  static Base baseClass(uint8_t code){
+    return NIBBLE_CLASS[code >> 4];
+  }
+  // constructors
+  PackedSeq(); // create empty sequence
+  PackedSeq(const string& bases); // bases only, quality unknown (0)
+  PackedSeq(const string& bases, const string& quals); // FASTQ pair
+  PackedSeq(const PackedSeq& src); // shares the bases of src
+  PackedSeq(PackedSeq&& src);
+  // operators
+  PackedSeq& operator=(const PackedSeq& src);
+  PackedSeq& operator=(PackedSeq&& src);
+  // public methods
+  PackedSeq substr(size_t start, size_t len = string::npos) const;
+  void append(const PackedSeq& src);
+  void append(const PackedSeq& src, size_t start, size_t len);
+  void append(const uint8_t* src, size_t len);
+  void push_back(uint8_t code);
+  uint8_t* extend(size_t len);
+  void insert(size_t pos, uint8_t code);
+  size_t length() const;
+  uint8_t operator[](size_t pos) const;
+  const uint8_t* data() const;
+  uint64_t rank(Base base, size_t pos) const;
+  void occ(size_t pos, uint64_t* counts) const;
+  size_t select(Base base, uint64_t nth) const;
+  void prefetch(size_t pos) const;
+  void appendTo(PackedSeq& dest, size_t start, size_t len) const;
+  string bases() const;
+  string quals() const;
+private:
+  // shared fields
+  static const Base NIBBLE_CLASS[16];
+  // fields
+  shared_ptr<vector<uint8_t> > buffer; // NULL for empty sequences
+  size_t start; // first base of this view of the buffer
+  size_t len;
+  // accessory methods
+  uint8_t* writableEnd(size_t extra);
+};
+
+#endif //__PACKEDSEQ_HPP__
@@ -0,0 +1,79 @@
+/** <header>
+
+ * This file is part of preBowt -- a prefix-based BWT-like transform of
+ * genetic data.
+ *
+ * Copyright 2014 David Eccles (gringer) <bioinformatics@gringene.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * without any warranty; without even the implied warranty of
+ * merchantability or fitness for a particular purpose. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+</header> **/
+
+#ifndef __POSITIONSAMPLES_HPP__
+#define __POSITIONSAMPLES_HPP__
+
+#include <cstdint>
+
+#include "dtree.hpp"
+#include "packedseq.hpp"
+#include "markbits.hpp"
+#include "samplevalues.hpp"
+
+using namespace std;
+
+// Sampled positions of the rows of a transform. A row is sampled if
+// its prefix length is a multiple of the sampling rate, or if it is a
+// whole sequence (the row holds an end marker), so that the position
+// of any row is found within rate LF steps (see
+// TransformIndex::position). Samples are kept in two D-Trees, so that
+// copies are cheap and rows can be inserted:
+//  - marks: one bit per row (see MarkBits), set (A) for sampled rows
+//    and clear (C) otherwise;
+//  - values: the seqId and offset of each sampled row, in row order,
+//    one element per sample (see SampleValues).
+// A rate of 0 disables sampling.
+class PositionSamples{
+  friend class MappedSamples; // writes sample records directly
+public:
+  // constants
+  typedef DTree<16, MarkBits::LEAF_ROWS, MarkBits> MarkTree;
+  typedef DTree<16, SampleValues::LEAF_SAMPLES, SampleValues> ValueTree;
+  static const uint64_t DEFAULT_RATE = 32;
+  // constructors
+  PositionSamples(uint64_t rate = 0); // no rows
+  // public methods
+  uint64_t rate() const;
+  uint64_t length() const;
+  bool isSampled(const SeqPos& pos, bool isEnd) const;
+  bool find(uint64_t row, SeqPos& pos) const;
+  void insert(uint64_t row, const SeqPos& pos, bool isEnd);
+  void append(const SeqPos& pos, bool isEnd);
+  void append(const PositionSamples& src, uint64_t start, uint64_t len,
+              uint64_t seqShift);
+  void finish();
+  uint64_t sampleCount() const;
+private:
+  // fields
+  uint64_t sampleRate;
+  MarkTree marks;
+  ValueTree values;
+  MarkTree::Loader markLoader; // appended rows, not yet added to marks
+  ValueTree newValues; // appended samples, in whole leaves
+  SampleValues valueLeaf; // appended samples not yet in newValues
+  // accessory methods
+  void appendSample(const SeqPos& pos);
+  void addValueLeaf();
+};
+
+#endif //__POSITIONSAMPLES_HPP__
@@ -0,0 +1,117 @@
+/** <header>
+
+ * This file is part of preBowt -- a prefix-based BWT-like transform of
+ * genetic data.
+ *
+ * Copyright 2014 David Eccles (gringer) <bioinformatics@gringene.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * without any warranty; without even the implied warranty of
+ * merchantability or fitness for a particular purpose. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+</header> **/
+
+#ifndef __PREBOWT_HPP__
+#define __PREBOWT_HPP__
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <atomic>
+
+#include "dtree.hpp"
+#include "mappedtree.hpp"
+#include "packedseq.hpp"
+#include "compactseq.hpp"
+#include "transformindex.hpp"
+
+using namespace std;
+
+// The prefix-array transform of a set of sequences, stored in a
+// D-Tree so that new sequences can be added (see TransformIndex).
+// Positions are sampled at a given rate (see PositionSamples), which
+// trades memory for locate() speed.
+class Prebowt : public TransformIndex<DTree<> >{
+public:
+  typedef DTree<> Tree;
+  // constructors
+  // create empty transform
+  Prebowt(uint64_t sampleRate = PositionSamples::DEFAULT_RATE);
+  // sort the prefixes of seqs
+  Prebowt(const vector<PackedSeq>& seqs,
+          uint64_t sampleRate = PositionSamples::DEFAULT_RATE);
+  // static public methods
+  static Prebowt build(const vector<PackedSeq>& seqs, size_t threadCount,
+                       uint64_t sampleRate = PositionSamples::DEFAULT_RATE);
+  static Prebowt merge(const Prebowt& first, const Prebowt& second,
+                       size_t threadCount = 1);
+  // public methods
+  uint64_t addSequence(const PackedSeq& seq);
+  void save(const string& fileName) const;
+private:
+  // static accessory methods
+  static void checkBases(const PackedSeq& seq);
+  static Prebowt sortPrefixes(const PackedSeq* seqs, size_t count,
+                              uint64_t sampleRate, size_t threadCount);
+  static void traceRows(const Prebowt& first, const Prebowt& second,
+                        uint64_t fromSeq, uint64_t toSeq,
+                        vector<uint64_t>& firstBefore);
+};
+
+// A transform saved with Prebowt::save, queried in place from a
+// read-only memory mapping of the index file. locate() uses the
+// position samples saved with it.
+class MappedPrebowt : public TransformIndex<MappedTree, MappedSamples>{
+public:
+  // constructors
+  MappedPrebowt(const string& fileName); // map an index file
+};
+
+// A copy of a transform with compressed leaves (see CompactSeq), for
+// large indexes that are queried far more often than they are
+// changed. Leaves hold four times as many bases as a Prebowt leaf, in
+// about the same space.
+class CompactPrebowt : public TransformIndex<DTree<16, 16384, CompactSeq> >{
+public:
+  typedef DTree<16, 16384, CompactSeq> Tree;
+  // constructors
+  CompactPrebowt(); // create empty transform
+  CompactPrebowt(const Prebowt& src); // compress the rows of src
+};
+
+// A transform that can be queried while sequences are added. Readers
+// pin the current version with snapshot() and query it for as long as
+// they hold it, without locks: versions are never modified. Writers
+// build the next version by path copying, so it shares all unchanged
+// nodes with the previous one, then publish it atomically. Each
+// version is freed once it has been replaced and no reader holds it.
+class VersionedPrebowt{
+public:
+  typedef shared_ptr<const Prebowt> Snapshot;
+  // constructors
+  VersionedPrebowt(); // start from an empty transform
+  VersionedPrebowt(const Prebowt& initial);
+  // public methods
+  Snapshot snapshot() const;
+  uint64_t version() const;
+  uint64_t addSequence(const PackedSeq& seq);
+  void addSequences(const vector<PackedSeq>& seqs);
+private:
+  // fields
+  Snapshot current; // only accessed with atomic_load/atomic_store
+  atomic<uint64_t> versionNum;
+  mutex writeLock; // writers are applied one at a time
+};
+
+#endif //__PREBOWT_HPP__
@@ -0,0 +1,74 @@
+/** <header>
+
+ * This file is part of preBowt -- a prefix-based BWT-like transform of
+ * genetic data.
+ *
+ * Copyright 2014 David Eccles (gringer) <bioinformatics@gringene.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * without any warranty; without even the implied warranty of
+ * merchantability or fitness for a particular purpose. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+</header> **/
+
+#ifndef __QUERYEXECUTOR_HPP__
+#define __QUERYEXECUTOR_HPP__
+
+#include <cstddef>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <exception>
+
+using namespace std;
+
+// A pool of worker threads for spreading query batches across cores.
+// Each worker has its own task queue, taking new work from the back;
+// a worker whose queue is empty steals from the front of the others,
+// so uneven batches (e.g. patterns with many hits) balance themselves.
+class QueryExecutor{
+public:
+  typedef function<void()> Task;
+  typedef function<void(size_t, size_t)> RangeTask;
+  // constructors
+  QueryExecutor(size_t threadCount = 0); // 0: one thread per core
+  // destructor
+  ~QueryExecutor();
+  // public methods
+  size_t threadCount() const;
+  void parallelFor(size_t count, size_t grain, const RangeTask& body);
+private:
+  class WorkQueue{
+  public:
+    mutex lock;
+    deque<Task> tasks;
+  };
+  // fields
+  vector<unique_ptr<WorkQueue> > queues;
+  vector<thread> workers;
+  mutex idleLock;
+  condition_variable wakeUp;
+  atomic<size_t> queuedCount;
+  atomic<size_t> nextQueue;
+  bool stopping;
+  // accessory methods
+  void submit(Task task);
+  bool takeTask(size_t queueId, Task& task);
+  void workerLoop(size_t queueId);
+};
+
+#endif //__QUERYEXECUTOR_HPP__
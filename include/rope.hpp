@@ -25,16 +25,96 @@
 
 #include <string>
 #include <memory>
+#include <vector>
+#include <iterator>
+#include <algorithm>
+
+#include "treestats.hpp"
 
 using namespace std;
 
 class Rope{
   friend ostream& operator<<(ostream& out, const Rope& src);
 public:
+  // a read-only forward iterator over the characters of a rope; it
+  // holds the path to the current leaf, so each step is amortised O(1)
+  class Iterator{
+  public:
+    typedef forward_iterator_tag iterator_category;
+    typedef char value_type;
+    typedef ptrdiff_t difference_type;
+    typedef const char* pointer;
+    typedef char reference;
+    Iterator(const Rope& src, size_t startPos);
+    char operator*() const;
+    Iterator& operator++();
+    bool operator==(const Iterator& other) const;
+    bool operator!=(const Iterator& other) const;
+    size_t position() const;
+  private:
+    vector<const Rope*> path; // ancestors of the current leaf
+    const Rope* leaf;
+    size_t leafPos;
+    size_t pos;
+    void descend(const Rope* node, size_t nodePos);
+  };
+  // A read-only window [start,start+len) of a rope. A view points to
+  // the rope without copying it, so the rope must outlive the view;
+  // making, reading and narrowing views allocates nothing. Characters
+  // are read by position, by iterating in either direction, or a leaf
+  // at a time; materialize() builds a rope only when one is needed.
+  class View{
+  public:
+    // a read-only bidirectional iterator over the characters of a
+    // view; it keeps the current leaf, so each step is amortised O(1)
+    class Iterator{
+    public:
+      typedef bidirectional_iterator_tag iterator_category;
+      typedef char value_type;
+      typedef ptrdiff_t difference_type;
+      typedef const char* pointer;
+      typedef char reference;
+      Iterator();
+      Iterator(const View& src, size_t viewPos);
+      char operator*() const;
+      Iterator& operator++();
+      Iterator& operator--();
+      bool operator==(const Iterator& other) const;
+      bool operator!=(const Iterator& other) const;
+      size_t position() const; // in the view
+    private:
+      const Rope* root;
+      const Rope* leaf; // the leaf holding pos, or NULL
+      size_t leafStart; // rope position of the first character of leaf
+      size_t first; // rope positions of the view
+      size_t last;
+      size_t pos; // rope position
+      void findLeaf();
+    };
+    typedef reverse_iterator<Iterator> ReverseIterator;
+    View(); // an empty view
+    View(const Rope& src, size_t start, size_t len);
+    size_t length() const;
+    char charAt(size_t pos) const;
+    View substr(size_t start, size_t len = string::npos) const;
+    Iterator begin() const;
+    Iterator end() const;
+    ReverseIterator rbegin() const;
+    ReverseIterator rend() const;
+    template<class Visit>
+    void forEachSpan(Visit visit) const;
+    Rope materialize() const;
+  private:
+    const Rope* root; // NULL for empty views
+    size_t start;
+    size_t len;
+  };
   // fields
   static const int SHORT_THRESHOLD = 20;
-  static int nextNodeNum;
-  int nodeNum;
+  static const size_t REBALANCE_DEPTH = 20; // rebalance short ropes
+  static const size_t MAX_DEPTH = 45; // always rebalance deeper ropes
+  static const size_t SMALL_LENGTH = 1000;
+  size_t nodeNum;
   // constructors
   Rope(const Rope& src);
   Rope(const string& tSeq);
@@ -46,8 +126,17 @@ public:
   // static public methods
   static Rope concat(const Rope& rL, const Rope& rR);
   static Rope substr(const Rope& src, const size_t& start, const size_t& len);
+  static Rope rebalance(const Rope& src);
   // public methods
   size_t length() const;
+  size_t depth() const;
+  bool isBalanced() const;
+  char charAt(size_t pos) const;
+  Iterator begin() const;
+  Iterator end() const;
+  Iterator iteratorAt(size_t pos) const;
+  View view(size_t start = 0, size_t len = string::npos) const;
+  void addShape(TreeStats& dest, size_t level = 0) const;
   Rope* getLeft() const;
   Rope* getRight() const;
 private:
@@ -55,6 +144,12 @@ private:
   shared_ptr<Rope> left; // shared_ptr used to avoid excess copying
   shared_ptr<Rope> right;
   string sequence;
+  size_t len; // cached length of the subtree
+  size_t nodeDepth; // cached depth of the subtree
+  // static accessory methods
+  static size_t minLength(size_t depth);
+  static void addToForest(const Rope& src, vector<shared_ptr<Rope> >& forest);
+  static void addBalanced(const Rope& src, vector<shared_ptr<Rope> >& forest);
   // accessory methods
   bool isLeaf() const;
   bool isShortLeaf() const;
@@ -62,7 +157,38 @@ private:
   bool hasLeft() const;
   bool hasRight() const;
   bool isConcatNode() const;
-  size_t depth() const;
+  const Rope* leafAt(size_t& pos) const;
+  template<class Visit>
+  void visitSpans(size_t start, size_t len, Visit& visit) const;
 };
 
+// Calls visit(const char* chars, size_t len) for each run of the view
+// that lies within one leaf, in order
+template<class Visit>
+void Rope::View::forEachSpan(Visit visit) const{
+  if(len > 0){
+    root->visitSpans(start, len, visit);
+  }
+}
+
+// calls visit(chars, len) for the part of each leaf in
+// [start,start+len), in order
+template<class Visit>
+void Rope::visitSpans(size_t start, size_t len, Visit& visit) const{
+  if(!hasChildren()){
+    visit(sequence.data() + start, len);
+    return;
+  }
+  size_t leftLength = left->len;
+  if(start < leftLength){
+    size_t leftLen = min(len, leftLength - start);
+    left->visitSpans(start, leftLen, visit);
+    start = leftLength;
+    len -= leftLen;
+  }
+  if(len > 0){
+    right->visitSpans(start - leftLength, len, visit);
+  }
+}
+
 #endif //__ROPE_HPP_
@@ -0,0 +1,75 @@
+/** <header>
+
+ * This file is part of preBowt -- a prefix-based BWT-like transform of
+ * genetic data.
+ *
+ * Copyright 2014 David Eccles (gringer) <bioinformatics@gringene.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * without any warranty; without even the implied warranty of
+ * merchantability or fitness for a particular purpose. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+</header> **/
+
+#ifndef __SAMPLEVALUES_HPP__
+#define __SAMPLEVALUES_HPP__
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+#include "packedseq.hpp"
+
+using namespace std;
+
+// a location within the stored sequences
+class SeqPos{
+public:
+  uint64_t seqId; // order of insertion
+  uint64_t offset;
+};
+
+// A run of sampled positions, for use as a D-Tree leaf
+// (DTree<Fanout, SampleValues::LEAF_SAMPLES, SampleValues>) whose
+// elements are samples rather than bases. The samples are held inside
+// the sequence, like the bits of MarkBits, so a sample is read in
+// place and copying a leaf allocates nothing; only the samples in use
+// are copied. A leaf holds up to CAPACITY samples, enough for the
+// merged leaves of a tree of LEAF_SAMPLES samples per leaf. Samples
+// have no base class: only the tree operations that move elements
+// (substr, split, append and insert of trees) are supported.
+class SampleValues{
+public:
+  // constants
+  static const size_t LEAF_SAMPLES = 128;
+  static const size_t CAPACITY = 2 * LEAF_SAMPLES;
+  // constructors
+  SampleValues(); // create empty sequence
+  SampleValues(const SampleValues& src);
+  // operators
+  SampleValues& operator=(const SampleValues& src);
+  const SeqPos& operator[](size_t pos) const;
+  // public methods
+  SampleValues substr(size_t start, size_t len = string::npos) const;
+  void append(const SampleValues& src);
+  void push_back(const SeqPos& pos);
+  size_t length() const;
+  void occ(size_t pos, uint64_t* counts) const;
+private:
+  // fields
+  SeqPos samples[CAPACITY]; // samples at length() and beyond are unset
+  size_t len;
+  // accessory methods
+  void appendSamples(const SeqPos* src, size_t count);
+};
+
+#endif //__SAMPLEVALUES_HPP__
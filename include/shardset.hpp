@@ -0,0 +1,155 @@
+/** <header>
+
+ * This file is part of preBowt -- a prefix-based BWT-like transform of
+ * genetic data.
+ *
+ * Copyright 2014 David Eccles (gringer) <bioinformatics@gringene.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * without any warranty; without even the implied warranty of
+ * merchantability or fitness for a particular purpose. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+</header> **/
+
+#ifndef __SHARDSET_HPP__
+#define __SHARDSET_HPP__
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <cstdint>
+
+#include "prebowt.hpp"
+#include "packedseq.hpp"
+#include "positionsamples.hpp"
+#include "queryexecutor.hpp"
+
+using namespace std;
+
+// One part of a ShardSet: an independent transform, in this process
+// (LocalShard) or behind a Unix socket (RemoteShard). Sequence IDs are
+// local to the shard, in order of insertion.
+class Shard{
+public:
+  // destructor
+  virtual ~Shard();
+  // public methods
+  virtual uint64_t length() = 0; // rows, including end markers
+  virtual uint64_t sequenceCount() = 0;
+  virtual void addSequences(const vector<PackedSeq>& seqs) = 0;
+  virtual vector<uint64_t> countBatch(const vector<string>& patterns) = 0;
+  virtual vector<vector<SeqPos> >
+  locateBatch(const vector<string>& patterns) = 0;
+};
+
+// A shard held in this process. Added sequences are built into a
+// transform of their own, which is merged into the shard.
+class LocalShard : public Shard{
+public:
+  // constructors
+  LocalShard(size_t buildThreads = 1,
+             uint64_t sampleRate = PositionSamples::DEFAULT_RATE);
+  LocalShard(const Prebowt& index, size_t buildThreads = 1);
+  // public methods
+  uint64_t length();
+  uint64_t sequenceCount();
+  void addSequences(const vector<PackedSeq>& seqs);
+  vector<uint64_t> countBatch(const vector<string>& patterns);
+  vector<vector<SeqPos> > locateBatch(const vector<string>& patterns);
+  const Prebowt& index() const;
+private:
+  // fields
+  Prebowt shardIndex;
+  size_t buildThreads;
+};
+
+// A shard served by a ShardServer in another process (or thread),
+// reached through a Unix socket. Each call is one request on a single
+// connection; calls are serialised. Throws runtime_error if the
+// server cannot be reached, or reports an error.
+class RemoteShard : public Shard{
+public:
+  // constructors
+  RemoteShard(const string& socketPath);
+  // destructor
+  ~RemoteShard();
+  // public methods
+  uint64_t length();
+  uint64_t sequenceCount();
+  void addSequences(const vector<PackedSeq>& seqs);
+  vector<uint64_t> countBatch(const vector<string>& patterns);
+  vector<vector<SeqPos> > locateBatch(const vector<string>& patterns);
+  void shutdown(); // asks the server to stop
+private:
+  // fields
+  string socketPath;
+  int fd;
+  mutex requestLock;
+  // accessory methods
+  vector<char> request(char op, const vector<char>& payload);
+};
+
+// Serves a shard on a Unix socket, for RemoteShard clients. Clients
+// are served one at a time, and each request is answered before the
+// next is read.
+class ShardServer{
+public:
+  // request codes
+  enum Op : char {LENGTH, SEQUENCE_COUNT, ADD, COUNT, LOCATE, SHUTDOWN};
+  // constructors
+  ShardServer(const shared_ptr<Shard>& shard, const string& socketPath);
+  // destructor
+  ~ShardServer();
+  // public methods
+  void serve(); // returns after a SHUTDOWN request
+private:
+  // fields
+  shared_ptr<Shard> shard;
+  string socketPath;
+  int listenFd;
+  // accessory methods
+  bool serveClient(int clientFd);
+};
+
+// Sequences partitioned across several shards. New sequences go to
+// the shard holding the fewest rows, and are given global IDs in
+// order of insertion across the whole set. Queries are scattered to
+// all shards on the threads of an executor, and the results gathered:
+// counts are summed, and hits are given global sequence IDs and sorted
+// by position. Sequences already in a shard when it is added to the
+// set are numbered after those already in the set.
+class ShardSet{
+public:
+  // constructors
+  ShardSet(); // a set with no shards
+  // public methods
+  void addShard(const shared_ptr<Shard>& shard);
+  size_t shardCount() const;
+  uint64_t sequenceCount() const;
+  uint64_t length() const;
+  void addSequences(const vector<PackedSeq>& seqs, QueryExecutor& executor);
+  uint64_t count(const string& pattern, QueryExecutor& executor) const;
+  vector<SeqPos> locate(const string& pattern, QueryExecutor& executor) const;
+  vector<uint64_t> countBatch(const vector<string>& patterns,
+                              QueryExecutor& executor) const;
+  vector<vector<SeqPos> > locateBatch(const vector<string>& patterns,
+                                      QueryExecutor& executor) const;
+private:
+  // fields
+  vector<shared_ptr<Shard> > shards;
+  vector<vector<uint64_t> > globalIds; // by shard, then local ID
+  vector<uint64_t> shardLengths;
+  uint64_t nextId;
+};
+
+#endif //__SHARDSET_HPP__
@@ -0,0 +1,881 @@
+/** <header>
+
+ * This file is part of preBowt -- a prefix-based BWT-like transform of
+ * genetic data.
+ *
+ * Copyright 2014 David Eccles (gringer) <bioinformatics@gringene.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * without any warranty; without even the implied warranty of
+ * merchantability or fitness for a particular purpose. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+</header> **/
+
+#ifndef __TRANSFORMINDEX_HPP__
+#define __TRANSFORMINDEX_HPP__
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <iterator>
+#include <ostream>
+#include <queue>
+#include <limits>
+#include <algorithm>
+#include <functional>
+
+#include "packedseq.hpp"
+#include "basecount.hpp"
+#include "positionsamples.hpp"
+#include "queryexecutor.hpp"
+
+using namespace std;
+
+// a half-open range [start,end) of rows in the transform
+class RowRange{
+public:
+  uint64_t start;
+  uint64_t end;
+};
+
+// Limits for approximate (mismatch) search. Mismatches are weighed by
+// the quality of the mismatched pattern base, so that low-quality
+// bases are cheap to mismatch; see TransformIndex::findApprox.
+class ApproxOptions{
+public:
+  ApproxOptions(uint32_t maxMismatches = 2,
+                uint32_t maxPenalty = numeric_limits<uint32_t>::max(),
+                uint64_t maxHits = 0)
+    : maxMismatches(maxMismatches), maxPenalty(maxPenalty),
+      maxHits(maxHits) {}
+  uint32_t maxMismatches;
+  uint32_t maxPenalty; // highest total mismatch penalty
+  uint64_t maxHits; // stop once this many rows are found (0: no limit)
+};
+
+// rows that match a pattern with a given number of mismatches
+class ApproxHit{
+public:
+  RowRange range;
+  uint32_t mismatches;
+  uint32_t penalty;
+};
+
+// an approximate match at a location within the stored sequences
+class ApproxMatch{
+public:
+  SeqPos pos;
+  uint32_t mismatches;
+  uint32_t penalty;
+};
+
+// the number of occurrences of a k-mer
+class KmerCount{
+public:
+  string kmer;
+  uint64_t count;
+};
+
+// Queries over a prefix-array transform. Row r of the transform holds
+// the base that follows the rth prefix, with prefixes sorted by their
+// reversed sequence (ties broken by order of insertion). The first
+// sequenceCount() rows are the empty prefixes, one per sequence.
+// Tree is any rank/select structure over the rows: a live DTree, or a
+// memory-mapped MappedTree. Samples holds the sampled positions of
+// the rows (PositionSamples, or MappedSamples for a MappedTree). All
+// queries are const, and safe to run from many threads at once.
+template<class Tree, class Samples = PositionSamples>
+class TransformIndex{
+public:
+  // a read-only forward iterator over the encoded bases (with quality)
+  // of one stored sequence. Bases are decoded lazily, each with one LF
+  // step from the row of the previous prefix.
+  class SequenceIterator{
+  public:
+    typedef forward_iterator_tag iterator_category;
+    typedef uint8_t value_type;
+    typedef ptrdiff_t difference_type;
+    typedef const uint8_t* pointer;
+    typedef uint8_t reference;
+    SequenceIterator(); // the end of any sequence
+    SequenceIterator(const TransformIndex& src, uint64_t seqId);
+    uint8_t operator*() const;
+    SequenceIterator& operator++();
+    bool operator==(const SequenceIterator& other) const;
+    bool operator!=(const SequenceIterator& other) const;
+    uint64_t position() const;
+  private:
+    const TransformIndex* index; // NULL at the end of the sequence
+    uint64_t row; // row of the prefix before the current base
+    uint64_t rank; // bases of the current class before row
+    uint64_t pos;
+    uint8_t code;
+    void load();
+  };
+  typedef function<void(const KmerCount&)> KmerCallback;
+  // constants
+  static const size_t BATCH_WIDTH = 32; // queries interleaved per core
+  static const size_t PARALLEL_GRAIN = 8 * BATCH_WIDTH; // queries per task
+  static const size_t EXPORT_GRAIN = 64; // sequences per export task
+  static const size_t EXPORT_WINDOW = 64 * EXPORT_GRAIN; // held in memory
+  static const size_t KMER_CHUNKS = 4; // k-mer range chunks per thread
+  static const size_t KMER_BLOCK_ROWS = 1 << 16; // bases copied per scan
+  static const size_t KMER_GAP_ROWS = 4096; // counted before seeking
+  static const size_t KMER_SCALAR_ROWS = 32; // counted base by base
+  static const size_t AMBIG_READ_ROWS = 16; // ambiguous rows read back
+  // public methods
+  RowRange find(const PackedSeq& pattern) const;
+  uint64_t count(const string& pattern) const;
+  vector<SeqPos> locate(const string& pattern) const;
+  vector<ApproxHit> findApprox(const PackedSeq& pattern,
+                               const ApproxOptions& options) const;
+  vector<ApproxMatch> locateApprox(const PackedSeq& pattern,
+                                   const ApproxOptions& options) const;
+  vector<RowRange> findBatch(const vector<PackedSeq>& patterns) const;
+  vector<uint64_t> countBatch(const vector<string>& patterns) const;
+  vector<RowRange> findParallel(const vector<PackedSeq>& patterns,
+                                QueryExecutor& executor) const;
+  vector<uint64_t> countParallel(const vector<string>& patterns,
+                                 QueryExecutor& executor) const;
+  void kmerSpectrum(size_t k, uint64_t minCount, QueryExecutor& executor,
+                    const KmerCallback& emit) const;
+  SeqPos position(uint64_t row) const;
+  uint64_t nextRow(uint64_t row) const;
+  uint64_t prevRow(uint64_t row) const;
+  uint64_t firstRow(PackedSeq::Base base) const;
+  uint64_t sequenceCount() const;
+  uint64_t length() const;
+  SequenceIterator sequenceBegin(uint64_t seqId) const;
+  SequenceIterator sequenceEnd() const;
+  PackedSeq sequence(uint64_t seqId) const;
+  void writeFastq(ostream& out, QueryExecutor& executor) const;
+  const Tree& transform() const;
+  const Samples& positionSamples() const;
+protected:
+  // fields
+  Tree tree;
+  Samples samples; // rate 0 (none) unless set by a subclass
+private:
+  // the state of one query in a batched search
+  class BatchQuery{
+  public:
+    size_t index; // position in the input (and output)
+    size_t basePos; // next pattern base to match
+    RowRange range;
+    typename Tree::RankCursor start;
+    typename Tree::RankCursor end;
+  };
+  // accessory methods
+  // the row ranges of the k-mer prefixes of one length, in row order,
+  // with their bases (2 bits each, first base highest) in codeWords
+  // words per range
+  class KmerLevel{
+  public:
+    vector<RowRange> ranges;
+    vector<uint64_t> codes;
+  };
+  // static accessory methods
+  static void countClasses(const uint8_t* bases, size_t len,
+                           uint64_t* counts);
+  // accessory methods
+  void kmerExtend(const KmerLevel& src, size_t from, size_t to,
+                  size_t depth, size_t codeWords, uint64_t minRows,
+                  const uint64_t* baseStarts, KmerLevel* dest) const;
+  // a partial match in an approximate search
+  class ApproxState{
+  public:
+    uint32_t penalty;
+    uint32_t mismatches;
+    size_t basePos; // next pattern base to match
+    RowRange range;
+    // states are taken cheapest first, then longest first
+    bool operator<(const ApproxState& other) const{
+      return (penalty != other.penalty) ? (penalty > other.penalty) :
+        (basePos < other.basePos);
+    }
+  };
+  // static accessory methods
+  static void addApproxState(const ApproxState& state,
+                             const RowRange& next, bool matches,
+                             uint32_t penalty, const ApproxOptions& options,
+                             priority_queue<ApproxState>& pending);
+  // accessory methods
+  void extendAmbiguous(const ApproxState& state, uint8_t patternBits,
+                       uint64_t fromRank, uint64_t toRank,
+                       uint64_t ambigStart, const ApproxOptions& options,
+                       priority_queue<ApproxState>& pending) const;
+};
+
+// public methods
+
+// Rows of all prefixes that end with a pattern. Each pattern base
+// narrows the range with one LF step (two rank queries), so the cost
+// is proportional to the pattern length. Pattern bases are matched
+// by class; an end marker never matches.
+template<class Tree, class Samples>
+RowRange TransformIndex<Tree, Samples>::find(const PackedSeq& pattern) const{
+  RowRange retVal = {0, length()};
+  for(size_t i = 0; (i < pattern.length()) && (retVal.start < retVal.end);
+      i++){
+    PackedSeq::Base base = PackedSeq::baseClass(pattern[i]);
+    if(base == PackedSeq::END){
+      retVal.end = retVal.start;
+      break;
+    }
+    uint64_t baseStart = firstRow(base);
+    retVal.start = baseStart + tree.rank(base, retVal.start);
+    retVal.end = baseStart + tree.rank(base, retVal.end);
+  }
+  return retVal;
+}
+
+// number of occurrences of a pattern in the stored sequences
+template<class Tree, class Samples>
+uint64_t TransformIndex<Tree, Samples>::count(const string& pattern) const{
+  RowRange range = find(PackedSeq(pattern));
+  return range.end - range.start;
+}
+
+// start positions of all occurrences of a pattern, in row order
+template<class Tree, class Samples>
+vector<SeqPos>
+TransformIndex<Tree, Samples>::locate(const string& pattern) const{
+  RowRange range = find(PackedSeq(pattern));
+  vector<SeqPos> retVal;
+  retVal.reserve(range.end - range.start);
+  for(uint64_t row = range.start; row < range.end; row++){
+    SeqPos pos = position(row);
+    pos.offset -= pattern.length();
+    retVal.push_back(pos);
+  }
+  return retVal;
+}
+
+// Finds the rows of prefixes that end with a pattern, allowing
+// substitutions. The search branches on every base class at each
+// pattern position, taking partial matches in order of increasing
+// penalty, so hits are found best first:
+//  - a stored base matches if it is compatible with the IUPAC bits of
+//    the pattern base (so R matches A and G, and N matches anything);
+//  - a mismatch costs the quality nibble of the pattern base (at
+//    least 1), so low-quality pattern bases are cheap to mismatch;
+//  - a stored N (a no-call) only matches an N, and a stored ambiguous
+//    base matches if its IUPAC bits share a base with those of the
+//    pattern base (so a stored Y matches C); a mismatched N or
+//    ambiguous base costs 1.
+// Each step takes two occ() queries, which give the ranges of all
+// base classes at once. N is a class of its own, so N gaps cost no
+// more than any other base; the other ambiguous bases are one class,
+// so their codes are read back (see extendAmbiguous). The search
+// stops early once options.maxHits rows are found; all rows with a
+// lower penalty will have been found.
+template<class Tree, class Samples>
+vector<ApproxHit>
+TransformIndex<Tree, Samples>::findApprox(const PackedSeq& pattern,
+                                          const ApproxOptions& options) const{
+  vector<ApproxHit> retVal;
+  uint64_t baseStarts[PackedSeq::ALL + 1];
+  for(size_t b = PackedSeq::END; b <= PackedSeq::ALL; b++){
+    baseStarts[b] = firstRow((PackedSeq::Base)b);
+  }
+  priority_queue<ApproxState> pending;
+  ApproxState first = {0, 0, 0, {0, length()}};
+  pending.push(first);
+  uint64_t hitRows = 0;
+  uint64_t startCounts[PackedSeq::ALL + 1];
+  uint64_t endCounts[PackedSeq::ALL + 1];
+  while(!pending.empty()){
+    ApproxState state = pending.top();
+    pending.pop();
+    if(state.basePos == pattern.length()){
+      ApproxHit hit = {state.range, state.mismatches, state.penalty};
+      retVal.push_back(hit);
+      hitRows += state.range.end - state.range.start;
+      if((options.maxHits > 0) && (hitRows >= options.maxHits)){
+        break;
+      }
+      continue;
+    }
+    tree.occ(state.range.start, startCounts);
+    tree.occ(state.range.end, endCounts);
+    uint8_t code = pattern[state.basePos];
+    uint8_t patternBits = code >> 4;
+    uint32_t mismatchPenalty = max(code & 0x0F, 1);
+    for(size_t b = PackedSeq::A; b <= PackedSeq::T; b++){
+      RowRange next = {baseStarts[b] + startCounts[b],
+                       baseStarts[b] + endCounts[b]};
+      bool matches = ((patternBits & (1 << (b - PackedSeq::A))) != 0);
+      addApproxState(state, next, matches, mismatchPenalty, options,
+                     pending);
+    }
+    RowRange noCalls = {baseStarts[PackedSeq::N] + startCounts[PackedSeq::N],
+                        baseStarts[PackedSeq::N] + endCounts[PackedSeq::N]};
+    addApproxState(state, noCalls, patternBits == 0x0F, 1, options,
+                   pending);
+    extendAmbiguous(state, patternBits, startCounts[PackedSeq::AMBIG],
+                    endCounts[PackedSeq::AMBIG],
+                    baseStarts[PackedSeq::AMBIG], options, pending);
+  }
+  return retVal;
+}
+
+// Adds the state that extends state to the rows of next, unless next
+// is empty or a mismatch (costing penalty) would exceed the limits
+template<class Tree, class Samples>
+void TransformIndex<Tree, Samples>::addApproxState(
+  const ApproxState& state, const RowRange& next, bool matches,
+  uint32_t penalty, const ApproxOptions& options,
+  priority_queue<ApproxState>& pending){
+  if(next.start >= next.end){
+    return;
+  }
+  ApproxState retVal = state;
+  retVal.basePos++;
+  retVal.range = next;
+  if(!matches){
+    retVal.mismatches++;
+    retVal.penalty += penalty;
+    if((retVal.mismatches > options.maxMismatches) ||
+       (retVal.penalty > options.maxPenalty)){
+      return;
+    }
+  }
+  pending.push(retVal);
+}
+
+// Adds the states for the ambiguous rows (other than N) of
+// state.range, the [fromRank,toRank) ambiguous rows of the transform.
+// Each row is found with select() and its code checked against
+// patternBits; runs of rows that match, or not, become one state each.
+// More than AMBIG_READ_ROWS rows (as in the wide ranges of the first
+// pattern bases of an index with many ambiguous bases) are not read,
+// and are all taken as one mismatch, costing 1.
+template<class Tree, class Samples>
+void TransformIndex<Tree, Samples>::extendAmbiguous(
+  const ApproxState& state, uint8_t patternBits, uint64_t fromRank,
+  uint64_t toRank, uint64_t ambigStart, const ApproxOptions& options,
+  priority_queue<ApproxState>& pending) const{
+  RowRange run = {ambigStart + fromRank, ambigStart + fromRank};
+  bool runMatches = false;
+  if((toRank - fromRank) > AMBIG_READ_ROWS){
+    run.end = ambigStart + toRank;
+    addApproxState(state, run, false, 1, options, pending);
+    return;
+  }
+  for(uint64_t rank = fromRank; rank < toRank; rank++){
+    uint8_t storedBits = tree.at(tree.select(PackedSeq::AMBIG, rank)) >> 4;
+    bool matches = ((storedBits & patternBits) != 0);
+    if((run.end > run.start) && (matches != runMatches)){
+      addApproxState(state, run, runMatches, 1, options, pending);
+      run.start = run.end;
+    }
+    runMatches = matches;
+    run.end++;
+  }
+  addApproxState(state, run, runMatches, 1, options, pending);
+}
+
+// start positions of approximate matches of a pattern, best first
+template<class Tree, class Samples>
+vector<ApproxMatch>
+TransformIndex<Tree, Samples>::locateApprox(const PackedSeq& pattern,
+                                            const ApproxOptions& options) const{
+  vector<ApproxHit> hits = findApprox(pattern, options);
+  vector<ApproxMatch> retVal;
+  for(size_t i = 0; i < hits.size(); i++){
+    for(uint64_t row = hits[i].range.start; row < hits[i].range.end; row++){
+      ApproxMatch match = {position(row), hits[i].mismatches,
+                           hits[i].penalty};
+      match.pos.offset -= pattern.length();
+      retVal.push_back(match);
+    }
+  }
+  return retVal;
+}
+
+// Finds many patterns at once. Up to BATCH_WIDTH queries are advanced
+// in lockstep, one tree level each per round, with each step
+// prefetching the node needed by that query's next step; by the time
+// the round comes back to a query its node should be in cache.
+// Finished queries are replaced from the input straight away. Results
+// are in input order. With PREBOWT_STATS, hardware events for the
+// batch are counted if TreeStats::setHardwareCounting() is on.
+template<class Tree, class Samples>
+vector<RowRange>
+TransformIndex<Tree, Samples>::findBatch(
+  const vector<PackedSeq>& patterns) const{
+#if PREBOWT_STATS
+  PerfCounters perf;
+#endif
+  vector<RowRange> retVal(patterns.size());
+  uint64_t baseStarts[PackedSeq::ALL + 1];
+  for(size_t b = PackedSeq::END; b <= PackedSeq::ALL; b++){
+    baseStarts[b] = firstRow((PackedSeq::Base)b);
+  }
+  BatchQuery queries[BATCH_WIDTH];
+  bool slotUsed[BATCH_WIDTH] = {false};
+  size_t nextPattern = 0;
+  size_t activeCount = 0;
+  do {
+    for(size_t q = 0; q < BATCH_WIDTH; q++){
+      BatchQuery& query = queries[q];
+      if(!slotUsed[q]){
+        if(nextPattern == patterns.size()){
+          continue;
+        }
+        // start a new query in this slot
+        query.index = nextPattern++;
+        query.basePos = 0;
+        query.range.start = 0;
+        query.range.end = length();
+        query.start.node = NULL;
+        query.end.node = NULL;
+        slotUsed[q] = true;
+        activeCount++;
+      } else {
+        bool startDone = Tree::rankStep(query.start);
+        if(!(Tree::rankStep(query.end) && startDone)){
+          continue;
+        }
+        PackedSeq::Base base = query.start.base;
+        query.range.start = baseStarts[base] + query.start.rank;
+        query.range.end = baseStarts[base] + query.end.rank;
+        query.basePos++;
+      }
+      const PackedSeq& pattern = patterns[query.index];
+      PackedSeq::Base base = (query.basePos < pattern.length()) ?
+        PackedSeq::baseClass(pattern[query.basePos]) : PackedSeq::END;
+      if((base == PackedSeq::END) || (query.range.start >= query.range.end)){
+        if(query.basePos < pattern.length()){
+          query.range.end = query.range.start;
+        }
+        retVal[query.index] = query.range;
+        slotUsed[q] = false;
+        activeCount--;
+      } else {
+        query.start = tree.rankCursor(base, query.range.start);
+        query.end = tree.rankCursor(base, query.range.end);
+      }
+    }
+  } while((activeCount > 0) || (nextPattern < patterns.size()));
+  return retVal;
+}
+
+// batched count(); see findBatch
+template<class Tree, class Samples>
+vector<uint64_t>
+TransformIndex<Tree, Samples>::countBatch(const vector<string>& patterns) const{
+  vector<PackedSeq> encoded;
+  encoded.reserve(patterns.size());
+  for(size_t i = 0; i < patterns.size(); i++){
+    encoded.push_back(PackedSeq(patterns[i]));
+  }
+  vector<RowRange> ranges = findBatch(encoded);
+  vector<uint64_t> retVal(ranges.size());
+  for(size_t i = 0; i < ranges.size(); i++){
+    retVal[i] = ranges[i].end - ranges[i].start;
+  }
+  return retVal;
+}
+
+// findBatch() on the threads of an executor, with each task taking a
+// run of PARALLEL_GRAIN patterns
+template<class Tree, class Samples>
+vector<RowRange>
+TransformIndex<Tree, Samples>::findParallel(const vector<PackedSeq>& patterns,
+                                            QueryExecutor& executor) const{
+  vector<RowRange> retVal(patterns.size());
+  executor.parallelFor(patterns.size(), PARALLEL_GRAIN,
+                       [&](size_t start, size_t end){
+      vector<PackedSeq> chunk(patterns.begin() + start,
+                              patterns.begin() + end);
+      vector<RowRange> ranges = findBatch(chunk);
+      copy(ranges.begin(), ranges.end(), retVal.begin() + start);
+    });
+  return retVal;
+}
+
+// countBatch() on the threads of an executor; patterns are also
+// encoded in parallel
+template<class Tree, class Samples>
+vector<uint64_t>
+TransformIndex<Tree, Samples>::countParallel(const vector<string>& patterns,
+                                             QueryExecutor& executor) const{
+  vector<uint64_t> retVal(patterns.size());
+  executor.parallelFor(patterns.size(), PARALLEL_GRAIN,
+                       [&](size_t start, size_t end){
+      vector<string> chunk(patterns.begin() + start,
+                           patterns.begin() + end);
+      vector<uint64_t> counts = countBatch(chunk);
+      copy(counts.begin(), counts.end(), retVal.begin() + start);
+    });
+  return retVal;
+}
+
+// Calls emit for every k-mer of A/C/G/T bases that occurs at least
+// minCount times, in sorted order (A < C < G < T). Prefixes ending with
+// the same bases are neighbouring rows, so the k-mers of each length
+// are row ranges, and the ranges of one base longer are found from
+// them by LF. The search goes one length at a time: the ranges of a
+// length are in row order, so they are extended with one sequential
+// scan of the transform (split into chunks for the threads of an
+// executor), rather than with rank queries. Ranges rarer than minCount
+// are dropped as soon as they are found. This holds the ranges of two
+// lengths at once, at most one per distinct k-mer (as a hash table
+// of the k-mers would), and emit is only called from this thread.
+// Each length costs a scan of the rows still in play, so this keeps up
+// with a hash table at k of about 21, and is much faster when minCount
+// prunes most k-mers early, but when nearly every k-mer is unique and
+// k is large (e.g. k=31 over low-coverage reads), it reads the whole
+// transform k times and is a few times slower than a hash table.
+template<class Tree, class Samples>
+void TransformIndex<Tree, Samples>::kmerSpectrum(
+  size_t k, uint64_t minCount, QueryExecutor& executor,
+  const KmerCallback& emit) const{
+  static const char BASES[] = "ACGT";
+  if(k == 0){
+    return;
+  }
+  uint64_t baseStarts[PackedSeq::ALL + 1];
+  for(size_t b = PackedSeq::END; b <= PackedSeq::ALL; b++){
+    baseStarts[b] = firstRow((PackedSeq::Base)b);
+  }
+  uint64_t minRows = max(minCount, (uint64_t)1);
+  size_t codeWords = (k + 31) / 32;
+  KmerLevel level;
+  if(length() >= minRows){
+    RowRange all = {0, length()};
+    level.ranges.push_back(all);
+    level.codes.assign(codeWords, 0);
+  }
+  for(size_t depth = 0; (depth < k) && !level.ranges.empty(); depth++){
+    size_t chunkCount = min(level.ranges.size(),
+                            executor.threadCount() * KMER_CHUNKS);
+    vector<KmerLevel> chunkLevels(4 * chunkCount); // by chunk, then base
+    executor.parallelFor(chunkCount, 1, [&](size_t start, size_t end){
+        for(size_t c = start; c < end; c++){
+          kmerExtend(level, level.ranges.size() * c / chunkCount,
+                     level.ranges.size() * (c + 1) / chunkCount, depth,
+                     codeWords, minRows, baseStarts, &chunkLevels[4 * c]);
+        }
+      });
+    KmerLevel next;
+    for(size_t b = 0; b < 4; b++){
+      for(size_t c = 0; c < chunkCount; c++){
+        KmerLevel& part = chunkLevels[4 * c + b];
+        next.ranges.insert(next.ranges.end(), part.ranges.begin(),
+                           part.ranges.end());
+        next.codes.insert(next.codes.end(), part.codes.begin(),
+                          part.codes.end());
+        part = KmerLevel();
+      }
+    }
+    level = move(next);
+  }
+  if(level.ranges.empty()){
+    return;
+  }
+  // ranges are in order of their last base; k-mers go out in order of
+  // their first
+  const uint64_t* codes = level.codes.data();
+  vector<size_t> order(level.ranges.size());
+  for(size_t i = 0; i < order.size(); i++){
+    order[i] = i;
+  }
+  sort(order.begin(), order.end(), [&](size_t a, size_t b){
+      return lexicographical_compare(codes + a * codeWords,
+                                     codes + (a + 1) * codeWords,
+                                     codes + b * codeWords,
+                                     codes + (b + 1) * codeWords);
+    });
+  KmerCount kmerCount;
+  kmerCount.kmer.resize(k);
+  for(size_t i = 0; i < order.size(); i++){
+    const uint64_t* code = codes + order[i] * codeWords;
+    for(size_t j = 0; j < k; j++){
+      kmerCount.kmer[j] = BASES[(code[j / 32] >> (62 - 2 * (j % 32))) & 3];
+    }
+    kmerCount.count = level.ranges[order[i]].end - level.ranges[order[i]].start;
+    emit(kmerCount);
+  }
+}
+
+// The sequence and prefix length of a row. With position samples, LF
+// steps are taken until reaching a sampled row, which is at most the
+// sampling rate away. Otherwise, the row steps back (FL) until
+// reaching an empty prefix; empty prefix rows are in order of
+// insertion, so their row number is the sequence ID.
+template<class Tree, class Samples>
+SeqPos TransformIndex<Tree, Samples>::position(uint64_t row) const{
+  SeqPos retVal = {0, 0};
+  if((samples.rate() > 0) && (samples.length() == length())){
+    uint64_t steps = 0;
+    for(; !samples.find(row, retVal); steps++){
+      row = nextRow(row);
+    }
+    retVal.offset -= steps;
+    return retVal;
+  }
+  uint64_t seqCount = sequenceCount();
+  for(; row >= seqCount; retVal.offset++){
+    row = prevRow(row);
+  }
+  retVal.seqId = row;
+  return retVal;
+}
+
+// LF step: the row of the prefix extended by this row's base. Rows
+// holding end markers have no successor.
+template<class Tree, class Samples>
+uint64_t TransformIndex<Tree, Samples>::nextRow(uint64_t row) const{
+  uint8_t code;
+  uint64_t rank = tree.rankAt(row, code);
+  return firstRow(PackedSeq::baseClass(code)) + rank;
+}
+
+// FL step: the row of the prefix shortened by one base. Empty prefix
+// rows (row < sequenceCount()) have no predecessor.
+template<class Tree, class Samples>
+uint64_t TransformIndex<Tree, Samples>::prevRow(uint64_t row) const{
+  PackedSeq::Base base = PackedSeq::END;
+  uint64_t baseStart = 0;
+  while((base < PackedSeq::N) &&
+        (row >= baseStart + tree.count(base))){
+    baseStart += tree.count(base);
+    base = (PackedSeq::Base)(base + 1);
+  }
+  return tree.select(base, row - baseStart);
+}
+
+// first row of the prefixes ending in a given base class (C[base])
+template<class Tree, class Samples>
+uint64_t TransformIndex<Tree, Samples>::firstRow(PackedSeq::Base base) const{
+  uint64_t retVal = 0;
+  for(size_t b = PackedSeq::END; b < base; b++){
+    retVal += tree.count((PackedSeq::Base)b);
+  }
+  return retVal;
+}
+
+// each sequence contributes one end marker
+template<class Tree, class Samples>
+uint64_t TransformIndex<Tree, Samples>::sequenceCount() const{
+  return tree.count(PackedSeq::END);
+}
+
+template<class Tree, class Samples>
+uint64_t TransformIndex<Tree, Samples>::length() const{
+  return tree.length();
+}
+
+template<class Tree, class Samples>
+typename TransformIndex<Tree, Samples>::SequenceIterator
+TransformIndex<Tree, Samples>::sequenceBegin(uint64_t seqId) const{
+  return SequenceIterator(*this, seqId);
+}
+
+template<class Tree, class Samples>
+typename TransformIndex<Tree, Samples>::SequenceIterator
+TransformIndex<Tree, Samples>::sequenceEnd() const{
+  return SequenceIterator();
+}
+
+// the bases of a stored sequence, in their original order
+template<class Tree, class Samples>
+PackedSeq TransformIndex<Tree, Samples>::sequence(uint64_t seqId) const{
+  PackedSeq retVal;
+  for(SequenceIterator it = sequenceBegin(seqId); it != sequenceEnd(); ++it){
+    retVal.push_back(*it);
+  }
+  return retVal;
+}
+
+// Writes every stored sequence to out as a FASTQ record named by its
+// sequence ID, in order of insertion. Sequences are decoded on the
+// threads of an executor, EXPORT_WINDOW at a time, so memory use does
+// not grow with the number of sequences.
+template<class Tree, class Samples>
+void TransformIndex<Tree, Samples>::writeFastq(ostream& out,
+                                               QueryExecutor& executor) const{
+  uint64_t seqCount = sequenceCount();
+  vector<string> records(min((uint64_t)EXPORT_WINDOW, seqCount));
+  for(uint64_t windowStart = 0; windowStart < seqCount;
+      windowStart += EXPORT_WINDOW){
+    size_t windowLength = min((uint64_t)EXPORT_WINDOW,
+                              seqCount - windowStart);
+    executor.parallelFor(windowLength, EXPORT_GRAIN,
+                         [&](size_t start, size_t end){
+        for(size_t i = start; i < end; i++){
+          PackedSeq seq = sequence(windowStart + i);
+          records[i] = "@" + to_string(windowStart + i) + "\n" +
+            seq.bases() + "\n+\n" + seq.quals() + "\n";
+        }
+      });
+    for(size_t i = 0; i < windowLength; i++){
+      out << records[i];
+    }
+  }
+}
+
+template<class Tree, class Samples>
+const Tree& TransformIndex<Tree, Samples>::transform() const{
+  return tree;
+}
+
+template<class Tree, class Samples>
+const Samples& TransformIndex<Tree, Samples>::positionSamples() const{
+  return samples;
+}
+
+// private accessory methods
+
+// adds the number of bases of each class to counts[END..N]; most
+// k-mer ranges and the gaps between them are a few rows, which are
+// counted without the set-up of the vector kernels
+template<class Tree, class Samples>
+void TransformIndex<Tree, Samples>::countClasses(const uint8_t* bases,
+                                                 size_t len,
+                                                 uint64_t* counts){
+  if(len >= KMER_SCALAR_ROWS){
+    BaseCounter::countAll(bases, len, counts);
+    return;
+  }
+  for(size_t i = 0; i < len; i++){
+    counts[PackedSeq::baseClass(bases[i])]++;
+  }
+}
+
+// Extends src.ranges[from,to) by one base, adding the ranges with at
+// least minRows rows to dest[0..3] (by base). The transform is read in
+// blocks from the first range on; gaps of more than KMER_GAP_ROWS rows
+// between ranges are skipped with an occ() query.
+template<class Tree, class Samples>
+void TransformIndex<Tree, Samples>::kmerExtend(
+  const KmerLevel& src, size_t from, size_t to, size_t depth,
+  size_t codeWords, uint64_t minRows, const uint64_t* baseStarts,
+  KmerLevel* dest) const{
+  uint64_t counts[PackedSeq::ALL + 1]; // bases before pos
+  uint64_t pos = src.ranges[from].start;
+  tree.occ(pos, counts);
+  PackedSeq block;
+  uint64_t blockStart = pos;
+  for(size_t i = from; i < to; i++){
+    const RowRange& range = src.ranges[i];
+    if((range.start - pos) > KMER_GAP_ROWS){
+      pos = range.start;
+      tree.occ(pos, counts);
+    }
+    if((pos < blockStart) || (range.end > (blockStart + block.length()))){
+      blockStart = pos;
+      block = PackedSeq();
+      tree.appendTo(block, blockStart,
+                    min(max(range.end - blockStart,
+                            (uint64_t)KMER_BLOCK_ROWS),
+                        length() - blockStart));
+    }
+    const uint8_t* bases = block.data() + (pos - blockStart);
+    countClasses(bases, range.start - pos, counts);
+    uint64_t rangeCounts[PackedSeq::ALL + 1] = {0};
+    countClasses(bases + (range.start - pos), range.end - range.start,
+                 rangeCounts);
+    for(size_t b = PackedSeq::A; b <= PackedSeq::T; b++){
+      if(rangeCounts[b] >= minRows){
+        KmerLevel& next = dest[b - PackedSeq::A];
+        RowRange nextRange = {baseStarts[b] + counts[b],
+                              baseStarts[b] + counts[b] + rangeCounts[b]};
+        next.ranges.push_back(nextRange);
+        next.codes.insert(next.codes.end(),
+                          src.codes.begin() + i * codeWords,
+                          src.codes.begin() + (i + 1) * codeWords);
+        next.codes[next.codes.size() - codeWords + depth / 32] |=
+          (uint64_t)(b - PackedSeq::A) << (62 - 2 * (depth % 32));
+      }
+    }
+    for(size_t b = PackedSeq::END; b < PackedSeq::ALL; b++){
+      counts[b] += rangeCounts[b];
+    }
+    pos = range.end;
+  }
+}
+
+// SequenceIterator
+
+// constructors
+
+template<class Tree, class Samples>
+TransformIndex<Tree, Samples>::SequenceIterator::SequenceIterator()
+  : index(NULL), row(0), rank(0), pos(0), code(0){
+}
+
+// the first base of a sequence; its empty prefix is row seqId
+template<class Tree, class Samples>
+TransformIndex<Tree, Samples>::SequenceIterator::SequenceIterator(
+  const TransformIndex& src, uint64_t seqId)
+  : index(&src), row(seqId), rank(0), pos(0), code(0){
+  if(seqId >= src.sequenceCount()){
+    index = NULL;
+  } else {
+    load();
+  }
+}
+
+// operators
+
+template<class Tree, class Samples>
+uint8_t TransformIndex<Tree, Samples>::SequenceIterator::operator*() const{
+  return code;
+}
+
+// LF step to the next prefix
+template<class Tree, class Samples>
+typename TransformIndex<Tree, Samples>::SequenceIterator&
+TransformIndex<Tree, Samples>::SequenceIterator::operator++(){
+  row = index->firstRow(PackedSeq::baseClass(code)) + rank;
+  pos++;
+  load();
+  return *this;
+}
+
+template<class Tree, class Samples>
+bool TransformIndex<Tree, Samples>::SequenceIterator::operator==(
+  const SequenceIterator& other) const{
+  return (index == other.index) && ((index == NULL) || (row == other.row));
+}
+
+template<class Tree, class Samples>
+bool TransformIndex<Tree, Samples>::SequenceIterator::operator!=(
+  const SequenceIterator& other) const{
+  return !(*this == other);
+}
+
+// public methods
+
+// offset of the current base in its sequence
+template<class Tree, class Samples>
+uint64_t TransformIndex<Tree, Samples>::SequenceIterator::position() const{
+  return pos;
+}
+
+// private accessory methods
+
+// reads the base following the prefix in row; the end marker ends
+// the sequence
+template<class Tree, class Samples>
+void TransformIndex<Tree, Samples>::SequenceIterator::load(){
+  rank = index->tree.rankAt(row, code);
+  if(PackedSeq::baseClass(code) == PackedSeq::END){
+    index = NULL;
+  }
+}
+
+#endif //__TRANSFORMINDEX_HPP__
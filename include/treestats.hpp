@@ -0,0 +1,126 @@
+/** <header>
+
+ * This file is part of preBowt -- a prefix-based BWT-like transform of
+ * genetic data.
+ *
+ * Copyright 2014 David Eccles (gringer) <bioinformatics@gringene.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * without any warranty; without even the implied warranty of
+ * merchantability or fitness for a particular purpose. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+</header> **/
+
+#ifndef __TREESTATS_HPP__
+#define __TREESTATS_HPP__
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <atomic>
+
+using namespace std;
+
+// Counts operations on the hot paths of DTree and Rope: nodes visited
+// and leaf bytes scanned by queries, splits, appends and node
+// allocations. Counting is only compiled in with PREBOWT_STATS=1
+// (cmake -DPREBOWT_STATS=ON); otherwise TREE_STAT() expands to nothing.
+// Each thread counts into its own block, without locks or atomic
+// read-modify-writes, and snapshot() sums the blocks of all threads.
+// Tree shape (leaf depths and node fill) is gathered on request by
+// walking a tree with addShape(), and does not need PREBOWT_STATS.
+class TreeStats{
+public:
+  // constants
+  enum Counter : size_t {QUERIES, NODES_VISITED, LEAF_BYTES_SCANNED,
+                         SPLITS, APPENDS, OVERFLOWS, NODE_ALLOCATIONS,
+                         COUNTER_COUNT};
+  enum Hardware : size_t {CYCLES, INSTRUCTIONS, CACHE_MISSES,
+                          BRANCH_MISSES, HARDWARE_COUNT};
+  static const size_t DEPTH_MAX = 64; // deeper leaves go in the last bin
+  static const size_t FILL_BINS = 10;
+  // fields
+  uint64_t counters[COUNTER_COUNT];
+  uint64_t hardware[HARDWARE_COUNT]; // from perf_event, if available
+  bool hardwareAvailable;
+  uint64_t leafDepths[DEPTH_MAX]; // leaves at each depth below the root
+  uint64_t nodeFills[FILL_BINS]; // internal nodes by tenths of fanout
+  uint64_t leafFills[FILL_BINS]; // leaves by tenths of capacity
+  // constructors
+  TreeStats(); // all zero
+  // static public methods
+  static bool enabled();
+  static TreeStats snapshot();
+  static void reset();
+  static void setHardwareCounting(bool enable);
+  static bool hardwareCounting();
+  static void addHardware(const uint64_t* values);
+  static inline void add(Counter counter, uint64_t count);
+  // public methods
+  void addLeaf(size_t depth, uint64_t length, uint64_t capacity);
+  void addNode(size_t childCount, size_t fanout);
+  string json() const;
+private:
+  // counters written by a single thread; see add()
+  class Block{
+  public:
+    atomic<uint64_t> values[COUNTER_COUNT];
+    Block();
+    ~Block();
+  };
+  // static accessory methods
+  static inline Block& localBlock();
+};
+
+// Counts hardware events (cycles, instructions, cache misses, branch
+// misses) on the calling thread from construction to destruction, and
+// adds them to the TreeStats hardware totals. Nothing is counted
+// unless TreeStats::setHardwareCounting(true) has been called and
+// perf_event_open() is permitted.
+class PerfCounters{
+public:
+  // constructors
+  PerfCounters();
+  // destructor
+  ~PerfCounters();
+private:
+  int fds[TreeStats::HARDWARE_COUNT]; // -1 if not counting
+  // copying would close the counters twice
+  PerfCounters(const PerfCounters& src);
+  PerfCounters& operator=(const PerfCounters& src);
+};
+
+#if PREBOWT_STATS
+#define TREE_STAT(counter, count) \
+  TreeStats::add(TreeStats::counter, (count))
+#else
+#define TREE_STAT(counter, count) ((void)0)
+#endif
+
+// static public methods
+
+// Only the owning thread writes to its block, so a relaxed load and
+// store is enough; other threads may read a slightly stale value.
+inline void TreeStats::add(Counter counter, uint64_t count){
+  atomic<uint64_t>& value = localBlock().values[counter];
+  value.store(value.load(memory_order_relaxed) + count,
+              memory_order_relaxed);
+}
+
+// static accessory methods
+
+inline TreeStats::Block& TreeStats::localBlock(){
+  static thread_local Block block;
+  return block;
+}
+
+#endif //__TREESTATS_HPP__
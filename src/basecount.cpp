@@ -0,0 +1,360 @@
+/** <header>
+
+ * This file is part of preBowt -- a prefix-based BWT-like transform of
+ * genetic data.
+ *
+ * Copyright 2014 David Eccles (gringer) <bioinformatics@gringene.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * without any warranty; without even the implied warranty of
+ * merchantability or fitness for a particular purpose. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+</header> **/
+
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define BASECOUNT_X86 1
+#include <immintrin.h>
+#endif
+
+#include "basecount.hpp"
+
+// the classes that are a single base nibble (high nibble of the
+// code), and their nibbles; every other code is AMBIG
+static const PackedSeq::Base NIBBLE_CLASSES[] = {
+  PackedSeq::END, PackedSeq::A, PackedSeq::C, PackedSeq::G, PackedSeq::T,
+  PackedSeq::N
+};
+static const uint8_t CLASS_NIBBLES[] = {0x00, 0x10, 0x20, 0x40, 0x80, 0xF0};
+static const size_t CLASS_COUNT = 6; // END, A, C, G, T, N
+
+// byte counters are flushed before they can overflow
+static const size_t FLUSH_VECTORS = 255;
+
+// 2-bit symbols per 64-bit word
+static const size_t WORD_SYMBOLS = 32;
+static const uint64_t LOW_BITS = 0x5555555555555555ULL;
+
+// bit i*2 is set for each symbol i of a word that equals symbol
+static inline uint64_t symbolMatches(uint64_t word, unsigned symbol){
+  uint64_t diff = word ^ (LOW_BITS * symbol);
+  return ~(diff | (diff >> 1)) & LOW_BITS;
+}
+
+// scalar kernels
+
+static uint64_t countScalar(const uint8_t* codes, size_t len,
+                            uint8_t nibble){
+  uint64_t retVal = 0;
+  for(size_t i = 0; i < len; i++){
+    retVal += ((codes[i] & 0xF0) == nibble);
+  }
+  return retVal;
+}
+
+// number of 2-bit symbols in the first len of words equal to symbol
+static uint64_t countSymbolsScalar(const uint64_t* words, size_t len,
+                                   unsigned symbol){
+  uint64_t retVal = 0;
+  size_t fullWords = len / WORD_SYMBOLS;
+  for(size_t i = 0; i < fullWords; i++){
+    retVal += __builtin_popcountll(symbolMatches(words[i], symbol));
+  }
+  size_t tail = len % WORD_SYMBOLS;
+  if(tail > 0){
+    uint64_t mask = (1ULL << (tail * 2)) - 1;
+    retVal += __builtin_popcountll(symbolMatches(words[fullWords], symbol)
+                                   & mask);
+  }
+  return retVal;
+}
+
+// counts[END..N] += class counts of codes[0,len)
+static void countAllScalar(const uint8_t* codes, size_t len,
+                           uint64_t* counts){
+  uint64_t nibbleCounts[16] = {0};
+  for(size_t i = 0; i < len; i++){
+    nibbleCounts[codes[i] >> 4]++;
+  }
+  for(size_t i = 0; i < 16; i++){
+    counts[PackedSeq::baseClass(i << 4)] += nibbleCounts[i];
+  }
+}
+
+#if BASECOUNT_X86
+
+// SSE2 kernels
+
+__attribute__((target("sse2")))
+static uint64_t sumLanes(__m128i sums){
+  uint64_t lanes[2];
+  _mm_storeu_si128((__m128i*)lanes, sums);
+  return lanes[0] + lanes[1];
+}
+
+__attribute__((target("sse2")))
+static uint64_t countSSE2(const uint8_t* codes, size_t len, uint8_t nibble){
+  const __m128i mask = _mm_set1_epi8((char)0xF0);
+  const __m128i target = _mm_set1_epi8((char)nibble);
+  const __m128i zero = _mm_setzero_si128();
+  __m128i sums = zero;
+  size_t vecEnd = len & ~(size_t)15;
+  size_t i = 0;
+  while(i < vecEnd){
+    size_t blockEnd = min(vecEnd, i + FLUSH_VECTORS * 16);
+    __m128i hits = zero;
+    for(; i < blockEnd; i += 16){
+      __m128i v = _mm_and_si128(_mm_loadu_si128((const __m128i*)(codes + i)),
+                                mask);
+      hits = _mm_sub_epi8(hits, _mm_cmpeq_epi8(v, target));
+    }
+    sums = _mm_add_epi64(sums, _mm_sad_epu8(hits, zero));
+  }
+  return sumLanes(sums) + countScalar(codes + i, len - i, nibble);
+}
+
+__attribute__((target("sse2")))
+static void countAllSSE2(const uint8_t* codes, size_t len, uint64_t* counts){
+  const __m128i mask = _mm_set1_epi8((char)0xF0);
+  const __m128i zero = _mm_setzero_si128();
+  __m128i targets[CLASS_COUNT];
+  __m128i sums[CLASS_COUNT];
+  for(size_t c = 0; c < CLASS_COUNT; c++){
+    targets[c] = _mm_set1_epi8((char)CLASS_NIBBLES[c]);
+    sums[c] = zero;
+  }
+  size_t vecEnd = len & ~(size_t)15;
+  size_t i = 0;
+  while(i < vecEnd){
+    size_t blockEnd = min(vecEnd, i + FLUSH_VECTORS * 16);
+    __m128i hits[CLASS_COUNT];
+    for(size_t c = 0; c < CLASS_COUNT; c++){
+      hits[c] = zero;
+    }
+    for(; i < blockEnd; i += 16){
+      __m128i v = _mm_and_si128(_mm_loadu_si128((const __m128i*)(codes + i)),
+                                mask);
+      for(size_t c = 0; c < CLASS_COUNT; c++){
+        hits[c] = _mm_sub_epi8(hits[c], _mm_cmpeq_epi8(v, targets[c]));
+      }
+    }
+    for(size_t c = 0; c < CLASS_COUNT; c++){
+      sums[c] = _mm_add_epi64(sums[c], _mm_sad_epu8(hits[c], zero));
+    }
+  }
+  uint64_t classified = 0;
+  for(size_t c = 0; c < CLASS_COUNT; c++){
+    uint64_t classCount = sumLanes(sums[c]);
+    counts[NIBBLE_CLASSES[c]] += classCount;
+    classified += classCount;
+  }
+  counts[PackedSeq::AMBIG] += vecEnd - classified;
+  countAllScalar(codes + i, len - i, counts);
+}
+
+// AVX2 kernels
+
+__attribute__((target("avx2")))
+static uint64_t sumLanes(__m256i sums){
+  uint64_t lanes[4];
+  _mm256_storeu_si256((__m256i*)lanes, sums);
+  return lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
+
+__attribute__((target("avx2")))
+static uint64_t countAVX2(const uint8_t* codes, size_t len, uint8_t nibble){
+  const __m256i mask = _mm256_set1_epi8((char)0xF0);
+  const __m256i target = _mm256_set1_epi8((char)nibble);
+  const __m256i zero = _mm256_setzero_si256();
+  __m256i sums = zero;
+  size_t vecEnd = len & ~(size_t)31;
+  size_t i = 0;
+  while(i < vecEnd){
+    size_t blockEnd = min(vecEnd, i + FLUSH_VECTORS * 32);
+    __m256i hits = zero;
+    for(; i < blockEnd; i += 32){
+      __m256i v = _mm256_and_si256(
+        _mm256_loadu_si256((const __m256i*)(codes + i)), mask);
+      hits = _mm256_sub_epi8(hits, _mm256_cmpeq_epi8(v, target));
+    }
+    sums = _mm256_add_epi64(sums, _mm256_sad_epu8(hits, zero));
+  }
+  return sumLanes(sums) + countScalar(codes + i, len - i, nibble);
+}
+
+// All four nucleotides, END and N are counted in one pass over the
+// codes; everything else is ambiguous.
+__attribute__((target("avx2")))
+static void countAllAVX2(const uint8_t* codes, size_t len, uint64_t* counts){
+  const __m256i mask = _mm256_set1_epi8((char)0xF0);
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i tEnd = _mm256_set1_epi8((char)0x00);
+  const __m256i tA = _mm256_set1_epi8((char)0x10);
+  const __m256i tC = _mm256_set1_epi8((char)0x20);
+  const __m256i tG = _mm256_set1_epi8((char)0x40);
+  const __m256i tT = _mm256_set1_epi8((char)0x80);
+  const __m256i tN = _mm256_set1_epi8((char)0xF0);
+  __m256i sEnd = zero, sA = zero, sC = zero, sG = zero, sT = zero;
+  __m256i sN = zero;
+  size_t vecEnd = len & ~(size_t)31;
+  size_t i = 0;
+  while(i < vecEnd){
+    size_t blockEnd = min(vecEnd, i + FLUSH_VECTORS * 32);
+    __m256i hEnd = zero, hA = zero, hC = zero, hG = zero, hT = zero;
+    __m256i hN = zero;
+    for(; i < blockEnd; i += 32){
+      __m256i v = _mm256_and_si256(
+        _mm256_loadu_si256((const __m256i*)(codes + i)), mask);
+      hEnd = _mm256_sub_epi8(hEnd, _mm256_cmpeq_epi8(v, tEnd));
+      hA = _mm256_sub_epi8(hA, _mm256_cmpeq_epi8(v, tA));
+      hC = _mm256_sub_epi8(hC, _mm256_cmpeq_epi8(v, tC));
+      hG = _mm256_sub_epi8(hG, _mm256_cmpeq_epi8(v, tG));
+      hT = _mm256_sub_epi8(hT, _mm256_cmpeq_epi8(v, tT));
+      hN = _mm256_sub_epi8(hN, _mm256_cmpeq_epi8(v, tN));
+    }
+    sEnd = _mm256_add_epi64(sEnd, _mm256_sad_epu8(hEnd, zero));
+    sA = _mm256_add_epi64(sA, _mm256_sad_epu8(hA, zero));
+    sC = _mm256_add_epi64(sC, _mm256_sad_epu8(hC, zero));
+    sG = _mm256_add_epi64(sG, _mm256_sad_epu8(hG, zero));
+    sT = _mm256_add_epi64(sT, _mm256_sad_epu8(hT, zero));
+    sN = _mm256_add_epi64(sN, _mm256_sad_epu8(hN, zero));
+  }
+  uint64_t classCounts[CLASS_COUNT] = {
+    sumLanes(sEnd), sumLanes(sA), sumLanes(sC), sumLanes(sG), sumLanes(sT),
+    sumLanes(sN)
+  };
+  uint64_t classified = 0;
+  for(size_t c = 0; c < CLASS_COUNT; c++){
+    counts[NIBBLE_CLASSES[c]] += classCounts[c];
+    classified += classCounts[c];
+  }
+  counts[PackedSeq::AMBIG] += vecEnd - classified;
+  countAllScalar(codes + i, len - i, counts);
+}
+
+// as countSymbolsScalar, with the popcnt instruction (present on all
+// AVX2 processors)
+__attribute__((target("popcnt")))
+static uint64_t countSymbolsPopcnt(const uint64_t* words, size_t len,
+                                   unsigned symbol){
+  uint64_t retVal = 0;
+  size_t fullWords = len / WORD_SYMBOLS;
+  for(size_t i = 0; i < fullWords; i++){
+    retVal += __builtin_popcountll(symbolMatches(words[i], symbol));
+  }
+  size_t tail = len % WORD_SYMBOLS;
+  if(tail > 0){
+    uint64_t mask = (1ULL << (tail * 2)) - 1;
+    retVal += __builtin_popcountll(symbolMatches(words[fullWords], symbol)
+                                   & mask);
+  }
+  return retVal;
+}
+
+#endif // BASECOUNT_X86
+
+// static public methods
+
+// number of bases of a given class in codes[0,len)
+uint64_t BaseCounter::count(const uint8_t* codes, size_t len,
+                            PackedSeq::Base base){
+  if(base == PackedSeq::AMBIG){
+    uint64_t counts[PackedSeq::ALL + 1] = {0};
+    active().countAll(codes, len, counts);
+    return counts[PackedSeq::AMBIG];
+  }
+  uint8_t nibble = (base == PackedSeq::N) ? 0xF0 : CLASS_NIBBLES[base];
+  return active().count(codes, len, nibble);
+}
+
+// adds the class counts of codes[0,len) to counts[END..N]
+void BaseCounter::countAll(const uint8_t* codes, size_t len,
+                           uint64_t* counts){
+  active().countAll(codes, len, counts);
+}
+
+// position of the nth (0-based) base of a given class in codes[0,len),
+// or len if there are not that many
+size_t BaseCounter::select(const uint8_t* codes, size_t len,
+                           PackedSeq::Base base, uint64_t nth){
+  for(size_t i = 0; i < len; i++){
+    if((PackedSeq::baseClass(codes[i]) == base) && (nth-- == 0)){
+      return i;
+    }
+  }
+  return len;
+}
+
+// number of 2-bit symbols in the first len symbols of words (packed
+// from the low bits up) that are equal to symbol
+uint64_t BaseCounter::countSymbols(const uint64_t* words, size_t len,
+                                   unsigned symbol){
+  return active().countSymbols(words, len, symbol);
+}
+
+BaseCounter::Kernel BaseCounter::bestKernel(){
+#if BASECOUNT_X86
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx2")){
+    return AVX2;
+  }
+  if(__builtin_cpu_supports("sse2")){
+    return SSE2;
+  }
+#endif
+  return SCALAR;
+}
+
+BaseCounter::Kernel BaseCounter::kernel(){
+  return active().kernel;
+}
+
+// switch kernels (e.g. for benchmarking); not safe while other
+// threads are counting. Returns false if the CPU lacks support.
+bool BaseCounter::setKernel(Kernel newKernel){
+  if(newKernel > bestKernel()){
+    return false;
+  }
+  active() = dispatchFor(newKernel);
+  return true;
+}
+
+const char* BaseCounter::kernelName(Kernel kernel){
+  switch(kernel){
+  case AVX2: return "avx2";
+  case SSE2: return "sse2";
+  default: return "scalar";
+  }
+}
+
+// private static accessory methods
+
+BaseCounter::Dispatch& BaseCounter::active(){
+  static Dispatch dispatch = dispatchFor(bestKernel());
+  return dispatch;
+}
+
+BaseCounter::Dispatch BaseCounter::dispatchFor(Kernel kernel){
+  Dispatch retVal = {kernel, countScalar, countAllScalar, countSymbolsScalar};
+#if BASECOUNT_X86
+  if(kernel == AVX2){
+    retVal.count = countAVX2;
+    retVal.countAll = countAllAVX2;
+    retVal.countSymbols = countSymbolsPopcnt;
+  } else if(kernel == SSE2){
+    retVal.count = countSSE2;
+    retVal.countAll = countAllSSE2;
+  }
+#endif
+  return retVal;
+}
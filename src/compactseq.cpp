@@ -0,0 +1,370 @@
+/** <header>
+
+ * This file is part of preBowt -- a prefix-based BWT-like transform of
+ * genetic data.
+ *
+ * Copyright 2014 David Eccles (gringer) <bioinformatics@gringene.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * without any warranty; without even the implied warranty of
+ * merchantability or fitness for a particular purpose. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+</header> **/
+
+#include <algorithm>
+
+#include "compactseq.hpp"
+#include "basecount.hpp"
+
+// 2-bit symbols per 64-bit word
+static const size_t WORD_SYMBOLS = 32;
+static const uint64_t LOW_BITS = 0x5555555555555555ULL;
+
+// bit i*2 is set for each symbol i of a word that equals symbol
+static inline uint64_t symbolMatches(uint64_t word, unsigned symbol){
+  uint64_t diff = word ^ (LOW_BITS * symbol);
+  return ~(diff | (diff >> 1)) & LOW_BITS;
+}
+
+// A/C/G/T are stored as symbols 0-3; anything else is an exception
+static inline bool isSymbol(PackedSeq::Base base){
+  return (base >= PackedSeq::A) && (base <= PackedSeq::T);
+}
+
+ostream& operator<<(ostream& out, const CompactSeq& src){
+  out << src.decode();
+  return out;
+}
+
+// constructors
+
+CompactSeq::CompactSeq(){
+}
+
+// Encodes bases in whichever form is smaller
+CompactSeq::CompactSeq(const PackedSeq& src){
+  size_t len = src.length();
+  if(len == 0){
+    return;
+  }
+  const uint8_t* codes = src.data();
+  size_t runCount = 1;
+  size_t exceptionCount = 0;
+  bool hasQuals = false;
+  for(size_t i = 0; i < len; i++){
+    runCount += (i > 0) && (codes[i] != codes[i - 1]);
+    exceptionCount += !isSymbol(PackedSeq::baseClass(codes[i]));
+    hasQuals |= ((codes[i] & 0x0F) != 0);
+  }
+  size_t wordCount = (len + WORD_SYMBOLS - 1) / WORD_SYMBOLS;
+  size_t symbolBytes = wordCount * sizeof(uint64_t) +
+    exceptionCount * sizeof(Exception) + (hasQuals ? (len + 1) / 2 : 0);
+  size_t runBytes = runCount * (sizeof(uint8_t) + sizeof(uint32_t));
+  shared_ptr<Encoded> newEncoded = make_shared<Encoded>();
+  newEncoded->length = len;
+  newEncoded->runEncoded = (runBytes < symbolBytes);
+  if(newEncoded->runEncoded){
+    newEncoded->runCodes.reserve(runCount);
+    newEncoded->runEnds.reserve(runCount);
+    for(size_t i = 0; i < len; i++){
+      if((i + 1 == len) || (codes[i + 1] != codes[i])){
+        newEncoded->runCodes.push_back(codes[i]);
+        newEncoded->runEnds.push_back(i + 1);
+      }
+    }
+  } else {
+    newEncoded->symbols.assign(wordCount, 0);
+    newEncoded->exceptions.reserve(exceptionCount);
+    if(hasQuals){
+      newEncoded->quals.assign((len + 1) / 2, 0);
+    }
+    for(size_t i = 0; i < len; i++){
+      PackedSeq::Base base = PackedSeq::baseClass(codes[i]);
+      if(isSymbol(base)){
+        newEncoded->symbols[i / WORD_SYMBOLS] |=
+          (uint64_t)(base - PackedSeq::A) << ((i % WORD_SYMBOLS) * 2);
+      } else {
+        Exception exception = {(uint32_t)i, codes[i]};
+        newEncoded->exceptions.push_back(exception);
+      }
+      if(hasQuals){
+        newEncoded->quals[i / 2] |= (codes[i] & 0x0F) << ((i % 2) * 4);
+      }
+    }
+  }
+  encoded = newEncoded;
+}
+
+// public methods
+
+// mirrors string::substr: over-length arguments are truncated
+CompactSeq CompactSeq::substr(size_t start, size_t len) const{
+  PackedSeq bases;
+  appendTo(bases, start, len);
+  return CompactSeq(bases);
+}
+
+void CompactSeq::append(const CompactSeq& src){
+  PackedSeq bases = decode();
+  src.appendTo(bases, 0, src.length());
+  *this = CompactSeq(bases);
+}
+
+void CompactSeq::append(const PackedSeq& src){
+  PackedSeq bases = decode();
+  bases.append(src);
+  *this = CompactSeq(bases);
+}
+
+void CompactSeq::insert(size_t pos, uint8_t code){
+  PackedSeq bases = decode();
+  bases.insert(pos, code);
+  *this = CompactSeq(bases);
+}
+
+size_t CompactSeq::length() const{
+  return encoded ? encoded->length : 0;
+}
+
+uint8_t CompactSeq::operator[](size_t pos) const{
+  if(encoded->runEncoded){
+    return encoded->runCodes[runAt(pos)];
+  }
+  size_t exception = exceptionsBefore(pos);
+  if((exception < encoded->exceptions.size()) &&
+     (encoded->exceptions[exception].pos == pos)){
+    return encoded->exceptions[exception].code;
+  }
+  unsigned symbol = (encoded->symbols[pos / WORD_SYMBOLS] >>
+                     ((pos % WORD_SYMBOLS) * 2)) & 3;
+  uint8_t qual = encoded->quals.empty() ? 0 :
+    (encoded->quals[pos / 2] >> ((pos % 2) * 4)) & 0x0F;
+  return (0x10 << symbol) | qual;
+}
+
+// number of bases of a given class in [0,pos)
+uint64_t CompactSeq::rank(Base base, size_t pos) const{
+  pos = min(pos, length());
+  if(pos == 0){
+    return 0;
+  }
+  uint64_t retVal = 0;
+  if(encoded->runEncoded){
+    size_t runStart = 0;
+    for(size_t r = 0; runStart < pos; r++){
+      size_t runEnd = min((size_t)encoded->runEnds[r], pos);
+      if(PackedSeq::baseClass(encoded->runCodes[r]) == base){
+        retVal += runEnd - runStart;
+      }
+      runStart = runEnd;
+    }
+    return retVal;
+  }
+  size_t exceptionEnd = exceptionsBefore(pos);
+  if(isSymbol(base)){
+    retVal = BaseCounter::countSymbols(encoded->symbols.data(), pos,
+                                       base - PackedSeq::A);
+    // exceptions are stored as A
+    return (base == PackedSeq::A) ? (retVal - exceptionEnd) : retVal;
+  }
+  for(size_t i = 0; i < exceptionEnd; i++){
+    retVal += (PackedSeq::baseClass(encoded->exceptions[i].code) == base);
+  }
+  return retVal;
+}
+
+// add the number of bases of each class in [0,pos) to counts[END..N],
+// and the total to counts[ALL]
+void CompactSeq::occ(size_t pos, uint64_t* counts) const{
+  pos = min(pos, length());
+  if(pos == 0){
+    return;
+  }
+  counts[PackedSeq::ALL] += pos;
+  if(encoded->runEncoded){
+    size_t runStart = 0;
+    for(size_t r = 0; runStart < pos; r++){
+      size_t runEnd = min((size_t)encoded->runEnds[r], pos);
+      counts[PackedSeq::baseClass(encoded->runCodes[r])] += runEnd - runStart;
+      runStart = runEnd;
+    }
+    return;
+  }
+  for(size_t b = PackedSeq::A; b <= PackedSeq::T; b++){
+    counts[b] += BaseCounter::countSymbols(encoded->symbols.data(), pos,
+                                           b - PackedSeq::A);
+  }
+  size_t exceptionEnd = exceptionsBefore(pos);
+  counts[PackedSeq::A] -= exceptionEnd;
+  for(size_t i = 0; i < exceptionEnd; i++){
+    counts[PackedSeq::baseClass(encoded->exceptions[i].code)]++;
+  }
+}
+
+// position of the nth (0-based) base of a given class, or length()
+// if there are not that many
+size_t CompactSeq::select(Base base, uint64_t nth) const{
+  if(!encoded){
+    return 0;
+  }
+  if(encoded->runEncoded){
+    size_t runStart = 0;
+    for(size_t r = 0; r < encoded->runCodes.size(); r++){
+      size_t runLength = encoded->runEnds[r] - runStart;
+      if(PackedSeq::baseClass(encoded->runCodes[r]) == base){
+        if(nth < runLength){
+          return runStart + nth;
+        }
+        nth -= runLength;
+      }
+      runStart = encoded->runEnds[r];
+    }
+    return length();
+  }
+  const vector<Exception>& exceptions = encoded->exceptions;
+  if(!isSymbol(base)){
+    for(size_t i = 0; i < exceptions.size(); i++){
+      if((PackedSeq::baseClass(exceptions[i].code) == base) &&
+         (nth-- == 0)){
+        return exceptions[i].pos;
+      }
+    }
+    return length();
+  }
+  size_t nextException = 0;
+  size_t wordCount = encoded->symbols.size();
+  for(size_t w = 0; w < wordCount; w++){
+    uint64_t matches = symbolMatches(encoded->symbols[w],
+                                     base - PackedSeq::A);
+    size_t wordEnd = (w + 1) * WORD_SYMBOLS;
+    if(wordEnd > length()){
+      matches &= (1ULL << ((length() % WORD_SYMBOLS) * 2)) - 1;
+    }
+    // exception slots hold A, but are not As
+    for(; (nextException < exceptions.size()) &&
+          (exceptions[nextException].pos < wordEnd); nextException++){
+      if(base == PackedSeq::A){
+        matches &= ~(1ULL << ((exceptions[nextException].pos %
+                               WORD_SYMBOLS) * 2));
+      }
+    }
+    uint64_t matchCount = __builtin_popcountll(matches);
+    if(nth < matchCount){
+      for(; nth > 0; nth--){
+        matches &= matches - 1;
+      }
+      return w * WORD_SYMBOLS + __builtin_ctzll(matches) / 2;
+    }
+    nth -= matchCount;
+  }
+  return length();
+}
+
+// prefetches the words needed to rank up to pos
+void CompactSeq::prefetch(size_t pos) const{
+  if(!encoded){
+    return;
+  }
+  if(encoded->runEncoded){
+    __builtin_prefetch(encoded->runCodes.data());
+    __builtin_prefetch(encoded->runEnds.data());
+    return;
+  }
+  const uint64_t* words = encoded->symbols.data();
+  for(size_t i = 0; i < pos; i += 8 * WORD_SYMBOLS){
+    __builtin_prefetch(words + i / WORD_SYMBOLS);
+  }
+  __builtin_prefetch(encoded->exceptions.data());
+}
+
+// appends the bases in [start,start+len), truncated to the end of
+// the sequence, to dest
+void CompactSeq::appendTo(PackedSeq& dest, size_t start, size_t len) const{
+  if(start >= length()){
+    return;
+  }
+  size_t end = start + min(len, length() - start);
+  vector<uint8_t> codes;
+  codes.reserve(end - start);
+  if(encoded->runEncoded){
+    for(size_t r = runAt(start), i = start; i < end; r++){
+      size_t runEnd = min((size_t)encoded->runEnds[r], end);
+      codes.insert(codes.end(), runEnd - i, encoded->runCodes[r]);
+      i = runEnd;
+    }
+  } else {
+    const vector<Exception>& exceptions = encoded->exceptions;
+    size_t nextException = exceptionsBefore(start);
+    for(size_t i = start; i < end; i++){
+      if((nextException < exceptions.size()) &&
+         (exceptions[nextException].pos == i)){
+        codes.push_back(exceptions[nextException++].code);
+        continue;
+      }
+      unsigned symbol = (encoded->symbols[i / WORD_SYMBOLS] >>
+                         ((i % WORD_SYMBOLS) * 2)) & 3;
+      uint8_t qual = encoded->quals.empty() ? 0 :
+        (encoded->quals[i / 2] >> ((i % 2) * 4)) & 0x0F;
+      codes.push_back((0x10 << symbol) | qual);
+    }
+  }
+  dest.append(codes.data(), codes.size());
+}
+
+PackedSeq CompactSeq::decode() const{
+  PackedSeq retVal;
+  appendTo(retVal, 0, length());
+  return retVal;
+}
+
+// heap and inline bytes used by this sequence (shared storage is
+// counted in full)
+size_t CompactSeq::memoryBytes() const{
+  size_t retVal = sizeof(CompactSeq);
+  if(encoded){
+    retVal += sizeof(Encoded) +
+      encoded->symbols.capacity() * sizeof(uint64_t) +
+      encoded->exceptions.capacity() * sizeof(Exception) +
+      encoded->quals.capacity() +
+      encoded->runCodes.capacity() +
+      encoded->runEnds.capacity() * sizeof(uint32_t);
+  }
+  return retVal;
+}
+
+bool CompactSeq::isRunEncoded() const{
+  return encoded && encoded->runEncoded;
+}
+
+// private accessory methods
+
+// number of exceptions at positions before pos
+size_t CompactSeq::exceptionsBefore(size_t pos) const{
+  const vector<Exception>& exceptions = encoded->exceptions;
+  size_t low = 0;
+  size_t high = exceptions.size();
+  while(low < high){
+    size_t mid = (low + high) / 2;
+    if(exceptions[mid].pos < pos){
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low;
+}
+
+// index of the run containing pos
+size_t CompactSeq::runAt(size_t pos) const{
+  return upper_bound(encoded->runEnds.begin(), encoded->runEnds.end(),
+                     (uint32_t)pos) - encoded->runEnds.begin();
+}
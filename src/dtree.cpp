@@ -20,251 +20,458 @@
 
 </header> **/
 
-#include <iostream>
-
-#include "dtree.hpp"
-#include "prebowtconfig.hpp"
-
-size_t DTree::leafDepth = 0;
-size_t DTree::nextNodeNum = 0;
-
 #define NODE_DEBUG 1
 //#define MEMORY_DEBUG 1
 
-ostream& operator<<(ostream& out, const DTree& src){
-#if NODE_DEBUG
-  out << "{";
-#if MEMORY_DEBUG
-  out << "#" << src.nodeNum;
-#endif
-#endif
-  if(src.nodes[0]){
-    out << *(src.nodes[0]);
-  }
-  for(size_t i = 0; i < src.nodeCount; i++){
-#if NODE_DEBUG
-    out << "<" << src.deltas[i] << ">";
-    out << "[";
-#endif
-    out << src.sequences[i];
-#if NODE_DEBUG
-    out << "]";
-#endif
-    if(src.nodes[i+1]){
-      out << *(src.nodes[i+1]);
-    }
-  }
-#if NODE_DEBUG
-  out << "<" << src.deltas[src.nodeCount] << ">";
-  out << "}";
-#endif
-  return out;
-}
-
-// constructors
-
-DTree::DTree(){
-  initialise();
-}
-
-DTree::DTree(const string& src){
-  initialise();
-  inplaceAppend(src);
-#if MEMORY_DEBUG
-  cerr << "%% " << *this << endl;
-#endif
-}
-
-// Copy constructor (shallow copy)
-DTree::DTree(const DTree& src){
-  initialise();
-  depth = src.depth;
-  inplaceAppend(src);
-}
-
-// Assignment operator (shallow copy)
-DTree& DTree::operator=(const DTree& src){
-  if(this != &src){ // gracefully handle self assignment
-    initialise();
-    depth = src.depth;
-    inplaceAppend(src);
-  }
-  return *this;
-}
-
-// public methods
-
-DTree DTree::substr(const uint64_t& start, const uint64_t& len) const{
-  uint64_t end = start + len;
-  DSplit startSplit = split(start);
-  DTree retVal = split(start).right.split(len).left;
-  return(retVal);
-}
-
-// splits a tree into two component DTrees at location pos
-// retVal.left: this[0,pos)
-// retVal.right: this[pos,this->length())
-DSplit DTree::split(const uint64_t& splitPos) const{
-  if(splitPos < deltas[0]){
-    // split point is inside the first child
-    DSplit preSplit = nodes[0]->split(splitPos);
-    DSplit retVal;
-    retVal.right = *this;
-    shared_ptr<DTree> preRight(&preSplit.right);
-    retVal.right.nodes[0] = preRight;
-    retVal.left = preSplit.left;
-    return retVal;
-  }
-  size_t splitNode = 0;
-  uint64_t splitStart = 0;
-  uint64_t startPosSplit = 0;
-  uint64_t pos = deltas[0] + deltas[1];
-  for(size_t i = 1; (i < nodeCount) && (splitPos > pos); i++){
-    splitNode++;
-    startPosSplit = pos;
-    pos+= deltas[i+1];
-  }
-  DSplit retVal;
-  string preSplit = (splitPos == 0) ? 
-    "" : sequences[splitNode].substr(0,splitPos - startPosSplit);
-  string postSplit = sequences[splitNode].substr(splitPos - startPosSplit);
-  retVal.left.inplaceAppend(*this,0,splitNode);
-  retVal.left.inplaceAppend(preSplit);
-  retVal.right.inplaceAppend(postSplit);
-  retVal.right.inplaceAppend(*this,splitNode+1);
-  return retVal;
-}
-
-DTree DTree::append(const DTree& src) const{
-  DTree retVal = *this;
-  if((nodeCount + src.nodeCount) <= SEQ_MAX){
-    retVal.deltas[retVal.nodeCount] += src.deltas[0];
-    for(int i = 0; i < src.nodeCount; i++){
-      // TODO: need to check right node here to prevent overwrite
-      retVal.nodes[retVal.nodeCount] = src.nodes[i];
-      retVal.sequences[retVal.nodeCount] = src.sequences[i];
-      retVal.deltas[++retVal.nodeCount] = src.deltas[i+1];
-    }
-  }
-  retVal.seqLength += src.seqLength;
-  return retVal;
-}
-
-DTree DTree::insert( const uint64_t& pos, const DTree& src) const{
-  DSplit insertSplit = split(pos);
-  return insertSplit.left.append(src).append(insertSplit.right);
-}
-
-uint64_t DTree::length() const{
-  return seqLength;
-}
-
-// private accessory methods
-
-void DTree::initialise(){
-  nodeCount = 0;
-  depth = 0;
-  nodeNum = DTree::nextNodeNum++;
-  seqLength = 0;
-  deltas[0] = 0;
-}
+#include <iostream>
+#include <cstdio>
+#include <sstream>
+#include <fstream>
+#include <stdexcept>
 
-// append nodes and sequences in-place from another DTree
-void DTree::inplaceAppend(const DTree& src, size_t fromNode, size_t toNode){
-  if((fromNode >= toNode) || (fromNode >= src.nodeCount)){
-    return;
-  }
-  //cerr << "Appending to: " << *this << endl;
-  deltas[nodeCount] += src.deltas[fromNode];
-  if(fromNode > 0){
-    deltas[nodeCount] -= src.sequences[fromNode-1].length();
-  }
-  // Append to pre-existing node if it exists
-  if(nodes[nodeCount]){
-    DTree toAppend = *src.nodes[fromNode];
-    nodes[nodeCount]->inplaceAppend(toAppend);
-  } else {
-    nodes[nodeCount] = src.nodes[fromNode];
-  }
-  for(int i = fromNode; (i < toNode) && (i < src.nodeCount); i++){
-    sequences[nodeCount] = src.sequences[i];
-    deltas[nodeCount+1] = src.deltas[i+1];
-    nodes[nodeCount+1] = src.nodes[i+1];
-    nodeCount++;
-    seqLength += src.deltas[i+1];
-  }
-  //cerr << "Result: " << *this << endl;
-}
+#include "dtree.hpp"
+#include "rope.hpp"
+#include "prebowt.hpp"
+#include "fastxreader.hpp"
+#include "shardset.hpp"
+#include "prebowtconfig.hpp"
 
-// append sequence in-place
-void DTree::inplaceAppend(const string& src){
-  sequences[nodeCount] = src;
-  deltas[++nodeCount] = src.length();
-  seqLength += src.length();
-}
+// small nodes, so that the tests exercise multi-level trees
+typedef DTree<4, 8> TestTree;
 
 // test function
 
 int main(){
   size_t nextTestID = 0;
-  string sA("The quick brown ");
-  string sB("fox jumps over ");
-  string sC("the lazy ");
-  string sD("dog");
+  string sA("GATTACAGGCTTAACG");
+  string sB("TTGCAWCCGNNATGC");
+  string sC("CCGTARGTA");
+  string sD("AGT");
   cout << "[" << ++nextTestID << "] Testing tree creation... ";
-  DTree dA(sA);
-  DTree dB = sB;
-  DTree dC(sC);
-  DTree dD = sD;
+  TestTree dA(sA);
+  TestTree dB = sB;
+  TestTree dC(sC);
+  TestTree dD = sD;
   cout << " done\n";
   cout << "    Result[dA]: " << dA << endl;
   cout << "    Result[dB]: " << dB << endl;
   cout << "    Result[dC]: " << dC << endl;
   cout << "    Result[dD]: " << dD << endl;
   cout << "[" << ++nextTestID << "] Testing append of DTree A and DTree B...";
-  DTree dE = dA.append(dB);
+  TestTree dE = dA.append(dB);
   cout << " done\n";
   cout << "    Result[dE]: " << dE << endl;
   cout << "[" << ++nextTestID << "] Testing append of DTree E and DTree C...";
-  DTree dF = dE.append(dC);
+  TestTree dF = dE.append(dC);
   cout << " done\n";
   cout << "    Result[dF]: " << dF << endl;
   cout << "[" << ++nextTestID << "] Testing split in middle...";
-  DSplit sG = dA.split(10);
+  DSplit<4, 8> sG = dA.split(10);
   cout << " done\n";
   cout << "    Result[sG.left]: " << sG.left << endl;
   cout << "    Result[sG.right]: " << sG.right << endl;
   cout << "[" << ++nextTestID << "] Testing split at left...";
-  DSplit sH = dA.split(0);
+  DSplit<4, 8> sH = dA.split(0);
   cout << " done\n";
   cout << "    Result[sH.left]: " << sH.left << endl;
   cout << "    Result[sH.right]: " << sH.right << endl;
   cout << "[" << ++nextTestID << "] Testing split at right...";
-  DSplit sI = dA.split(dA.length());
+  DSplit<4, 8> sI = dA.split(dA.length());
   cout << " done\n";
   cout << "    Result[sI.left]: " << sI.left << endl;
   cout << "    Result[sI.right]: " << sI.right << endl;
   cout << "[" << ++nextTestID 
        << "] Testing complete substring on single node using length()... ";
-  cout << "'" << dA.substr(0,dA.length()) << "' == 'The quick brown '...";
+  cout << "'" << dA.substr(0,dA.length()) << "' == 'GATTACAGGCTTAACG'...";
   cout << " done\n";
   cout << "[" << ++nextTestID 
        << "] Testing partial substring on single node... ";
-  cout << "'" << dA.substr(4,5) << "' == 'quick'...";
+  cout << "'" << dA.substr(4,5) << "' == 'ACAGG'...";
   cout << " done\n";
   cout << "[" << ++nextTestID 
        << "] Testing substring with range [0,len(left)+1]...";
   cout << "'" << dE.substr(0,sA.length()+1)
-       << "' == 'The quick brown f'...";
+       << "' == 'GATTACAGGCTTAACGT'...";
   cout << " done\n";
   cout << "[" << ++nextTestID 
        << "] Testing substring with range [4,len(left+right)]...";
   cout << "'" << dE.substr(4,sA.length()+sB.length() - 4)
-       << "' == 'quick brown fox jumps over '...";
+       << "' == 'ACAGGCTTAACGTTGCAWCCGNNATGC'...";
   cout << " done\n";
   cout << "[" << ++nextTestID 
        << "] Testing insertion...";
-  DTree dJ = dA.append(dC).insert(dA.length(), dB);
+  TestTree dJ = dA.append(dC).insert(dA.length(), dB);
   cout << " done\n";
   cout << "     Result[dJ]: " << dJ << endl;
+  cout << "[" << ++nextTestID
+       << "] Testing rank of G within [0,20) of dF...";
+  cout << " '" << dF.rank(PackedSeq::G, 20) << "' == '5'...";
+  cout << " done\n";
+  cout << "[" << ++nextTestID
+       << "] Testing occ within [0,len(dF)-1) of dF...";
+  uint64_t counts[PackedSeq::ALL + 1];
+  dF.occ(dF.length() - 1, counts);
+  cout << " '";
+  for(size_t b = 0; b <= PackedSeq::ALL; b++){
+    cout << ((b == 0) ? "" : ",") << counts[b];
+  }
+  cout << "' == '0,8,9,9,9,2,2,39'...";
+  cout << " done\n";
+  cout << "[" << ++nextTestID
+       << "] Testing base+quality encoding round trip...";
+  PackedSeq pK("ACGTNRYW$", "I5)!IIII!");
+  cout << " done\n";
+  cout << "     Result[pK]: " << pK.bases() << " " << pK.quals()
+       << " == ACGTNRYW$ I5)!IIII!" << endl;
+  cout << "[" << ++nextTestID
+       << "] Testing transform creation from sA, sB, sC...";
+  vector<PackedSeq> seqs;
+  seqs.push_back(PackedSeq(sA));
+  seqs.push_back(PackedSeq(sB));
+  seqs.push_back(PackedSeq(sC));
+  Prebowt pL(seqs);
+  cout << " done\n";
+  cout << "     Result[pL]: " << pL.transform() << endl;
+  cout << "[" << ++nextTestID << "] Testing pattern count...";
+  cout << " '" << pL.count("TA") << "' == '4'...";
+  cout << " done\n";
+  cout << "[" << ++nextTestID << "] Testing pattern locate...";
+  vector<SeqPos> hits = pL.locate("TA");
+  cout << " '";
+  for(size_t i = 0; i < hits.size(); i++){
+    cout << ((i == 0) ? "" : ",") << hits[i].seqId << ":" << hits[i].offset;
+  }
+  cout << "' == '2:3,2:7,0:3,0:11'...";
+  cout << " done\n";
+  cout << "[" << ++nextTestID
+       << "] Testing dynamic insertion of sA, sB, sC...";
+  Prebowt pM;
+  for(size_t i = 0; i < seqs.size(); i++){
+    pM.addSequence(seqs[i]);
+  }
+  cout << " done\n";
+  cout << "     Result[pM]: " << pM.transform() << endl;
+  cout << "                 " << pL.transform() << " (== pL)" << endl;
+  cout << "[" << ++nextTestID
+       << "] Testing parallel construction of sA, sB, sC...";
+  Prebowt pN = Prebowt::build(seqs, 3);
+  cout << " done\n";
+  cout << "     Result[pN]: " << pN.transform() << endl;
+  cout << "                 " << pL.transform() << " (== pL)" << endl;
+  cout << "[" << ++nextTestID << "] Testing save and mapping of pL...";
+  pL.save("prebowt_test.pbi");
+  MappedPrebowt pO("prebowt_test.pbi");
+  cout << " '" << pO.count("TA") << "' == '4'...";
+  hits = pO.locate("TA");
+  cout << " '";
+  for(size_t i = 0; i < hits.size(); i++){
+    cout << ((i == 0) ? "" : ",") << hits[i].seqId << ":" << hits[i].offset;
+  }
+  cout << "' == '2:3,2:7,0:3,0:11'...";
+  cout << " '" << pO.positionSamples().rate() << ","
+       << pO.positionSamples().sampleCount() << "' == '"
+       << pL.positionSamples().rate() << ","
+       << pL.positionSamples().sampleCount() << "'...";
+  remove("prebowt_test.pbi");
+  cout << " done\n";
+  cout << "[" << ++nextTestID
+       << "] Testing rejection of sequences with end markers...";
+  size_t rejected = 0;
+  vector<PackedSeq> endSeqs(1, PackedSeq("AC$T"));
+  try {
+    pL.addSequence(endSeqs[0]);
+  } catch(const invalid_argument& e) {
+    rejected++;
+  }
+  try {
+    Prebowt::build(endSeqs, 2);
+  } catch(const invalid_argument& e) {
+    rejected++;
+  }
+  cout << " '" << rejected << "," << pL.sequenceCount() << "," << pL.count("TA")
+       << "' == '2,3,4'...";
+  cout << " done\n";
+  cout << "[" << ++nextTestID
+       << "] Testing snapshot isolation while adding sD...";
+  VersionedPrebowt pV(pL);
+  VersionedPrebowt::Snapshot before = pV.snapshot();
+  pV.addSequence(PackedSeq(sD));
+  VersionedPrebowt::Snapshot after = pV.snapshot();
+  cout << " '" << before->count("AGT") << "," << after->count("AGT")
+       << "' == '0,1'...";
+  cout << " done\n";
+  cout << "[" << ++nextTestID << "] Testing parallel pattern count...";
+  QueryExecutor executor(3);
+  vector<string> patterns;
+  patterns.push_back("TA");
+  patterns.push_back("AGT");
+  patterns.push_back("CC");
+  patterns.push_back("G");
+  vector<uint64_t> hitCounts = after->countParallel(patterns, executor);
+  cout << " '" << hitCounts[0] << "," << hitCounts[1] << ","
+       << hitCounts[2] << "," << hitCounts[3] << "' == '4,1,2,10'...";
+  cout << " done\n";
+  cout << "[" << ++nextTestID << "] Testing compressed copy of pL...";
+  CompactPrebowt pP(pL);
+  cout << " '" << pP.count("TA") << "' == '4'...";
+  hits = pP.locate("TA");
+  cout << " '";
+  for(size_t i = 0; i < hits.size(); i++){
+    cout << ((i == 0) ? "" : ",") << hits[i].seqId << ":" << hits[i].offset;
+  }
+  cout << "' == '2:3,2:7,0:3,0:11'...";
+  cout << " done\n";
+  cout << "     Result[pP]: " << pP.transform() << endl;
+  cout << "                 " << pL.transform() << " (== pL)" << endl;
+  cout << "[" << ++nextTestID
+       << "] Testing sampled locate after insertion and merging...";
+  Prebowt pQ(2);
+  for(size_t i = 0; i < seqs.size(); i++){
+    pQ.addSequence(seqs[i]);
+  }
+  Prebowt pR = Prebowt::build(seqs, 3, 2);
+  vector<SeqPos> hitsQ = pQ.locate("TA");
+  vector<SeqPos> hitsR = pR.locate("TA");
+  cout << " '";
+  for(size_t i = 0; i < hitsQ.size(); i++){
+    cout << ((i == 0) ? "" : ",") << hitsQ[i].seqId << ":" << hitsQ[i].offset;
+  }
+  cout << "' == '";
+  for(size_t i = 0; i < hitsR.size(); i++){
+    cout << ((i == 0) ? "" : ",") << hitsR[i].seqId << ":" << hitsR[i].offset;
+  }
+  cout << "' == '2:3,2:7,0:3,0:11'...";
+  cout << " done\n";
+  cout << "[" << ++nextTestID << "] Testing sequence recovery from pM...";
+  cout << " '" << pM.sequence(1).bases() << "' == '" << sB << "'...";
+  cout << " done\n";
+  cout << "[" << ++nextTestID << "] Testing FASTQ export of pP...";
+  ostringstream fastq;
+  pP.writeFastq(fastq, executor);
+  cout << " done\n";
+  istringstream fastqLines(fastq.str());
+  string fastqLine;
+  while(getline(fastqLines, fastqLine)){
+    cout << "     " << fastqLine << endl;
+  }
+  cout << "[" << ++nextTestID
+       << "] Testing 1-mismatch search for TCR in pL...";
+  vector<ApproxMatch> approx = pL.locateApprox(PackedSeq("TCR"),
+                                               ApproxOptions(1));
+  cout << " '";
+  for(size_t i = 0; i < approx.size(); i++){
+    cout << ((i == 0) ? "" : ",") << approx[i].pos.seqId << ":"
+         << approx[i].pos.offset << "/" << approx[i].mismatches;
+  }
+  cout << "' == '1:5/1,0:11/1,2:3/1,0:2/1,0:10/1,1:0/1,1:2/1,2:0/1,1:6/1,"
+       << "0:4/1,0:13/1'...";
+  cout << " done\n";
+  cout << "[" << ++nextTestID
+       << "] Testing search for CAT, TCG, CCT, GNA, GCA in stored ACRTTYGA,"
+       << " GGNAC...";
+  Prebowt pY;
+  pY.addSequence(PackedSeq("ACRTTYGA"));
+  pY.addSequence(PackedSeq("GGNAC"));
+  const char* ambigPatterns[] = {"CAT", "TCG", "CCT", "GNA", "GCA"};
+  cout << " '";
+  for(size_t p = 0; p < 5; p++){
+    approx = pY.locateApprox(PackedSeq(ambigPatterns[p]), ApproxOptions(0));
+    for(size_t i = 0; i < approx.size(); i++){
+      cout << ((p == 0) ? "" : ",") << approx[i].pos.seqId << ":"
+           << approx[i].pos.offset << "/" << approx[i].mismatches;
+    }
+  }
+  approx = pY.locateApprox(PackedSeq("CCT"), ApproxOptions(1));
+  cout << "," << approx.size() << ":" << approx[0].pos.offset << "/"
+       << approx[0].mismatches << "' == '0:1/0,0:4/0,1:1/0,1:1/1'...";
+  cout << " done\n";
+  cout << "[" << ++nextTestID << "] Testing 2-mer spectrum of pL...";
+  cout << " '";
+  size_t kmersSeen = 0;
+  pL.kmerSpectrum(2, 3, executor, [&](const KmerCount& kmerCount){
+      cout << ((kmersSeen++ == 0) ? "" : ",") << kmerCount.kmer << ":"
+           << kmerCount.count;
+    });
+  cout << "' == 'CG:3,GC:3,TA:4,TT:3'...";
+  cout << " done\n";
+  cout << "[" << ++nextTestID << "] Testing shape statistics of dF...";
+  TreeStats shape;
+  dF.addShape(shape);
+  cout << " done\n";
+  cout << "     Result[dF]: " << shape.json() << endl;
+  cout << "[" << ++nextTestID << "] Testing bulk load of sA, sB, sC...";
+  TestTree::Loader loader;
+  loader.append(PackedSeq(sA));
+  loader.append(PackedSeq(sB));
+  loader.append(PackedSeq(sC));
+  TestTree dK = loader.finish();
+  cout << " done\n";
+  cout << "     Result[dK]: " << dK << endl;
+  cout << "[" << ++nextTestID
+       << "] Testing parallel FASTQ and FASTA reading...";
+  {
+    ofstream fastqFile("prebowt_test.fq");
+    fastqFile << "@A\n" << sA << "\n+\n" << string(sA.length(), 'I')
+              << "\n@B\r\n" << sB << "\r\n+B\r\n"
+              << string(sB.length(), '5') << "\r\n@C\n" << sC << "\n+\n"
+              << string(sC.length(), '+');
+    ofstream fastaFile("prebowt_test.fa");
+    fastaFile << ">A\n" << sA.substr(0, 10) << "\n" << sA.substr(10)
+              << "\n\n>B\n" << sB << "\n>C\n" << sC << "\n";
+  }
+  vector<PackedSeq> fastqSeqs =
+    ParallelFastxReader("prebowt_test.fq").readAll(executor);
+  vector<PackedSeq> fastaSeqs =
+    ParallelFastxReader("prebowt_test.fa").readAll(executor);
+  remove("prebowt_test.fq");
+  remove("prebowt_test.fa");
+  cout << " done\n";
+  for(size_t i = 0; i < fastqSeqs.size(); i++){
+    cout << "     Result[fq" << i << "]: " << fastqSeqs[i].bases() << " "
+         << fastqSeqs[i].quals() << endl;
+  }
+  for(size_t i = 0; i < fastaSeqs.size(); i++){
+    cout << "     Result[fa" << i << "]: " << fastaSeqs[i] << endl;
+  }
+  cout << "[" << ++nextTestID
+       << "] Testing gaps and end markers in records read as N...";
+  {
+    ofstream fastaFile("prebowt_test.fa");
+    fastaFile << ">A\nACGT-TTGA\n>B\nGGTTC\n";
+  }
+  vector<PackedSeq> gapSeqs =
+    ParallelFastxReader("prebowt_test.fa").readAll(executor);
+  remove("prebowt_test.fa");
+  istringstream gapLines("@A\nAC$T\n+\nIIII\n>B\nGG-C\n");
+  vector<PackedSeq> gapRecords = FastxReader(gapLines).readAll();
+  gapSeqs.insert(gapSeqs.end(), gapRecords.begin(), gapRecords.end());
+  Prebowt pZ(gapSeqs);
+  hits = pZ.locate("GG");
+  cout << " '" << pZ.sequenceCount();
+  for(size_t i = 0; i < hits.size(); i++){
+    cout << "," << hits[i].seqId << ":" << hits[i].offset;
+  }
+  for(size_t i = 0; i < gapSeqs.size(); i++){
+    cout << "," << gapSeqs[i];
+  }
+  cout << "' == '4,1:0,3:0,ACGTNTTGA,GGTTC,ACNT,GGNC'...";
+  cout << " done\n";
+  cout << "[" << ++nextTestID << "] Testing view of dF[12,24)...";
+  TestTree::View window = dF.view(12, 12);
+  string forward, backward, leafRuns;
+  for(TestTree::View::Iterator it = window.begin(); it != window.end(); ++it){
+    forward += PackedSeq::decodeBase(*it);
+  }
+  for(TestTree::View::ReverseIterator it = window.rbegin();
+      it != window.rend(); ++it){
+    backward += PackedSeq::decodeBase(*it);
+  }
+  window.forEachLeaf([&](const PackedSeq& bases, size_t start, size_t len){
+      leafRuns += (leafRuns.empty() ? "" : "|") +
+        bases.substr(start, len).bases();
+    });
+  cout << " '" << forward << "' == 'AACGTTGCAWCC'...";
+  cout << " '" << backward << "' == 'CCWACGTTGCAA'...";
+  cout << " '" << PackedSeq::decodeBase(window.substr(9).at(0))
+       << "' == 'W'...";
+  cout << " done\n";
+  cout << "     Result[leaves]: " << leafRuns << endl;
+  cout << "     Result[tree]: " << window.materialize() << endl;
+  cout << "[" << ++nextTestID
+       << "] Testing sharded search of sA, sB, sC, sD, GTAC...";
+  shared_ptr<Shard> servedShard = make_shared<LocalShard>();
+  ShardServer server(servedShard, "prebowt_test.sock");
+  thread serverThread(&ShardServer::serve, &server);
+  shared_ptr<RemoteShard> remoteShard =
+    make_shared<RemoteShard>("prebowt_test.sock");
+  ShardSet shardSet;
+  shardSet.addShard(make_shared<LocalShard>());
+  shardSet.addShard(remoteShard);
+  shardSet.addShard(make_shared<LocalShard>());
+  vector<PackedSeq> shardSeqs(seqs);
+  shardSeqs.push_back(PackedSeq(sD));
+  shardSet.addSequences(shardSeqs, executor);
+  cout << " '" << shardSet.count("TA", executor) << "' == '4'...";
+  hits = shardSet.locate("GT", executor);
+  cout << " '";
+  for(size_t i = 0; i < hits.size(); i++){
+    cout << ((i == 0) ? "" : ",") << hits[i].seqId << ":" << hits[i].offset;
+  }
+  cout << "' == '2:2,2:6,3:1'...";
+  cout << " '" << servedShard->sequenceCount() << "' == '1'...";
+  // the second sequence goes to the remote shard, which rejects it
+  vector<PackedSeq> badBatch;
+  badBatch.push_back(PackedSeq("GTAC"));
+  badBatch.push_back(PackedSeq("A$C"));
+  size_t failedAdds = 0;
+  try {
+    shardSet.addSequences(badBatch, executor);
+  } catch(const exception& e) {
+    failedAdds++;
+  }
+  hits = shardSet.locate("GT", executor);
+  cout << " '" << failedAdds;
+  for(size_t i = 0; i < hits.size(); i++){
+    cout << "," << hits[i].seqId << ":" << hits[i].offset;
+  }
+  cout << "' == '1,2:2,2:6,3:1,4:0'...";
+  remoteShard->shutdown();
+  serverThread.join();
+  cout << " done\n";
+  cout << "[" << ++nextTestID << "] Testing rope creation...";
+  Rope rA("The quick brown ");
+  Rope rB("fox jumps over ");
+  Rope rC("the lazy ");
+  Rope rD("dog");
+  cout << " done\n";
+  cout << "     Result[rA]: " << rA << endl;
+  cout << "     Result[rB]: " << rB << endl;
+  cout << "     Result[rC]: " << rC << endl;
+  cout << "     Result[rD]: " << rD << endl;
+  cout << "[" << ++nextTestID << "] Testing rope concatenation...";
+  Rope rE = Rope::concat(rA, rB);
+  Rope rF(rA, rB);
+  Rope rG = Rope::concat(rF, rC);
+  Rope rH = Rope::concat(rG, rD);
+  cout << " done\n";
+  cout << "     Result[rE]: " << rE << endl;
+  cout << "     Result[rF]: " << rF << endl;
+  cout << "     Result[rG]: " << rG << endl;
+  cout << "     Result[rH]: " << rH << endl;
+  cout << "[" << ++nextTestID << "] Testing rope substrings...";
+  cout << " '" << Rope::substr(rA, 4, 5) << "' == 'quick'...";
+  cout << " '" << Rope::substr(rF, 0, rF.getLeft()->length() + 1)
+       << "' == 'The quick brown f'...";
+  cout << " '" << Rope::substr(rF, 4, rF.length())
+       << "' == 'quick brown fox jumps over '...";
+  cout << " done\n";
+  cout << "[" << ++nextTestID << "] Testing rope lookup and iteration...";
+  cout << " '" << rH.charAt(4) << rH.charAt(16) << rH.charAt(rH.length() - 1)
+       << "' == 'qfg'...";
+  cout << " '" << string(rH.iteratorAt(35), rH.end()) << "' == 'lazy dog'...";
+  cout << " done\n";
+  cout << "[" << ++nextTestID
+       << "] Testing rebalancing of 1000 appended rope leaves...";
+  Rope rI("");
+  for(int j = 0; j < 1000; j++){
+    rI = Rope::concat(rI, Rope("0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ"));
+  }
+  cout << " '" << (rI.depth() <= Rope::MAX_DEPTH) << "' == '1'...";
+  cout << " '" << Rope::substr(rI, 35990, 10) << "' == 'QRSTUVWXYZ'...";
+  cout << " done\n";
+  cout << "[" << ++nextTestID << "] Testing view of rH[4,20)...";
+  Rope::View ropeWindow = rH.view(4, 16);
+  string ropeSpans;
+  ropeWindow.forEachSpan([&](const char* chars, size_t spanLen){
+      ropeSpans += (ropeSpans.empty() ? "" : "|") + string(chars, spanLen);
+    });
+  cout << " '" << ropeWindow.charAt(0) << ropeWindow.charAt(12)
+       << "' == 'qf'...";
+  cout << " '" << string(ropeWindow.begin(), ropeWindow.end())
+       << "' == 'quick brown fox '...";
+  cout << " '" << string(ropeWindow.rbegin(), ropeWindow.rend())
+       << "' == ' xof nworb kciuq'...";
+  cout << " '" << ropeWindow.substr(6, 5).materialize() << "' == 'brown'...";
+  cout << " done\n";
+  cout << "     Result[spans]: " << ropeSpans << endl;
 }
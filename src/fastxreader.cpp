@@ -0,0 +1,404 @@
+/** <header>
+
+ * This file is part of preBowt -- a prefix-based BWT-like transform of
+ * genetic data.
+ *
+ * Copyright 2014 David Eccles (gringer) <bioinformatics@gringene.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * without any warranty; without even the implied warranty of
+ * merchantability or fitness for a particular purpose. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+</header> **/
+
+#include <cstring>
+#include <climits>
+#include <stdexcept>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if PREBOWT_ZLIB
+#include <zlib.h>
+#endif
+
+#include "fastxreader.hpp"
+
+// Gaps ('-') and '$' encode as end markers, which would split a record
+// in two once it is added to a transform, so they are read as N
+static void maskEndMarkers(uint8_t* codes, size_t len){
+  for(size_t i = 0; i < len; i++){
+    if(PackedSeq::baseClass(codes[i]) == PackedSeq::END){
+      codes[i] |= 0xF0;
+    }
+  }
+}
+
+// FastxReader
+
+// constructors
+
+FastxReader::FastxReader(istream& in) : in(in), haveLine(false){
+}
+
+// public methods
+
+// reads the next record; returns false at the end of the input
+bool FastxReader::next(PackedSeq& seq, string& name){
+  while((haveLine || nextLine()) && line.empty()){
+    haveLine = false;
+  }
+  if(!haveLine){
+    return false;
+  }
+  haveLine = false;
+  char recordType = line[0];
+  name = line.substr(1);
+  string bases;
+  while(nextLine() && (line.empty() ||
+                       ((line[0] != '>') && (line[0] != '@') &&
+                        (line[0] != '+')))){
+    bases += line;
+    haveLine = false;
+  }
+  seq = PackedSeq();
+  uint8_t* dest = seq.extend(bases.length());
+  if((recordType == '@') && haveLine && (line[0] == '+')){
+    // quality lines continue until they cover the bases
+    string quals;
+    haveLine = false;
+    while((quals.length() < bases.length()) && nextLine()){
+      quals += line;
+      haveLine = false;
+    }
+    quals.resize(bases.length(), PackedSeq::PHRED_OFFSET);
+    PackedSeq::encode(bases.data(), quals.data(), bases.length(), dest);
+  } else {
+    PackedSeq::encode(bases.data(), NULL, bases.length(), dest);
+  }
+  maskEndMarkers(dest, bases.length());
+  return true;
+}
+
+vector<PackedSeq> FastxReader::readAll(){
+  vector<PackedSeq> retVal;
+  PackedSeq seq;
+  string name;
+  while(next(seq, name)){
+    retVal.push_back(seq);
+  }
+  return retVal;
+}
+
+// private accessory methods
+
+// loads the next line (without line ending) into line, if there is one
+bool FastxReader::nextLine(){
+  if(haveLine){
+    return true;
+  }
+  if(!getline(in, line)){
+    return false;
+  }
+  if(!line.empty() && (line[line.length() - 1] == '\r')){
+    line.erase(line.length() - 1);
+  }
+  haveLine = true;
+  return true;
+}
+
+// the length of a line, without its line ending, and the start of the
+// next line (or end, if the line is not finished)
+static size_t lineLength(const char* data, size_t pos, size_t end,
+                         size_t& nextLine){
+  const char* lineEnd =
+    static_cast<const char*>(memchr(data + pos, '\n', end - pos));
+  size_t retVal = (lineEnd == NULL) ? (end - pos) : (lineEnd - data - pos);
+  nextLine = (lineEnd == NULL) ? end : (pos + retVal + 1);
+  if((retVal > 0) && (data[pos + retVal - 1] == '\r')){
+    retVal--;
+  }
+  return retVal;
+}
+
+// ParallelFastxReader
+
+// constructors
+
+// throws runtime_error if the file cannot be read
+ParallelFastxReader::ParallelFastxReader(const string& fileName)
+  : fileName(fileName), mappedLength(0), mappedPos(0), bufferLength(0),
+    inputDone(false), format(0), windowBytes(WINDOW_BYTES){
+  int fd = open(fileName.c_str(), O_RDONLY);
+  if(fd < 0){
+    throw runtime_error("cannot open sequence file: " + fileName);
+  }
+  struct stat fileStat;
+  if(fstat(fd, &fileStat) != 0){
+    close(fd);
+    throw runtime_error("cannot read sequence file: " + fileName);
+  }
+  unsigned char magic[2] = {0, 0};
+  bool isGzip = (pread(fd, magic, 2, 0) == 2) &&
+    (magic[0] == 0x1f) && (magic[1] == 0x8b);
+  if(!isGzip){
+    size_t fileSize = fileStat.st_size;
+    if(fileSize > 0){
+      void* addr = mmap(NULL, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+      if(addr == MAP_FAILED){
+        close(fd);
+        throw runtime_error("cannot map sequence file: " + fileName);
+      }
+      madvise(addr, fileSize, MADV_SEQUENTIAL);
+      mapping.reset(static_cast<const char*>(addr),
+                    [fileSize](const char* p){
+                      munmap(const_cast<char*>(p), fileSize);
+                    });
+    }
+    close(fd);
+    mappedLength = fileSize;
+    return;
+  }
+#if PREBOWT_ZLIB
+  gzFile gzipIn = gzdopen(fd, "rb");
+  if(gzipIn == NULL){
+    close(fd);
+    throw runtime_error("cannot read gzip file: " + fileName);
+  }
+  gzbuffer(gzipIn, 1 << 20);
+  gzipFile.reset(gzipIn, [](void* p){
+      gzclose(static_cast<gzFile>(p));
+    });
+#else
+  close(fd);
+  throw runtime_error("reading gzip files needs zlib: " + fileName);
+#endif
+}
+
+// public methods
+
+// Adds the records of the next window to dest; returns false once the
+// input is used up. Throws runtime_error for input that is not FASTA
+// or FASTQ, or FASTQ records with the wrong number of qualities.
+bool ParallelFastxReader::next(vector<PackedSeq>& dest,
+                               QueryExecutor& executor){
+  const char* data;
+  size_t length;
+  bool last;
+  while(loadWindow(data, length, last)){
+    if(format == 0){
+      size_t first = 0;
+      while((first < length) && isspace((unsigned char)data[first])){
+        first++;
+      }
+      if(first == length){
+        consume(length);
+        continue;
+      }
+      format = data[first];
+      if((format != '>') && (format != '@')){
+        throw runtime_error("not a FASTA or FASTQ file: " + fileName);
+      }
+    }
+    // pieces start at record starts; the last one ends at the window end
+    vector<size_t> starts(1, recordStart(data, 0, length, format));
+    for(size_t pos = PIECE_BYTES; pos < length; pos += PIECE_BYTES){
+      size_t start = recordStart(data, max(pos, starts.back() + 1),
+                                 length, format);
+      if(start == length){
+        break;
+      }
+      starts.push_back(start);
+    }
+    size_t pieceCount = starts.size();
+    starts.push_back(length);
+    vector<PackedSeq> pieceBases(pieceCount);
+    vector<vector<size_t> > pieceLengths(pieceCount);
+    size_t parsedEnd = length;
+    executor.parallelFor(pieceCount, 1, [&](size_t start, size_t end){
+        for(size_t p = start; p < end; p++){
+          bool final = ((p + 1) == pieceCount);
+          size_t pieceEnd = parsePiece(data, starts[p], starts[p + 1],
+                                       last || !final, format,
+                                       pieceBases[p], pieceLengths[p]);
+          if(final){
+            parsedEnd = pieceEnd;
+          }
+        }
+      });
+    size_t recordCount = 0;
+    for(size_t p = 0; p < pieceCount; p++){
+      size_t offset = 0;
+      for(size_t i = 0; i < pieceLengths[p].size(); i++){
+        dest.push_back(pieceBases[p].substr(offset, pieceLengths[p][i]));
+        offset += pieceLengths[p][i];
+      }
+      recordCount += pieceLengths[p].size();
+    }
+    if((recordCount == 0) && !last){
+      // a record longer than the window
+      windowBytes *= 2;
+      continue;
+    }
+    consume(parsedEnd);
+    if(recordCount > 0){
+      return true;
+    }
+  }
+  return false;
+}
+
+vector<PackedSeq> ParallelFastxReader::readAll(QueryExecutor& executor){
+  vector<PackedSeq> retVal;
+  while(next(retVal, executor)){
+  }
+  return retVal;
+}
+
+// private static accessory methods
+
+// The first record start at or after pos, or length if there is none.
+// A FASTQ '@' line only counts as a record start if the line two
+// lines later (the '+' line) is in the window.
+size_t ParallelFastxReader::recordStart(const char* data, size_t pos,
+                                        size_t length, char format){
+  size_t nextLine = pos;
+  if((pos > 0) && (pos < length) && (data[pos - 1] != '\n')){
+    lineLength(data, pos, length, nextLine);
+  }
+  while(nextLine < length){
+    size_t line = nextLine;
+    lineLength(data, line, length, nextLine);
+    if(data[line] != format){
+      continue;
+    }
+    if(format == '>'){
+      return line;
+    }
+    size_t plusLine;
+    lineLength(data, nextLine, length, plusLine);
+    if((plusLine < length) && (data[plusLine] == '+')){
+      return line;
+    }
+  }
+  return length;
+}
+
+// Encodes the records starting in [start,end) into bases, and adds
+// their lengths to lengths. Unless the piece is complete, the last
+// record may be cut off by the end of the window, and is left out.
+// Returns the end of the last record parsed.
+size_t ParallelFastxReader::parsePiece(const char* data, size_t start,
+                                       size_t end, bool complete,
+                                       char format, PackedSeq& bases,
+                                       vector<size_t>& lengths){
+  // there are fewer bases than bytes, so one allocation is enough
+  uint8_t* dest = bases.extend(end - start);
+  size_t used = 0;
+  size_t pos = start;
+  while(pos < end){
+    if((data[pos] == '\n') || (data[pos] == '\r')){
+      pos++;
+      continue;
+    }
+    size_t recordBegin = pos;
+    size_t recordUsed = used;
+    size_t nextLine;
+    lineLength(data, pos, end, nextLine);
+    pos = nextLine;
+    bool cutOff;
+    if(format == '>'){
+      while((pos < end) && (data[pos] != '>')){
+        size_t lineLen = lineLength(data, pos, end, nextLine);
+        PackedSeq::encode(data + pos, NULL, lineLen, dest + used);
+        maskEndMarkers(dest + used, lineLen);
+        used += lineLen;
+        pos = nextLine;
+      }
+      cutOff = (pos == end);
+    } else {
+      size_t baseStart = pos;
+      size_t baseLen = lineLength(data, baseStart, end, nextLine);
+      size_t qualStart;
+      lineLength(data, nextLine, end, qualStart);
+      size_t qualLen = lineLength(data, qualStart, end, pos);
+      cutOff = (qualStart == end) || (data[pos - 1] != '\n');
+      if(!(cutOff && !complete)){
+        if(qualLen != baseLen){
+          throw runtime_error("FASTQ record has " + to_string(qualLen) +
+                              " qualities for " + to_string(baseLen) +
+                              " bases");
+        }
+        PackedSeq::encode(data + baseStart, data + qualStart, baseLen,
+                          dest + used);
+        maskEndMarkers(dest + used, baseLen);
+        used += baseLen;
+      }
+    }
+    if(cutOff && !complete){
+      used = recordUsed;
+      pos = recordBegin;
+      break;
+    }
+    lengths.push_back(used - recordUsed);
+  }
+  bases = bases.substr(0, used);
+  return pos;
+}
+
+// private accessory methods
+
+// Finds the next window of input; last is set if it reaches the end of
+// the input. Returns false if there is no input left.
+bool ParallelFastxReader::loadWindow(const char*& data, size_t& length,
+                                     bool& last){
+  if(!gzipFile){
+    data = mapping.get() + mappedPos;
+    length = min(windowBytes, mappedLength - mappedPos);
+    last = ((mappedPos + length) == mappedLength);
+    return (length > 0);
+  }
+#if PREBOWT_ZLIB
+  if(buffer.size() < windowBytes){
+    buffer.resize(windowBytes);
+  }
+  gzFile gzipIn = static_cast<gzFile>(gzipFile.get());
+  while((bufferLength < windowBytes) && !inputDone){
+    int readLength = gzread(gzipIn, buffer.data() + bufferLength,
+                            min(windowBytes - bufferLength,
+                                (size_t)INT_MAX));
+    if(readLength < 0){
+      throw runtime_error("cannot read gzip file: " + fileName);
+    }
+    inputDone = (readLength == 0);
+    bufferLength += readLength;
+  }
+#endif
+  data = buffer.data();
+  length = bufferLength;
+  last = inputDone;
+  return (length > 0);
+}
+
+// drops the first bytes of the current window
+void ParallelFastxReader::consume(size_t bytes){
+  if(!gzipFile){
+    mappedPos += bytes;
+    return;
+  }
+  copy(buffer.begin() + bytes, buffer.begin() + bufferLength,
+       buffer.begin());
+  bufferLength -= bytes;
+}
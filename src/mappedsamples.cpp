@@ -0,0 +1,151 @@
+/** <header>
+
+ * This file is part of preBowt -- a prefix-based BWT-like transform of
+ * genetic data.
+ *
+ * Copyright 2014 David Eccles (gringer) <bioinformatics@gringene.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * without any warranty; without even the implied warranty of
+ * merchantability or fitness for a particular purpose. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+</header> **/
+
+#include <stdexcept>
+#include <vector>
+
+#include "mappedsamples.hpp"
+
+static_assert(sizeof(MappedSampleHeader) == 64,
+              "sample section header should fill one record");
+
+// rows read from the sample trees at a time while writing
+static const uint64_t WRITE_ROWS = 1 << 16;
+
+// constructors
+
+MappedSamples::MappedSamples()
+  : sampleRate(0), rowCount(0), samples(0),
+    marks(NULL), blockRanks(NULL), values(NULL){
+}
+
+// Reads the section of a mapped index file at offset; throws
+// runtime_error if it runs past the end of the file
+MappedSamples::MappedSamples(const shared_ptr<const uint8_t>& mapping,
+                             uint64_t fileLength, uint64_t offset,
+                             const string& fileName)
+  : mapping(mapping), sampleRate(0), rowCount(0), samples(0),
+    marks(NULL), blockRanks(NULL), values(NULL){
+  if(offset + sizeof(MappedSampleHeader) > fileLength){
+    throw runtime_error("index file is truncated: " + fileName);
+  }
+  const MappedSampleHeader* header =
+    reinterpret_cast<const MappedSampleHeader*>(mapping.get() + offset);
+  uint64_t markWords = (header->rowCount + 63) / 64;
+  uint64_t blockCount = header->rowCount / BLOCK_ROWS + 1;
+  uint64_t sectionLength = sizeof(MappedSampleHeader) + sizeof(uint64_t) *
+    (markWords + blockCount + 2 * header->sampleCount);
+  if(offset + sectionLength > fileLength){
+    throw runtime_error("index file is truncated: " + fileName);
+  }
+  sampleRate = header->rate;
+  rowCount = header->rowCount;
+  samples = header->sampleCount;
+  marks = reinterpret_cast<const uint64_t*>(header + 1);
+  blockRanks = marks + markWords;
+  values = blockRanks + blockCount;
+}
+
+// static public methods
+
+// Writes the finished rows of src as a sample section, and returns
+// its length in bytes. Marks are read a block of codes at a time, and
+// samples a leaf at a time.
+uint64_t MappedSamples::write(ostream& out, const PositionSamples& src){
+  MappedSampleHeader header = {src.rate(), src.length(),
+                               src.sampleCount(), {0, 0, 0, 0, 0}};
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  vector<uint64_t> ranks;
+  uint64_t sampled = 0;
+  uint64_t word = 0;
+  uint64_t markWords = 0;
+  for(uint64_t start = 0; start < header.rowCount; start += WRITE_ROWS){
+    PackedSeq codes;
+    src.marks.appendTo(codes, start, WRITE_ROWS);
+    for(uint64_t i = 0; i < codes.length(); i++){
+      uint64_t row = start + i;
+      if((row % BLOCK_ROWS) == 0){
+        ranks.push_back(sampled);
+      }
+      if(PackedSeq::baseClass(codes[i]) == PackedSeq::A){
+        word |= (uint64_t)1 << (row % 64);
+        sampled++;
+      }
+      if((row % 64) == 63){
+        out.write(reinterpret_cast<const char*>(&word), sizeof(word));
+        markWords++;
+        word = 0;
+      }
+    }
+  }
+  if((header.rowCount % 64) != 0){
+    out.write(reinterpret_cast<const char*>(&word), sizeof(word));
+    markWords++;
+  }
+  if((header.rowCount % BLOCK_ROWS) == 0){
+    ranks.push_back(sampled);
+  }
+  out.write(reinterpret_cast<const char*>(ranks.data()),
+            ranks.size() * sizeof(uint64_t));
+  src.values.view().forEachLeaf(
+    [&](const SampleValues& leaf, size_t start, size_t len){
+      for(size_t i = start; i < (start + len); i++){
+        uint64_t value[2] = {leaf[i].seqId, leaf[i].offset};
+        out.write(reinterpret_cast<const char*>(value), sizeof(value));
+      }
+    });
+  return sizeof(header) + sizeof(uint64_t) *
+    (markWords + ranks.size() + 2 * header.sampleCount);
+}
+
+// public methods
+
+uint64_t MappedSamples::rate() const{
+  return sampleRate;
+}
+
+// number of rows covered by the samples
+uint64_t MappedSamples::length() const{
+  return rowCount;
+}
+
+uint64_t MappedSamples::sampleCount() const{
+  return samples;
+}
+
+// If a row is sampled, sets pos to its position and returns true
+bool MappedSamples::find(uint64_t row, SeqPos& pos) const{
+  uint64_t wordNum = row / 64;
+  uint64_t bit = (uint64_t)1 << (row % 64);
+  if((row >= rowCount) || !(marks[wordNum] & bit)){
+    return false;
+  }
+  uint64_t sample = blockRanks[row / BLOCK_ROWS];
+  for(uint64_t w = (row / BLOCK_ROWS) * (BLOCK_ROWS / 64); w < wordNum;
+      w++){
+    sample += __builtin_popcountll(marks[w]);
+  }
+  sample += __builtin_popcountll(marks[wordNum] & (bit - 1));
+  pos.seqId = values[2 * sample];
+  pos.offset = values[2 * sample + 1];
+  return true;
+}
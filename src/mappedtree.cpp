@@ -0,0 +1,317 @@
+/** <header>
+
+ * This file is part of preBowt -- a prefix-based BWT-like transform of
+ * genetic data.
+ *
+ * Copyright 2014 David Eccles (gringer) <bioinformatics@gringene.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * without any warranty; without even the implied warranty of
+ * merchantability or fitness for a particular purpose. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+</header> **/
+
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "mappedtree.hpp"
+#include "basecount.hpp"
+
+static_assert(sizeof(MappedHeader) == MappedTree::RECORD_ALIGN,
+              "index file header should fill one record");
+static_assert(sizeof(MappedNode) == 2 * MappedTree::RECORD_ALIGN,
+              "node record header should fill two cache lines");
+
+// root of an empty tree: a leaf with no bases
+static const MappedNode EMPTY_NODE = {0, 0, {0}};
+
+// constructors
+
+MappedTree::MappedTree()
+  : root(&EMPTY_NODE), fanout(0){
+}
+
+// Maps an index file written by MappedTree::write. Only the header is
+// read here; node pages are loaded by the OS as queries touch them.
+MappedTree::MappedTree(const string& fileName)
+  : root(&EMPTY_NODE), fanout(0){
+  int fd = open(fileName.c_str(), O_RDONLY);
+  if(fd < 0){
+    throw runtime_error("cannot open index file: " + fileName);
+  }
+  struct stat fileStat;
+  if((fstat(fd, &fileStat) != 0) ||
+     ((size_t)fileStat.st_size < sizeof(MappedHeader))){
+    close(fd);
+    throw runtime_error("index file is truncated: " + fileName);
+  }
+  size_t fileSize = fileStat.st_size;
+  void* addr = mmap(NULL, fileSize, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if(addr == MAP_FAILED){
+    throw runtime_error("cannot map index file: " + fileName);
+  }
+  mapping.reset(static_cast<const uint8_t*>(addr),
+                [fileSize](const uint8_t* p){
+                  munmap(const_cast<uint8_t*>(p), fileSize);
+                });
+  const MappedHeader* header =
+    reinterpret_cast<const MappedHeader*>(mapping.get());
+  if(memcmp(header->magic, "PREBOWT", 8) != 0){
+    throw runtime_error("not a prebowt index file: " + fileName);
+  }
+  if(header->byteOrder != MappedHeader::ORDER_MARK){
+    throw runtime_error("index file has foreign byte order: " + fileName);
+  }
+  if(header->version != MappedHeader::VERSION){
+    throw runtime_error("unsupported index file version: " + fileName);
+  }
+  if((header->fileLength != fileSize) ||
+     (header->rootOffset + sizeof(MappedNode) > fileSize) ||
+     (header->rootOffset % RECORD_ALIGN != 0) ||
+     (header->samplesOffset % RECORD_ALIGN != 0)){
+    throw runtime_error("index file is truncated: " + fileName);
+  }
+  fanout = header->fanout;
+  root = reinterpret_cast<const MappedNode*>(mapping.get() +
+                                             header->rootOffset);
+  if(header->samplesOffset != 0){
+    positions = MappedSamples(mapping, fileSize, header->samplesOffset,
+                              fileName);
+  }
+}
+
+// static public methods
+
+// Advances a rank query by one level (see DTree::rankStep). Child
+// records have a fixed layout, so the rows needed by the next step
+// can be prefetched before the child header has been read.
+bool MappedTree::rankStep(RankCursor& cursor){
+  const MappedNode* node = cursor.node;
+  if(node == NULL){
+    return true;
+  }
+  if(node->depth == 0){
+    if(!cursor.leafReady){
+      const uint8_t* bases = node->codes();
+      for(uint64_t i = 0; i < cursor.pos; i += 64){
+        __builtin_prefetch(bases + i);
+      }
+      cursor.leafReady = true;
+      return false;
+    }
+    cursor.rank += BaseCounter::count(node->codes(), cursor.pos,
+                                      cursor.base);
+    cursor.node = NULL;
+    return true;
+  }
+  const uint64_t* lengths = node->deltas(PackedSeq::ALL, cursor.fanout);
+  const uint64_t* counts = node->deltas(cursor.base, cursor.fanout);
+  size_t i = 0;
+  for(; cursor.pos >= lengths[i]; i++){
+    cursor.pos -= lengths[i];
+    cursor.rank += counts[i];
+  }
+  cursor.node = reinterpret_cast<const MappedNode*>
+    (cursor.file + node->children(cursor.fanout)[i]);
+  __builtin_prefetch(cursor.node);
+  __builtin_prefetch(cursor.node->deltas(PackedSeq::ALL, cursor.fanout));
+  __builtin_prefetch(cursor.node->deltas(cursor.base, cursor.fanout));
+  return false;
+}
+
+// public methods
+
+uint64_t MappedTree::length() const{
+  return root->totals[PackedSeq::ALL];
+}
+
+// number of internal levels above the leaves
+size_t MappedTree::height() const{
+  return root->depth;
+}
+
+// number of bases of a given class in the tree
+uint64_t MappedTree::count(Base base) const{
+  return root->totals[base];
+}
+
+// number of bases of a given class in [0,pos)
+uint64_t MappedTree::rank(Base base, uint64_t pos) const{
+  if(pos >= length()){
+    return root->totals[base];
+  }
+  uint64_t retVal = 0;
+  const MappedNode* node = root;
+  while(node->depth > 0){
+    const uint64_t* lengths = node->deltas(PackedSeq::ALL, fanout);
+    const uint64_t* counts = node->deltas(base, fanout);
+    size_t i = 0;
+    for(; pos >= lengths[i]; i++){
+      pos -= lengths[i];
+      retVal += counts[i];
+    }
+    node = child(node, i);
+  }
+  return retVal + BaseCounter::count(node->codes(), pos, base);
+}
+
+// fills counts[END..N] with the number of bases of each class in
+// [0,pos), and counts[ALL] with min(pos, length())
+void MappedTree::occ(uint64_t pos, uint64_t* counts) const{
+  if(pos >= length()){
+    copy(root->totals, root->totals + PackedSeq::ALL + 1, counts);
+    return;
+  }
+  fill(counts, counts + PackedSeq::ALL + 1, 0);
+  const MappedNode* node = root;
+  while(node->depth > 0){
+    const uint64_t* lengths = node->deltas(PackedSeq::ALL, fanout);
+    size_t i = 0;
+    for(; pos >= lengths[i]; i++){
+      pos -= lengths[i];
+      for(size_t b = 0; b <= PackedSeq::ALL; b++){
+        counts[b] += node->deltas(b, fanout)[i];
+      }
+    }
+    node = child(node, i);
+  }
+  BaseCounter::countAll(node->codes(), pos, counts);
+  counts[PackedSeq::ALL] += pos;
+}
+
+// position of the nth (0-based) base of a given class, or length() if
+// there are not that many
+uint64_t MappedTree::select(Base base, uint64_t nth) const{
+  if(nth >= root->totals[base]){
+    return length();
+  }
+  uint64_t retVal = 0;
+  const MappedNode* node = root;
+  while(node->depth > 0){
+    const uint64_t* lengths = node->deltas(PackedSeq::ALL, fanout);
+    const uint64_t* counts = node->deltas(base, fanout);
+    size_t i = 0;
+    for(; nth >= counts[i]; i++){
+      nth -= counts[i];
+      retVal += lengths[i];
+    }
+    node = child(node, i);
+  }
+  return retVal + BaseCounter::select(node->codes(),
+                                      node->totals[PackedSeq::ALL],
+                                      base, nth);
+}
+
+// encoded base at a given position
+uint8_t MappedTree::at(uint64_t pos) const{
+  const MappedNode* node = root;
+  while(node->depth > 0){
+    const uint64_t* lengths = node->deltas(PackedSeq::ALL, fanout);
+    size_t i = 0;
+    for(; pos >= lengths[i]; i++){
+      pos -= lengths[i];
+    }
+    node = child(node, i);
+  }
+  return node->codes()[pos];
+}
+
+// Sets code to the encoded base at pos, and returns the number of
+// bases of its class in [0,pos); see DTree::rankAt
+uint64_t MappedTree::rankAt(uint64_t pos, uint8_t& code) const{
+  uint64_t counts[PackedSeq::ALL + 1] = {0};
+  const MappedNode* node = root;
+  while(node->depth > 0){
+    const uint64_t* lengths = node->deltas(PackedSeq::ALL, fanout);
+    size_t i = 0;
+    for(; pos >= lengths[i]; i++){
+      pos -= lengths[i];
+      for(size_t b = 0; b < PackedSeq::ALL; b++){
+        counts[b] += node->deltas(b, fanout)[i];
+      }
+    }
+    node = child(node, i);
+  }
+  code = node->codes()[pos];
+  Base base = PackedSeq::baseClass(code);
+  return counts[base] + BaseCounter::count(node->codes(), pos, base);
+}
+
+// appends the bases in [start,start+len) to dest
+void MappedTree::appendTo(PackedSeq& dest, uint64_t start,
+                          uint64_t len) const{
+  appendTo(root, dest, start, len);
+}
+
+// Starts an incremental rank(base, pos) query; see rankStep()
+MappedTree::RankCursor MappedTree::rankCursor(Base base,
+                                              uint64_t pos) const{
+  RankCursor retVal = {root, pos, 0, base, false, mapping.get(), fanout};
+  if(pos >= length()){
+    retVal.node = NULL;
+    retVal.rank = root->totals[base];
+  } else {
+    __builtin_prefetch(root->deltas(PackedSeq::ALL, fanout));
+    __builtin_prefetch(root->deltas(base, fanout));
+  }
+  return retVal;
+}
+
+// the position samples stored in the file (rate 0 if there are none)
+const MappedSamples& MappedTree::samples() const{
+  return positions;
+}
+
+// private static accessory methods
+
+// pads the file to the start of the next record
+void MappedTree::writePadding(ostream& out, uint64_t& fileLength){
+  static const char PADDING[RECORD_ALIGN] = {0};
+  size_t padLength = (RECORD_ALIGN - (fileLength % RECORD_ALIGN))
+    % RECORD_ALIGN;
+  out.write(PADDING, padLength);
+  fileLength += padLength;
+}
+
+// private accessory methods
+
+const MappedNode* MappedTree::child(const MappedNode* node, size_t i) const{
+  return reinterpret_cast<const MappedNode*>
+    (mapping.get() + node->children(fanout)[i]);
+}
+
+void MappedTree::appendTo(const MappedNode* node, PackedSeq& dest,
+                          uint64_t start, uint64_t len) const{
+  if(node->depth == 0){
+    uint64_t leafLength = node->totals[PackedSeq::ALL];
+    if(start < leafLength){
+      dest.append(node->codes() + start, min(len, leafLength - start));
+    }
+    return;
+  }
+  const uint64_t* lengths = node->deltas(PackedSeq::ALL, fanout);
+  for(size_t i = 0; (i < node->count) && (len > 0); i++){
+    if(start >= lengths[i]){
+      start -= lengths[i];
+      continue;
+    }
+    uint64_t childLen = min(len, lengths[i] - start);
+    appendTo(child(node, i), dest, start, childLen);
+    len -= childLen;
+    start = 0;
+  }
+}
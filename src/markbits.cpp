@@ -0,0 +1,180 @@
+/** <header>
+
+ * This file is part of preBowt -- a prefix-based BWT-like transform of
+ * genetic data.
+ *
+ * Copyright 2014 David Eccles (gringer) <bioinformatics@gringene.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * without any warranty; without even the implied warranty of
+ * merchantability or fitness for a particular purpose. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+</header> **/
+
+#include <algorithm>
+#include <cstring>
+
+#include "markbits.hpp"
+
+// the low n bits of a word (n <= 64)
+static uint64_t lowMask(size_t n){
+  return (n >= 64) ? ~(uint64_t)0 : (((uint64_t)1 << n) - 1);
+}
+
+ostream& operator<<(ostream& out, const MarkBits& src){
+  for(size_t i = 0; i < src.length(); i++){
+    out << PackedSeq::decodeBase(src[i]);
+  }
+  return out;
+}
+
+// constructors
+
+MarkBits::MarkBits()
+  : len(0){
+  memset(words, 0, sizeof(words));
+}
+
+MarkBits::MarkBits(const PackedSeq& src)
+  : len(0){
+  memset(words, 0, sizeof(words));
+  append(src);
+}
+
+// public methods
+
+// mirrors string::substr: over-length arguments are truncated
+MarkBits MarkBits::substr(size_t start, size_t len) const{
+  MarkBits retVal;
+  if(start < length()){
+    retVal.appendBits(words, start, min(len, length() - start));
+  }
+  return retVal;
+}
+
+void MarkBits::append(const MarkBits& src){
+  appendBits(src.words, 0, src.length());
+}
+
+void MarkBits::append(const PackedSeq& src){
+  const uint8_t* codes = src.data();
+  for(size_t i = 0; i < src.length(); i++, len++){
+    if(PackedSeq::baseClass(codes[i]) == PackedSeq::A){
+      words[len / 64] |= (uint64_t)1 << (len % 64);
+    }
+  }
+}
+
+// shifts the bits from pos on up by one; the sequence must hold fewer
+// than CAPACITY rows
+void MarkBits::insert(size_t pos, uint8_t code){
+  size_t first = pos / 64;
+  for(size_t w = len / 64; w > first; w--){
+    words[w] = (words[w] << 1) | (words[w - 1] >> 63);
+  }
+  uint64_t below = words[first] & lowMask(pos % 64);
+  uint64_t bit = (PackedSeq::baseClass(code) == PackedSeq::A);
+  words[first] = below | ((words[first] & ~below) << 1)
+    | (bit << (pos % 64));
+  len++;
+}
+
+size_t MarkBits::length() const{
+  return len;
+}
+
+uint8_t MarkBits::operator[](size_t pos) const{
+  return ((words[pos / 64] >> (pos % 64)) & 1) ? SET_CODE : CLEAR_CODE;
+}
+
+// number of rows of a given class in [0,pos)
+uint64_t MarkBits::rank(Base base, size_t pos) const{
+  if(base == PackedSeq::A){
+    return onesBefore(pos);
+  }
+  return (base == PackedSeq::C) ? (pos - onesBefore(pos)) : 0;
+}
+
+// add the number of rows of each class in [0,pos) to counts[END..N],
+// and the total to counts[ALL]
+void MarkBits::occ(size_t pos, uint64_t* counts) const{
+  uint64_t ones = onesBefore(pos);
+  counts[PackedSeq::A] += ones;
+  counts[PackedSeq::C] += pos - ones;
+  counts[PackedSeq::ALL] += pos;
+}
+
+// position of the nth (0-based) row of a given class, or length() if
+// there are not that many
+size_t MarkBits::select(Base base, uint64_t nth) const{
+  if((base != PackedSeq::A) && (base != PackedSeq::C)){
+    return len;
+  }
+  for(size_t w = 0; (w * 64) < len; w++){
+    uint64_t bits = (base == PackedSeq::A) ? words[w] : ~words[w];
+    bits &= lowMask(len - w * 64);
+    uint64_t found = __builtin_popcountll(bits);
+    if(nth < found){
+      for(; nth > 0; nth--){
+        bits &= bits - 1;
+      }
+      return w * 64 + __builtin_ctzll(bits);
+    }
+    nth -= found;
+  }
+  return len;
+}
+
+// prefetches the words needed to rank up to pos
+void MarkBits::prefetch(size_t pos) const{
+  for(size_t i = 0; i < pos; i += 512){
+    __builtin_prefetch(words + i / 64);
+  }
+}
+
+// appends the rows in [start,start+len) to dest, as A and C codes
+void MarkBits::appendTo(PackedSeq& dest, size_t start, size_t len) const{
+  if(start >= length()){
+    return;
+  }
+  len = min(len, length() - start);
+  uint8_t* codes = dest.extend(len);
+  for(size_t i = 0; i < len; i++){
+    codes[i] = (*this)[start + i];
+  }
+}
+
+// private accessory methods
+
+uint64_t MarkBits::onesBefore(size_t pos) const{
+  uint64_t retVal = 0;
+  for(size_t w = 0; w < (pos / 64); w++){
+    retVal += __builtin_popcountll(words[w]);
+  }
+  if((pos % 64) != 0){
+    retVal += __builtin_popcountll(words[pos / 64] & lowMask(pos % 64));
+  }
+  return retVal;
+}
+
+// adds bits [start,start+count) of src to the end, a word at a time
+void MarkBits::appendBits(const uint64_t* src, size_t start,
+                          size_t count){
+  for(size_t i = 0; i < count;){
+    size_t srcBit = start + i;
+    size_t n = min(count - i, min(64 - (srcBit % 64), 64 - (len % 64)));
+    uint64_t bits = (src[srcBit / 64] >> (srcBit % 64)) & lowMask(n);
+    words[len / 64] |= bits << (len % 64);
+    len += n;
+    i += n;
+  }
+}
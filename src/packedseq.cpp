@@ -0,0 +1,313 @@
+/** <header>
+
+ * This file is part of preBowt -- a prefix-based BWT-like transform of
+ * genetic data.
+ *
+ * Copyright 2014 David Eccles (gringer) <bioinformatics@gringene.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * without any warranty; without even the implied warranty of
+ * merchantability or fitness for a particular purpose. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+</header> **/
+
+#include <algorithm>
+
+#include "packedseq.hpp"
+#include "basecount.hpp"
+
+// IUPAC symbol for each 4-bit base pattern (bit 0 = A ... bit 3 = T)
+static const char NIBBLE_BASES[] = "$ACMGRSVTWYHKDBN";
+
+// base class for each 4-bit base pattern
+const PackedSeq::Base PackedSeq::NIBBLE_CLASS[16] = {
+  END, A, C, AMBIG, G, AMBIG, AMBIG, AMBIG,
+  T, AMBIG, AMBIG, AMBIG, AMBIG, AMBIG, AMBIG, N
+};
+
+// base nibble for an IUPAC symbol; anything unrecognised becomes N
+static uint8_t baseNibble(char base){
+  switch(base){
+  case '$': case '-': return 0x0;
+  case 'A': case 'a': return 0x1;
+  case 'C': case 'c': return 0x2;
+  case 'M': case 'm': return 0x3;
+  case 'G': case 'g': return 0x4;
+  case 'R': case 'r': return 0x5;
+  case 'S': case 's': return 0x6;
+  case 'V': case 'v': return 0x7;
+  case 'T': case 't': case 'U': case 'u': return 0x8;
+  case 'W': case 'w': return 0x9;
+  case 'Y': case 'y': return 0xA;
+  case 'H': case 'h': return 0xB;
+  case 'K': case 'k': return 0xC;
+  case 'D': case 'd': return 0xD;
+  case 'B': case 'b': return 0xE;
+  default: return 0xF;
+  }
+}
+
+// baseNibble() for every character, shifted into the high nibble
+static vector<uint8_t> makeBaseCodes(){
+  vector<uint8_t> retVal(256);
+  for(size_t i = 0; i < retVal.size(); i++){
+    retVal[i] = baseNibble((char)i) << 4;
+  }
+  return retVal;
+}
+
+ostream& operator<<(ostream& out, const PackedSeq& src){
+  out << src.bases();
+  return out;
+}
+
+// static public methods
+
+// Encode a base and its (Phred+33) quality character. Quality is
+// divided by 4 with integer rounding, capped at Q=60 (i.e. 15*4)
+uint8_t PackedSeq::encode(char base, char qual){
+  int q = (qual < PHRED_OFFSET) ? 0 : (qual - PHRED_OFFSET) / 4;
+  return (baseNibble(base) << 4) | min(q, (int)QUAL_MAX);
+}
+
+// Encodes len bases (and qualities, or unknown quality if quals is
+// NULL) into dest, as encode(base, qual) does one at a time
+void PackedSeq::encode(const char* bases, const char* quals, size_t len,
+                       uint8_t* dest){
+  static const vector<uint8_t> BASE_CODES = makeBaseCodes();
+  if(quals == NULL){
+    for(size_t i = 0; i < len; i++){
+      dest[i] = BASE_CODES[(uint8_t)bases[i]];
+    }
+    return;
+  }
+  for(size_t i = 0; i < len; i++){
+    int q = (quals[i] < PHRED_OFFSET) ? 0 : (quals[i] - PHRED_OFFSET) / 4;
+    dest[i] = BASE_CODES[(uint8_t)bases[i]] | min(q, (int)QUAL_MAX);
+  }
+}
+
+char PackedSeq::decodeBase(uint8_t code){
+  return NIBBLE_BASES[code >> 4];
+}
+
+char PackedSeq::decodeQual(uint8_t code){
+  return (char)(PHRED_OFFSET + (code & 0x0F) * 4);
+}
+
+// constructors
+
+PackedSeq::PackedSeq()
+  : start(0), len(0){
+}
+
+PackedSeq::PackedSeq(const string& bases)
+  : start(0), len(0){
+  uint8_t* dest = writableEnd(bases.length());
+  for(size_t i = 0; i < bases.length(); i++){
+    dest[i] = encode(bases[i]);
+  }
+}
+
+PackedSeq::PackedSeq(const string& bases, const string& quals)
+  : start(0), len(0){
+  uint8_t* dest = writableEnd(bases.length());
+  for(size_t i = 0; i < bases.length(); i++){
+    dest[i] = encode(bases[i],
+                     (i < quals.length()) ? quals[i] : PHRED_OFFSET);
+  }
+}
+
+PackedSeq::PackedSeq(const PackedSeq& src)
+  : buffer(src.buffer), start(src.start), len(src.len){
+}
+
+PackedSeq::PackedSeq(PackedSeq&& src)
+  : buffer(move(src.buffer)), start(src.start), len(src.len){
+  src.start = 0;
+  src.len = 0;
+}
+
+// operators
+
+PackedSeq& PackedSeq::operator=(const PackedSeq& src){
+  buffer = src.buffer;
+  start = src.start;
+  len = src.len;
+  return *this;
+}
+
+PackedSeq& PackedSeq::operator=(PackedSeq&& src){
+  if(this != &src){
+    buffer = move(src.buffer);
+    start = src.start;
+    len = src.len;
+    src.start = 0;
+    src.len = 0;
+  }
+  return *this;
+}
+
+// public methods
+
+// mirrors string::substr: over-length arguments are truncated. The
+// result is a view of the same buffer.
+PackedSeq PackedSeq::substr(size_t start, size_t len) const{
+  PackedSeq retVal;
+  if(start < this->len){
+    retVal.buffer = buffer;
+    retVal.start = this->start + start;
+    retVal.len = min(len, this->len - start);
+  }
+  return retVal;
+}
+
+void PackedSeq::append(const PackedSeq& src){
+  append(src, 0, src.len);
+}
+
+// Append src[start,start+len), truncated to the end of src. Appending
+// to an empty sequence, or appending the part of a buffer that
+// directly follows this view, shares the buffer instead of copying.
+void PackedSeq::append(const PackedSeq& src, size_t start, size_t len){
+  if(start >= src.len){
+    return;
+  }
+  len = min(len, src.len - start);
+  if(this->len == 0){
+    *this = src.substr(start, len);
+  } else if((buffer == src.buffer) &&
+            ((this->start + this->len) == (src.start + start))){
+    this->len += len;
+  } else {
+    append(src.data() + start, len);
+  }
+}
+
+void PackedSeq::append(const uint8_t* src, size_t len){
+  if(len > 0){
+    copy(src, src + len, writableEnd(len));
+  }
+}
+
+void PackedSeq::push_back(uint8_t code){
+  *writableEnd(1) = code;
+}
+
+// Adds len bases to the end, and returns a pointer for writing them
+// (see writableEnd)
+uint8_t* PackedSeq::extend(size_t len){
+  return writableEnd(len);
+}
+
+// inserts in place if the buffer is not shared; otherwise the bases
+// are copied once, into a new buffer with room for the insertion
+void PackedSeq::insert(size_t pos, uint8_t code){
+  if(buffer && (buffer.use_count() == 1)){
+    buffer->insert(buffer->begin() + start + pos, code);
+    len++;
+    return;
+  }
+  shared_ptr<vector<uint8_t> > newBuffer = make_shared<vector<uint8_t> >();
+  newBuffer->reserve(len + 1);
+  const uint8_t* codes = data();
+  newBuffer->insert(newBuffer->end(), codes, codes + pos);
+  newBuffer->push_back(code);
+  newBuffer->insert(newBuffer->end(), codes + pos, codes + len);
+  buffer = newBuffer;
+  start = 0;
+  len++;
+}
+
+size_t PackedSeq::length() const{
+  return len;
+}
+
+uint8_t PackedSeq::operator[](size_t pos) const{
+  return (*buffer)[start + pos];
+}
+
+const uint8_t* PackedSeq::data() const{
+  return buffer ? (buffer->data() + start) : NULL;
+}
+
+// number of bases of a given class in [0,pos)
+uint64_t PackedSeq::rank(Base base, size_t pos) const{
+  return BaseCounter::count(data(), pos, base);
+}
+
+// add the number of bases of each class in [0,pos) to counts[END..N],
+// and the total to counts[ALL]
+void PackedSeq::occ(size_t pos, uint64_t* counts) const{
+  BaseCounter::countAll(data(), pos, counts);
+  counts[ALL] += pos;
+}
+
+// position of the nth (0-based) base of a given class, or length()
+// if there are not that many
+size_t PackedSeq::select(Base base, uint64_t nth) const{
+  return BaseCounter::select(data(), len, base, nth);
+}
+
+// prefetches the bases needed to rank up to pos
+void PackedSeq::prefetch(size_t pos) const{
+  const uint8_t* codes = data();
+  for(size_t i = 0; i < pos; i += 64){
+    __builtin_prefetch(codes + i);
+  }
+}
+
+// the leaf interface shared with CompactSeq; see append()
+void PackedSeq::appendTo(PackedSeq& dest, size_t start, size_t len) const{
+  dest.append(*this, start, len);
+}
+
+string PackedSeq::bases() const{
+  string retVal(len, ' ');
+  const uint8_t* codes = data();
+  for(size_t i = 0; i < len; i++){
+    retVal[i] = decodeBase(codes[i]);
+  }
+  return retVal;
+}
+
+string PackedSeq::quals() const{
+  string retVal(len, ' ');
+  const uint8_t* codes = data();
+  for(size_t i = 0; i < len; i++){
+    retVal[i] = decodeQual(codes[i]);
+  }
+  return retVal;
+}
+
+// private accessory methods
+
+// Makes room for extra bases at the end of this view, and returns a
+// pointer to them. The buffer is grown in place if no other sequence
+// shares it and nothing follows this view; otherwise this view is
+// copied to a new buffer.
+uint8_t* PackedSeq::writableEnd(size_t extra){
+  if(!(buffer && (buffer.use_count() == 1) &&
+       ((start + len) == buffer->size()))){
+    shared_ptr<vector<uint8_t> > newBuffer =
+      make_shared<vector<uint8_t> >();
+    newBuffer->reserve(len + extra);
+    if(len > 0){
+      newBuffer->assign(data(), data() + len);
+    }
+    buffer = newBuffer;
+    start = 0;
+  }
+  buffer->resize(start + len + extra);
+  len += extra;
+  return buffer->data() + start + len - extra;
+}
@@ -0,0 +1,149 @@
+/** <header>
+
+ * This file is part of preBowt -- a prefix-based BWT-like transform of
+ * genetic data.
+ *
+ * Copyright 2014 David Eccles (gringer) <bioinformatics@gringene.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * without any warranty; without even the implied warranty of
+ * merchantability or fitness for a particular purpose. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+</header> **/
+
+#include "positionsamples.hpp"
+
+// mark codes: A (set) for sampled rows, C (clear) for the rest
+static const uint8_t SAMPLED_MARK = MarkBits::SET_CODE;
+static const uint8_t UNSAMPLED_MARK = MarkBits::CLEAR_CODE;
+
+// constructors
+
+PositionSamples::PositionSamples(uint64_t rate)
+  : sampleRate(rate){
+}
+
+// public methods
+
+uint64_t PositionSamples::rate() const{
+  return sampleRate;
+}
+
+// number of rows covered by the samples
+uint64_t PositionSamples::length() const{
+  return marks.length();
+}
+
+uint64_t PositionSamples::sampleCount() const{
+  return values.length();
+}
+
+// whether the row at a given position, which holds an end marker if
+// isEnd is set, should be sampled
+bool PositionSamples::isSampled(const SeqPos& pos, bool isEnd) const{
+  return (sampleRate > 0) && (isEnd || ((pos.offset % sampleRate) == 0));
+}
+
+// If a row is sampled, sets pos to its position and returns true
+bool PositionSamples::find(uint64_t row, SeqPos& pos) const{
+  if((row >= marks.length()) ||
+     (PackedSeq::baseClass(marks.at(row)) != PackedSeq::A)){
+    return false;
+  }
+  uint64_t sample = marks.rank(PackedSeq::A, row);
+  values.view(sample, 1).forEachLeaf(
+    [&](const SampleValues& leaf, size_t start, size_t){
+      pos = leaf[start];
+    });
+  return true;
+}
+
+// records a row inserted into the transform before row
+void PositionSamples::insert(uint64_t row, const SeqPos& pos, bool isEnd){
+  if(sampleRate == 0){
+    return;
+  }
+  bool sampled = isSampled(pos, isEnd);
+  marks = marks.insertBase(row, sampled ? SAMPLED_MARK : UNSAMPLED_MARK);
+  if(sampled){
+    SampleValues sample;
+    sample.push_back(pos);
+    values = values.insert(marks.rank(PackedSeq::A, row),
+                           ValueTree::fromLeaf(sample));
+  }
+}
+
+// Adds a row to the end. Appended rows are bulk-loaded into new trees,
+// and are not seen by queries until finish() is called.
+void PositionSamples::append(const SeqPos& pos, bool isEnd){
+  if(sampleRate == 0){
+    return;
+  }
+  bool sampled = isSampled(pos, isEnd);
+  markLoader.push_back(sampled ? SAMPLED_MARK : UNSAMPLED_MARK);
+  if(sampled){
+    appendSample(pos);
+  }
+}
+
+// Adds rows [start,start+len) of src to the end, with seqShift added
+// to their sequence IDs (see append(pos, isEnd)). Both sets of samples
+// should use the same rate.
+void PositionSamples::append(const PositionSamples& src, uint64_t start,
+                             uint64_t len, uint64_t seqShift){
+  if(sampleRate == 0){
+    return;
+  }
+  uint64_t firstSample = src.marks.rank(PackedSeq::A, start);
+  uint64_t sampleEnd = src.marks.rank(PackedSeq::A, start + len);
+  markLoader.append(src.marks, start, len);
+  if((seqShift == 0) && (sampleEnd > firstSample)){
+    // the samples are shared with src
+    addValueLeaf();
+    newValues = newValues.append(
+      src.values.substr(firstSample, sampleEnd - firstSample));
+    return;
+  }
+  src.values.view(firstSample, sampleEnd - firstSample).forEachLeaf(
+    [&](const SampleValues& leaf, size_t leafStart, size_t leafLen){
+      for(size_t i = leafStart; i < (leafStart + leafLen); i++){
+        SeqPos pos = leaf[i];
+        pos.seqId += seqShift;
+        appendSample(pos);
+      }
+    });
+}
+
+// adds any rows still waiting to be added by append()
+void PositionSamples::finish(){
+  marks = marks.append(markLoader.finish());
+  addValueLeaf();
+  values = values.append(newValues);
+  newValues = ValueTree();
+}
+
+// private accessory methods
+
+void PositionSamples::appendSample(const SeqPos& pos){
+  valueLeaf.push_back(pos);
+  if(valueLeaf.length() >= SampleValues::LEAF_SAMPLES){
+    addValueLeaf();
+  }
+}
+
+// moves the samples in valueLeaf to the end of newValues
+void PositionSamples::addValueLeaf(){
+  if(valueLeaf.length() > 0){
+    newValues = newValues.append(ValueTree::fromLeaf(valueLeaf));
+    valueLeaf = SampleValues();
+  }
+}
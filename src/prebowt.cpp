@@ -0,0 +1,650 @@
+/** <header>
+
+ * This file is part of preBowt -- a prefix-based BWT-like transform of
+ * genetic data.
+ *
+ * Copyright 2014 David Eccles (gringer) <bioinformatics@gringene.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * without any warranty; without even the implied warranty of
+ * merchantability or fitness for a particular purpose. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+</header> **/
+
+#include <algorithm>
+#include <thread>
+#include <stdexcept>
+
+#include "prebowt.hpp"
+#include "basecount.hpp"
+
+// Sorts the prefixes of a set of sequences by their reversed sequence
+// (comparing base classes, with shorter prefixes first), then by order
+// of insertion, with prefix doubling as in Larsson and Sadakane's
+// suffix sorter. Prefix j of sequence i is numbered seqStarts[i] + j,
+// so the prefix that is h bases shorter is h numbers back. Rows start
+// out in groups by their last few bases; each round sorts the rows of every
+// group by the group of their prefixes that are h bases shorter, which
+// orders them by their last 2h bases, until every group holds one row.
+// This takes at most log2(longest repeat) rounds, each a few linear
+// passes split into chunks across threads, so that a single long
+// sequence is sorted in parallel too. Index is the type of the row and
+// prefix numbers, so that up to 2^32 rows take 9 bytes each.
+template<class Index>
+class PrefixSorter{
+public:
+  // constructors
+  PrefixSorter(const PackedSeq* seqs, size_t count,
+               QueryExecutor& executor);
+  // public methods
+  void sort();
+  void finish(PackedSeq& symbols, PositionSamples& samples);
+private:
+  // constants
+  static const uint8_t GROUP_START = 1; // first row of a group
+  static const uint8_t GROUP_SPLIT = 2; // first row of a new group
+  static const uint64_t NO_ROW = UINT64_MAX;
+  static const size_t BUCKET_BASES = 5; // bases sorted by bucketRows
+  static const size_t CLASS_BITS = 3;
+  static const size_t CLASS_MASK = (1 << CLASS_BITS) - 1;
+  static const size_t BUCKET_COUNT = 1 << (CLASS_BITS * BUCKET_BASES);
+  // fields
+  const PackedSeq* seqs;
+  size_t count;
+  QueryExecutor& executor;
+  size_t chunkCount;
+  uint64_t rowCount;
+  uint64_t shift; // bases covered by the current groups
+  vector<uint64_t> seqStarts; // number of the empty prefix of each seq
+  vector<Index> rows; // prefix numbers, in sorted order
+  vector<Index> groups; // first row of the group of each prefix
+  vector<uint8_t> flags; // GROUP_START and GROUP_SPLIT, by row
+  // accessory methods
+  uint64_t chunkStart(size_t chunk) const;
+  size_t seqOf(uint64_t prefix) const;
+  void bucketRows();
+  template<class Visit>
+  void forEachBucket(size_t chunk, Visit visit) const;
+  static size_t nextBucket(size_t bucket, uint8_t code);
+  bool sortGroups();
+  void sortGroup(uint64_t start, uint64_t end);
+  void sortLargeGroup(uint64_t start, uint64_t end);
+  void markSplits(uint64_t start, uint64_t end, uint64_t groupStart);
+  void relabel();
+};
+
+template<class Index>
+const uint8_t PrefixSorter<Index>::GROUP_START;
+template<class Index>
+const uint8_t PrefixSorter<Index>::GROUP_SPLIT;
+template<class Index>
+const uint64_t PrefixSorter<Index>::NO_ROW;
+template<class Index>
+const size_t PrefixSorter<Index>::BUCKET_BASES;
+template<class Index>
+const size_t PrefixSorter<Index>::CLASS_BITS;
+template<class Index>
+const size_t PrefixSorter<Index>::CLASS_MASK;
+template<class Index>
+const size_t PrefixSorter<Index>::BUCKET_COUNT;
+
+// constructors
+
+template<class Index>
+PrefixSorter<Index>::PrefixSorter(const PackedSeq* seqs, size_t count,
+                                  QueryExecutor& executor)
+  : seqs(seqs), count(count), executor(executor),
+    chunkCount(executor.threadCount()), shift(BUCKET_BASES),
+    seqStarts(count + 1, 0){
+  for(size_t i = 0; i < count; i++){
+    seqStarts[i+1] = seqStarts[i] + seqs[i].length() + 1;
+  }
+  rowCount = seqStarts[count];
+}
+
+// public methods
+
+template<class Index>
+void PrefixSorter<Index>::sort(){
+  bucketRows();
+  while(sortGroups()){
+    relabel();
+    shift *= 2;
+  }
+  flags = vector<uint8_t>();
+}
+
+// Writes the symbol of each sorted row (the base after its prefix, or
+// an end marker) to symbols, and appends its position to samples.
+// The groups are no longer needed, so hold the sequence of each row.
+template<class Index>
+void PrefixSorter<Index>::finish(PackedSeq& symbols,
+                                 PositionSamples& samples){
+  uint8_t* codes = symbols.extend(rowCount);
+  uint8_t endCode = PackedSeq::encode('$');
+  executor.parallelFor(chunkCount, 1, [&](size_t from, size_t to){
+      for(uint64_t row = chunkStart(from); row < chunkStart(to); row++){
+        size_t seqId = seqOf(rows[row]);
+        uint64_t length = rows[row] - seqStarts[seqId];
+        codes[row] = (rows[row] + 1 == seqStarts[seqId + 1]) ?
+          endCode : seqs[seqId].data()[length];
+        groups[row] = seqId;
+      }
+    });
+  for(uint64_t row = 0; row < rowCount; row++){
+    SeqPos pos = {groups[row], rows[row] - seqStarts[groups[row]]};
+    samples.append(pos, rows[row] + 1 == seqStarts[groups[row] + 1]);
+  }
+}
+
+// private accessory methods
+
+template<class Index>
+uint64_t PrefixSorter<Index>::chunkStart(size_t chunk) const{
+  return rowCount * chunk / chunkCount;
+}
+
+template<class Index>
+size_t PrefixSorter<Index>::seqOf(uint64_t prefix) const{
+  return upper_bound(seqStarts.begin(), seqStarts.end(), prefix)
+    - seqStarts.begin() - 1;
+}
+
+// Places the rows by their last BUCKET_BASES base classes (see
+// bucketOf), with a counting sort. Prefixes shorter than that are each
+// a group of their own; rows in the same bucket keep the order of
+// their prefix numbers, which for these is their order of insertion.
+template<class Index>
+void PrefixSorter<Index>::bucketRows(){
+  rows.resize(rowCount);
+  groups.resize(rowCount);
+  flags.assign(rowCount, 0);
+  vector<uint64_t> next(chunkCount * BUCKET_COUNT, 0);
+  executor.parallelFor(chunkCount, 1, [&](size_t from, size_t to){
+      for(size_t chunk = from; chunk < to; chunk++){
+        uint64_t* chunkRows = next.data() + chunk * BUCKET_COUNT;
+        forEachBucket(chunk, [chunkRows](uint64_t, size_t bucket){
+            chunkRows[bucket]++;
+          });
+      }
+    });
+  vector<uint64_t> bucketStarts(BUCKET_COUNT);
+  uint64_t row = 0;
+  for(size_t bucket = 0; bucket < BUCKET_COUNT; bucket++){
+    bucketStarts[bucket] = row;
+    for(size_t chunk = 0; chunk < chunkCount; chunk++){
+      uint64_t chunkRows = next[chunk * BUCKET_COUNT + bucket];
+      next[chunk * BUCKET_COUNT + bucket] = row;
+      row += chunkRows;
+    }
+    if(bucketStarts[bucket] < row){
+      flags[bucketStarts[bucket]] = GROUP_START;
+    }
+  }
+  executor.parallelFor(chunkCount, 1, [&](size_t from, size_t to){
+      for(size_t chunk = from; chunk < to; chunk++){
+        uint64_t* chunkRows = next.data() + chunk * BUCKET_COUNT;
+        forEachBucket(chunk, [&](uint64_t prefix, size_t bucket){
+            uint64_t row = chunkRows[bucket]++;
+            rows[row] = prefix;
+            if((bucket & CLASS_MASK) == 0){ // shorter than BUCKET_BASES
+              groups[prefix] = row;
+              flags[row] = GROUP_START;
+            } else {
+              groups[prefix] = bucketStarts[bucket];
+            }
+          });
+      }
+    });
+}
+
+// Calls visit(prefix, bucket) for each prefix numbered within a chunk.
+// The bucket of a prefix holds the classes of its last BUCKET_BASES
+// bases, latest first, as CLASS_BITS digits (class + 1, or 0 past the
+// start of the sequence), so buckets sort in the order of the
+// prefixes.
+template<class Index>
+template<class Visit>
+void PrefixSorter<Index>::forEachBucket(size_t chunk, Visit visit) const{
+  uint64_t prefix = chunkStart(chunk);
+  uint64_t end = chunkStart(chunk + 1);
+  for(size_t seqId = seqOf(prefix); prefix < end; seqId++){
+    const uint8_t* codes = seqs[seqId].data();
+    uint64_t seqLength = seqStarts[seqId + 1] - seqStarts[seqId] - 1;
+    uint64_t length = prefix - seqStarts[seqId];
+    size_t bucket = 0;
+    for(uint64_t i = length - min(length, (uint64_t)BUCKET_BASES);
+        i < length; i++){
+      bucket = nextBucket(bucket, codes[i]);
+    }
+    for(; (length <= seqLength) && (prefix < end); length++, prefix++){
+      visit(prefix, bucket);
+      if(length < seqLength){
+        bucket = nextBucket(bucket, codes[length]);
+      }
+    }
+  }
+}
+
+// the bucket of a prefix extended by one base
+template<class Index>
+size_t PrefixSorter<Index>::nextBucket(size_t bucket, uint8_t code){
+  return (bucket >> CLASS_BITS) |
+    ((PackedSeq::baseClass(code) + 1) << (CLASS_BITS * (BUCKET_BASES - 1)));
+}
+
+// Sorts the rows of each group with more than one row, and marks where
+// they split into new groups; returns false if there were none. Each
+// chunk takes the groups that start within it, except for groups
+// larger than a chunk, which are sorted afterwards by all threads.
+template<class Index>
+bool PrefixSorter<Index>::sortGroups(){
+  vector<uint64_t> chunkGroups(chunkCount + 1, rowCount);
+  executor.parallelFor(chunkCount, 1, [&](size_t from, size_t to){
+      for(size_t chunk = from; chunk < to; chunk++){
+        uint64_t row = chunkStart(chunk);
+        while((row < chunkStart(chunk + 1)) && !flags[row]){
+          row++;
+        }
+        chunkGroups[chunk] = (row < chunkStart(chunk + 1)) ? row : NO_ROW;
+      }
+    });
+  for(size_t chunk = chunkCount; chunk-- > 0;){
+    if(chunkGroups[chunk] == NO_ROW){
+      chunkGroups[chunk] = chunkGroups[chunk + 1];
+    }
+  }
+  vector<uint8_t> unsorted(chunkCount, 0);
+  vector<vector<uint64_t> > largeGroups(chunkCount);
+  executor.parallelFor(chunkCount, 1, [&](size_t from, size_t to){
+      for(size_t chunk = from; chunk < to; chunk++){
+        uint64_t groupEnd = chunkGroups[chunk + 1];
+        for(uint64_t start = chunkGroups[chunk]; start < groupEnd;){
+          uint64_t end = start + 1;
+          while((end < groupEnd) && !flags[end]){
+            end++;
+          }
+          if((end - start) > 1){
+            unsorted[chunk] = 1;
+            if((end - start) * chunkCount > rowCount){
+              largeGroups[chunk].push_back(start);
+              largeGroups[chunk].push_back(end);
+            } else {
+              sortGroup(start, end);
+            }
+          }
+          start = end;
+        }
+      }
+    });
+  for(size_t chunk = 0; chunk < chunkCount; chunk++){
+    for(size_t i = 0; i < largeGroups[chunk].size(); i += 2){
+      sortLargeGroup(largeGroups[chunk][i], largeGroups[chunk][i+1]);
+    }
+  }
+  return find(unsorted.begin(), unsorted.end(), 1) != unsorted.end();
+}
+
+template<class Index>
+void PrefixSorter<Index>::sortGroup(uint64_t start, uint64_t end){
+  const Index* groupOf = groups.data();
+  uint64_t back = shift;
+  std::sort(rows.begin() + start, rows.begin() + end,
+            [groupOf, back](Index a, Index b){
+              return groupOf[a - back] < groupOf[b - back];
+            });
+  markSplits(start, end, start);
+}
+
+// sorts one chunk of the group on each thread, then merges the chunks
+// pairwise
+template<class Index>
+void PrefixSorter<Index>::sortLargeGroup(uint64_t start, uint64_t end){
+  const Index* groupOf = groups.data();
+  uint64_t back = shift;
+  auto order = [groupOf, back](Index a, Index b){
+    return groupOf[a - back] < groupOf[b - back];
+  };
+  vector<uint64_t> pieces(chunkCount + 1);
+  for(size_t piece = 0; piece <= chunkCount; piece++){
+    pieces[piece] = start + (end - start) * piece / chunkCount;
+  }
+  typename vector<Index>::iterator first = rows.begin();
+  executor.parallelFor(chunkCount, 1, [&](size_t from, size_t to){
+      std::sort(first + pieces[from], first + pieces[to], order);
+    });
+  for(size_t width = 1; width < chunkCount; width *= 2){
+    size_t pairCount = (chunkCount + width * 2 - 1) / (width * 2);
+    executor.parallelFor(pairCount, 1, [&](size_t from, size_t to){
+        for(size_t pair = from; pair < to; pair++){
+          size_t left = pair * width * 2;
+          size_t middle = min(left + width, chunkCount);
+          size_t right = min(left + width * 2, chunkCount);
+          inplace_merge(first + pieces[left], first + pieces[middle],
+                        first + pieces[right], order);
+        }
+      });
+  }
+  executor.parallelFor(chunkCount, 1, [&](size_t from, size_t to){
+      markSplits(pieces[from], pieces[to], start);
+    });
+}
+
+// marks the sorted rows [start,end) of a group that differ from the
+// row before them
+template<class Index>
+void PrefixSorter<Index>::markSplits(uint64_t start, uint64_t end,
+                                     uint64_t groupStart){
+  for(uint64_t row = max(start, groupStart + 1); row < end; row++){
+    if(groups[rows[row] - shift] != groups[rows[row - 1] - shift]){
+      flags[row] = GROUP_SPLIT;
+    }
+  }
+}
+
+// Points the prefixes of every new group to its first row. Each chunk
+// first finds the group that its first row is in, from the last group
+// start in the chunks before it.
+template<class Index>
+void PrefixSorter<Index>::relabel(){
+  vector<uint64_t> lastGroups(chunkCount, NO_ROW);
+  executor.parallelFor(chunkCount, 1, [&](size_t from, size_t to){
+      for(size_t chunk = from; chunk < to; chunk++){
+        for(uint64_t row = chunkStart(chunk + 1);
+            row-- > chunkStart(chunk);){
+          if(flags[row]){
+            lastGroups[chunk] = row;
+            break;
+          }
+        }
+      }
+    });
+  vector<uint64_t> firstGroups(chunkCount, 0);
+  for(size_t chunk = 1; chunk < chunkCount; chunk++){
+    firstGroups[chunk] = (lastGroups[chunk - 1] == NO_ROW) ?
+      firstGroups[chunk - 1] : lastGroups[chunk - 1];
+  }
+  executor.parallelFor(chunkCount, 1, [&](size_t from, size_t to){
+      for(size_t chunk = from; chunk < to; chunk++){
+        uint64_t groupStart = firstGroups[chunk];
+        bool isNew = (flags[groupStart] == GROUP_SPLIT);
+        for(uint64_t row = chunkStart(chunk); row < chunkStart(chunk + 1);
+            row++){
+          if(flags[row]){
+            groupStart = row;
+            isNew = (flags[row] == GROUP_SPLIT);
+          }
+          if(isNew){
+            groups[rows[row]] = groupStart;
+          }
+        }
+      }
+    });
+  executor.parallelFor(chunkCount, 1, [&](size_t from, size_t to){
+      for(uint64_t row = chunkStart(from); row < chunkStart(to); row++){
+        flags[row] = (flags[row] != 0) ? GROUP_START : 0;
+      }
+    });
+}
+
+// constructors
+
+Prebowt::Prebowt(uint64_t sampleRate){
+  samples = PositionSamples(sampleRate);
+}
+
+// Builds the transform by sorting every prefix of every sequence
+Prebowt::Prebowt(const vector<PackedSeq>& seqs, uint64_t sampleRate){
+  *this = sortPrefixes(seqs.data(), seqs.size(), sampleRate, 1);
+}
+
+// static public methods
+
+// Builds the transform on several threads, which share every pass of
+// the prefix sort (see PrefixSorter), so that a few long sequences are
+// built as quickly as many short ones. The result is identical to a
+// sequential build. Throws invalid_argument if any sequence contains
+// end markers.
+Prebowt Prebowt::build(const vector<PackedSeq>& seqs, size_t threadCount,
+                       uint64_t sampleRate){
+  return sortPrefixes(seqs.data(), seqs.size(), sampleRate,
+                      max(threadCount, (size_t)1));
+}
+
+// Merges two transforms, as if the sequences of second were inserted
+// after those of first. For every row of second, the number of rows of
+// first that sort before it is found by tracing its sequences through
+// first with LF steps (in parallel, split by sequence); the rows are
+// then interleaved, and bulk-loaded into a new tree.
+Prebowt Prebowt::merge(const Prebowt& first, const Prebowt& second,
+                       size_t threadCount){
+  if((first.length() == 0) || (second.length() == 0)){
+    return (first.length() == 0) ? second : first;
+  }
+  threadCount = max(threadCount, (size_t)1);
+  uint64_t secondSeqs = second.sequenceCount();
+  vector<uint64_t> firstBefore(second.length());
+  vector<thread> workers;
+  for(size_t t = 0; t < threadCount; t++){
+    uint64_t fromSeq = secondSeqs * t / threadCount;
+    uint64_t toSeq = secondSeqs * (t + 1) / threadCount;
+    workers.push_back(thread(traceRows, cref(first), cref(second),
+                             fromSeq, toSeq, ref(firstBefore)));
+  }
+  for(size_t i = 0; i < workers.size(); i++){
+    workers[i].join();
+  }
+  uint64_t firstSeqs = first.sequenceCount();
+  Prebowt retVal(first.samples.rate());
+  Tree::Loader loader;
+  uint64_t firstPos = 0;
+  uint64_t secondPos = 0;
+  while(secondPos < second.length()){
+    uint64_t runFirstEnd = firstBefore[secondPos];
+    loader.append(first.tree, firstPos, runFirstEnd - firstPos);
+    retVal.samples.append(first.samples, firstPos, runFirstEnd - firstPos, 0);
+    firstPos = runFirstEnd;
+    uint64_t runSecondEnd = secondPos + 1;
+    while((runSecondEnd < second.length())
+          && (firstBefore[runSecondEnd] == runFirstEnd)){
+      runSecondEnd++;
+    }
+    loader.append(second.tree, secondPos, runSecondEnd - secondPos);
+    retVal.samples.append(second.samples, secondPos,
+                          runSecondEnd - secondPos, firstSeqs);
+    secondPos = runSecondEnd;
+  }
+  loader.append(first.tree, firstPos, first.length() - firstPos);
+  retVal.samples.append(first.samples, firstPos,
+                        first.length() - firstPos, 0);
+  retVal.tree = loader.finish();
+  retVal.samples.finish();
+  return retVal;
+}
+
+// public methods
+
+// Inserts every prefix of a new sequence, shortest first, and returns
+// its sequence ID. The empty prefix goes after all existing empty
+// prefixes; each longer prefix is placed with an LF step from the
+// row just inserted, which also puts it after any identical prefixes
+// of earlier sequences. Each base costs one rank query and one
+// insertion, so the cost is O(length * log n). Throws
+// invalid_argument, leaving the transform unchanged, if the sequence
+// contains end markers.
+uint64_t Prebowt::addSequence(const PackedSeq& seq){
+  checkBases(seq);
+  uint64_t seqId = sequenceCount();
+  uint64_t row = seqId;
+  for(size_t i = 0; i < seq.length(); i++){
+    tree = tree.insertBase(row, seq[i]);
+    SeqPos pos = {seqId, i};
+    samples.insert(row, pos, false);
+    PackedSeq::Base base = PackedSeq::baseClass(seq[i]);
+    // the new empty prefix row is not yet matched by an end marker
+    row = firstRow(base) + 1 + tree.rank(base, row);
+  }
+  tree = tree.insertBase(row, PackedSeq::encode('$'));
+  SeqPos pos = {seqId, seq.length()};
+  samples.insert(row, pos, true);
+  return seqId;
+}
+
+// writes the transform and its position samples to an index file
+// that MappedPrebowt can map
+void Prebowt::save(const string& fileName) const{
+  MappedTree::write(tree, fileName, samples);
+}
+
+// private static accessory methods
+
+// the transform of seqs[0,count), by sorting all of their prefixes;
+// row numbers are 32-bit unless there are too many rows. Throws
+// invalid_argument if any sequence contains end markers.
+Prebowt Prebowt::sortPrefixes(const PackedSeq* seqs, size_t count,
+                              uint64_t sampleRate, size_t threadCount){
+  uint64_t rowCount = 0;
+  for(size_t i = 0; i < count; i++){
+    checkBases(seqs[i]);
+    rowCount += seqs[i].length() + 1;
+  }
+  QueryExecutor executor(threadCount);
+  Prebowt retVal(sampleRate);
+  PackedSeq symbols;
+  if(rowCount <= UINT32_MAX){
+    PrefixSorter<uint32_t> sorter(seqs, count, executor);
+    sorter.sort();
+    sorter.finish(symbols, retVal.samples);
+  } else {
+    PrefixSorter<uint64_t> sorter(seqs, count, executor);
+    sorter.sort();
+    sorter.finish(symbols, retVal.samples);
+  }
+  retVal.tree = Tree(symbols);
+  retVal.samples.finish();
+  return retVal;
+}
+
+// An end marker within a sequence would end it early in the transform
+// (splitting it in two), so sequences with end markers are rejected
+void Prebowt::checkBases(const PackedSeq& seq){
+  if(BaseCounter::count(seq.data(), seq.length(), PackedSeq::END) > 0){
+    throw invalid_argument("sequence contains an end marker at offset " +
+                           to_string(seq.select(PackedSeq::END, 0)));
+  }
+}
+
+// For the rows of the sequences [fromSeq,toSeq) of second, stores the
+// number of rows of first that sort before them. The empty prefixes
+// of second follow all of those of first; each step extends the prefix
+// in both transforms at once.
+void Prebowt::traceRows(const Prebowt& first, const Prebowt& second,
+                        uint64_t fromSeq, uint64_t toSeq,
+                        vector<uint64_t>& firstBefore){
+  uint64_t firstStarts[PackedSeq::ALL + 1];
+  uint64_t secondStarts[PackedSeq::ALL + 1];
+  for(size_t b = PackedSeq::END; b <= PackedSeq::ALL; b++){
+    firstStarts[b] = first.firstRow((PackedSeq::Base)b);
+    secondStarts[b] = second.firstRow((PackedSeq::Base)b);
+  }
+  for(uint64_t seqId = fromSeq; seqId < toSeq; seqId++){
+    uint64_t firstRowCount = first.sequenceCount();
+    uint64_t row = seqId;
+    while(true){
+      firstBefore[row] = firstRowCount;
+      uint8_t code;
+      uint64_t secondRank = second.tree.rankAt(row, code);
+      PackedSeq::Base base = PackedSeq::baseClass(code);
+      if(base == PackedSeq::END){
+        break;
+      }
+      firstRowCount = firstStarts[base] + first.tree.rank(base, firstRowCount);
+      row = secondStarts[base] + secondRank;
+    }
+  }
+}
+
+// MappedPrebowt
+
+// constructors
+
+// throws runtime_error if the file is missing or not a valid index
+MappedPrebowt::MappedPrebowt(const string& fileName){
+  tree = MappedTree(fileName);
+  samples = tree.samples();
+}
+
+// CompactPrebowt
+
+// constructors
+
+CompactPrebowt::CompactPrebowt(){
+}
+
+// the rows of src are compressed one leaf at a time
+CompactPrebowt::CompactPrebowt(const Prebowt& src){
+  samples = src.positionSamples();
+  const Prebowt::Tree& rows = src.transform();
+  Tree::Loader loader;
+  for(uint64_t pos = 0; pos < rows.length(); pos += Tree::SEQ_MAX){
+    PackedSeq leafRows;
+    rows.appendTo(leafRows, pos, Tree::SEQ_MAX);
+    loader.append(leafRows);
+  }
+  tree = loader.finish();
+}
+
+// VersionedPrebowt
+
+// constructors
+
+VersionedPrebowt::VersionedPrebowt()
+  : current(make_shared<const Prebowt>()), versionNum(0){
+}
+
+VersionedPrebowt::VersionedPrebowt(const Prebowt& initial)
+  : current(make_shared<const Prebowt>(initial)), versionNum(0){
+}
+
+// public methods
+
+// pins the latest published version
+VersionedPrebowt::Snapshot VersionedPrebowt::snapshot() const{
+  return atomic_load(&current);
+}
+
+// number of versions published so far
+uint64_t VersionedPrebowt::version() const{
+  return versionNum.load(memory_order_acquire);
+}
+
+// adds a sequence as a new version, and returns its sequence ID
+uint64_t VersionedPrebowt::addSequence(const PackedSeq& seq){
+  lock_guard<mutex> guard(writeLock);
+  Prebowt next = *atomic_load(&current);
+  uint64_t retVal = next.addSequence(seq);
+  atomic_store(&current, Snapshot(make_shared<const Prebowt>(move(next))));
+  versionNum.fetch_add(1, memory_order_release);
+  return retVal;
+}
+
+// adds several sequences as a single new version; none are added if
+// any is rejected (see Prebowt::addSequence)
+void VersionedPrebowt::addSequences(const vector<PackedSeq>& seqs){
+  lock_guard<mutex> guard(writeLock);
+  Prebowt next = *atomic_load(&current);
+  for(size_t i = 0; i < seqs.size(); i++){
+    next.addSequence(seqs[i]);
+  }
+  atomic_store(&current, Snapshot(make_shared<const Prebowt>(move(next))));
+  versionNum.fetch_add(1, memory_order_release);
+}
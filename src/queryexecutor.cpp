@@ -0,0 +1,161 @@
+/** <header>
+
+ * This file is part of preBowt -- a prefix-based BWT-like transform of
+ * genetic data.
+ *
+ * Copyright 2014 David Eccles (gringer) <bioinformatics@gringene.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * without any warranty; without even the implied warranty of
+ * merchantability or fitness for a particular purpose. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+</header> **/
+
+#include "queryexecutor.hpp"
+
+// constructors
+
+QueryExecutor::QueryExecutor(size_t threadCount)
+  : queuedCount(0), nextQueue(0), stopping(false){
+  if(threadCount == 0){
+    threadCount = max(thread::hardware_concurrency(), 1u);
+  }
+  for(size_t i = 0; i < threadCount; i++){
+    queues.push_back(unique_ptr<WorkQueue>(new WorkQueue()));
+  }
+  for(size_t i = 0; i < threadCount; i++){
+    workers.push_back(thread(&QueryExecutor::workerLoop, this, i));
+  }
+}
+
+// destructor
+
+// waits for queued tasks to finish
+QueryExecutor::~QueryExecutor(){
+  {
+    lock_guard<mutex> guard(idleLock);
+    stopping = true;
+  }
+  wakeUp.notify_all();
+  for(size_t i = 0; i < workers.size(); i++){
+    workers[i].join();
+  }
+}
+
+// public methods
+
+size_t QueryExecutor::threadCount() const{
+  return workers.size();
+}
+
+// Calls body(start, end) for consecutive ranges of [0,count), each of
+// at most grain items, and waits for them all to finish. The calling
+// thread runs tasks too, so this can be used from inside a task. The
+// first exception thrown by body is rethrown here.
+void QueryExecutor::parallelFor(size_t count, size_t grain,
+                                const RangeTask& body){
+  if(count == 0){
+    return;
+  }
+  grain = max(grain, (size_t)1);
+  size_t taskCount = (count + grain - 1) / grain;
+  mutex doneLock;
+  condition_variable allDone;
+  size_t remaining = taskCount;
+  exception_ptr firstError;
+  for(size_t start = 0; start < count; start += grain){
+    size_t end = min(start + grain, count);
+    submit([&, start, end](){
+        try {
+          body(start, end);
+        } catch(...) {
+          lock_guard<mutex> guard(doneLock);
+          if(!firstError){
+            firstError = current_exception();
+          }
+        }
+        lock_guard<mutex> guard(doneLock);
+        if(--remaining == 0){
+          allDone.notify_all();
+        }
+      });
+  }
+  Task task;
+  for(size_t i = 0; takeTask(i % queues.size(), task); i++){
+    task();
+  }
+  unique_lock<mutex> lock(doneLock);
+  allDone.wait(lock, [&](){ return remaining == 0; });
+  if(firstError){
+    rethrow_exception(firstError);
+  }
+}
+
+// private accessory methods
+
+// queues are filled in turn, so a burst of tasks starts out spread
+// across all workers
+void QueryExecutor::submit(Task task){
+  WorkQueue& queue = *queues[nextQueue.fetch_add(1, memory_order_relaxed)
+                             % queues.size()];
+  {
+    lock_guard<mutex> guard(queue.lock);
+    queue.tasks.push_back(move(task));
+  }
+  {
+    lock_guard<mutex> guard(idleLock);
+    queuedCount++;
+  }
+  wakeUp.notify_one();
+}
+
+// takes the newest task from a queue, or failing that the oldest task
+// from another queue
+bool QueryExecutor::takeTask(size_t queueId, Task& task){
+  {
+    WorkQueue& own = *queues[queueId];
+    lock_guard<mutex> guard(own.lock);
+    if(!own.tasks.empty()){
+      task = move(own.tasks.back());
+      own.tasks.pop_back();
+      queuedCount--;
+      return true;
+    }
+  }
+  for(size_t i = 1; i < queues.size(); i++){
+    WorkQueue& victim = *queues[(queueId + i) % queues.size()];
+    lock_guard<mutex> guard(victim.lock);
+    if(!victim.tasks.empty()){
+      task = move(victim.tasks.front());
+      victim.tasks.pop_front();
+      queuedCount--;
+      return true;
+    }
+  }
+  return false;
+}
+
+void QueryExecutor::workerLoop(size_t queueId){
+  Task task;
+  while(true){
+    if(takeTask(queueId, task)){
+      task();
+      task = Task();
+      continue;
+    }
+    unique_lock<mutex> lock(idleLock);
+    wakeUp.wait(lock, [&](){ return stopping || (queuedCount > 0); });
+    if(stopping && (queuedCount == 0)){
+      return;
+    }
+  }
+}
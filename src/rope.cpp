@@ -26,6 +26,8 @@
 #include <algorithm>
 
 #include "rope.hpp"
+#include "blockpool.hpp"
+#include "nodenumber.hpp"
 #include "prebowtconfig.hpp"
 
 //#define PTR_DEBUG 1
@@ -48,7 +50,24 @@ using namespace std;
 // cluster where they can be accessed locally."
 
 
-int Rope::nextNodeNum = 0;
+// the first count Fibonacci numbers, starting from 1, 2
+static vector<size_t> fibonacci(size_t count){
+  vector<size_t> retVal;
+  retVal.push_back(1);
+  retVal.push_back(2);
+  while(retVal.size() < count){
+    retVal.push_back(retVal[retVal.size() - 1] + retVal[retVal.size() - 2]);
+  }
+  return retVal;
+}
+
+// a new shared rope node; each node and its reference counts share
+// one pooled block
+template<class... Args>
+static shared_ptr<Rope> newRope(Args&&... args){
+  TREE_STAT(NODE_ALLOCATIONS, 1);
+  return allocate_shared<Rope>(PoolAllocator<Rope>(), forward<Args>(args)...);
+}
 
 ostream &operator<<(ostream& out, const Rope& src){
 #if OUTPUT_DEBUG
@@ -76,46 +95,57 @@ ostream &operator<<(ostream& out, const Rope& src){
 // Copy constructor (shallow copy)
 // [note: left and right for src and this point to the same node]
 Rope::Rope(const Rope& src){
-  nodeNum = nextNodeNum++;
+  nodeNum = NodeNumber<Rope>::next();
 #if PTR_DEBUG
   cerr << "[C#" << nodeNum << "<-#" << src.nodeNum << "]";
 #endif
   sequence = src.sequence;
   left = src.left;
   right = src.right;
+  len = src.len;
+  nodeDepth = src.nodeDepth;
 }
 
 // Create a new leaf node out of a string
 Rope::Rope(const string& tSeq){
-  nodeNum = nextNodeNum++;
+  nodeNum = NodeNumber<Rope>::next();
 #if PTR_DEBUG
   cerr << "[L#" << nodeNum << "(" << tSeq << ")]";
 #endif
   sequence = tSeq;
+  len = tSeq.length();
+  nodeDepth = 0;
 }
 
 // Create a new concatenation node from two child ropes
 Rope::Rope(const Rope& rL, const Rope& rR){
-  nodeNum = nextNodeNum++;
-  shared_ptr<Rope> pRL(new Rope(rL));
-  shared_ptr<Rope> pRR(new Rope(rR));
+  nodeNum = NodeNumber<Rope>::next();
+  shared_ptr<Rope> pRL = newRope(rL);
+  shared_ptr<Rope> pRR = newRope(rR);
 #if PTR_DEBUG
   cerr << "[T#" << nodeNum << "<-(#" 
        << pRL->nodeNum << ",#" << pRR->nodeNum << ")]";
 #endif
   left = pRL;
   right = pRR;
+  len = rL.len + rR.len;
+  // We define the depth of a leaf to be 0, and the depth of a
+  // concatenation to be one plus the maximum depth of its children.
+  nodeDepth = max(rL.nodeDepth, rR.nodeDepth) + 1;
 }
 
 // Assignment operator (shallow copy)
 Rope& Rope::operator=(const Rope& src){
   if(this != &src){ // gracefully handle self assignment
-    nodeNum = nextNodeNum++;
+    nodeNum = NodeNumber<Rope>::next();
 #if PTR_DEBUG
     cerr << "[A#" << nodeNum << "<-#" << src.nodeNum << "]";
 #endif
+    sequence = src.sequence;
     left = src.left;
     right = src.right;
+    len = src.len;
+    nodeDepth = src.nodeDepth;
   }
   return *this;
 }
@@ -129,6 +159,7 @@ Rope::~Rope(){
 
 // static public methods
 Rope Rope::concat(const Rope& rL, const Rope& rR){
+  TREE_STAT(APPENDS, 1);
   if(rL.isShortLeaf() && rR.isShortLeaf()){
     // If both arguments are short leaves, we produce a flat rope
     // (leaf) consisting of the concatenation.
@@ -146,10 +177,18 @@ Rope Rope::concat(const Rope& rL, const Rope& rR){
   }
   // In the general case, concatenation involves simply allocating a
   // concatenation node containing two pointers to the two arguments.
-  return(Rope(rL, rR));
+  // Deep results are rebalanced (as in the SGI rope); small ropes are
+  // cheap to rebalance, so are kept shallower.
+  Rope retVal(rL, rR);
+  if((retVal.nodeDepth > REBALANCE_DEPTH) &&
+     ((retVal.len < SMALL_LENGTH) || (retVal.nodeDepth > MAX_DEPTH))){
+    return(Rope::rebalance(retVal));
+  }
+  return(retVal);
 }
 
 Rope Rope::substr(const Rope& src, const size_t& start, const size_t& len){
+  TREE_STAT(SPLITS, 1);
 #if SUBSTR_DEBUG
   cerr << "[SS(" << start << "," << len << ")]";
 #endif
@@ -162,43 +201,114 @@ Rope Rope::substr(const Rope& src, const size_t& start, const size_t& len){
     cerr << "[Leaf substring (" << start << ","
          << len << ") of "<< src.length() << "]";
 #endif
-    Rope retVal(src.sequence.substr(start, len));
+    Rope retVal((start < src.len) ? src.sequence.substr(start, len) : "");
     return(retVal);
   }
-  size_t leftLength = src.left->length();
+  size_t leftLength = src.left->len;
+  // ranges entirely within one child are passed down
+  if(start >= leftLength){
+    return(Rope::substr(*src.right, start - leftLength, len));
+  }
+  if(len <= (leftLength - start)){
+    return(Rope::substr(*src.left, start, len));
+  }
   // left = if start <= 0 and len >= length(rope1) then
   //           rope1
   //        else
   //           substr(rope1,start,len)
-  Rope left(((start == 0) && (len >= leftLength)) ?
-            *src.left :
+  Rope left((start == 0) ? *src.left :
             Rope::substr(*src.left, start, len));
-  // right = if start <= length(rope1)
-  //  and start + len >= length(rope1) + length(rope2) then
+  // right = if start + len >= length(rope1) + length(rope2) then
   //            rope2
   //         else
-  //            substr(rope2,start-length(rope1), len-length(left))
-  Rope right(((start <= leftLength) 
-              && ((start + len) >= (leftLength + src.right->length()))) ?
-             *src.right :
-             Rope::substr(*src.right, 
-                          (leftLength >= start) ? 0 : start - leftLength,
-                          len - left.length()));
+  //            substr(rope2,0,len-length(left))
+  size_t rightLen = len - left.len;
+  Rope right((rightLen >= src.right->len) ? *src.right :
+             Rope::substr(*src.right, 0, rightLen));
   return(Rope::concat(left,right));
 }
 
+// Rebalances a rope as described by Boehm, Atkinson and Plass: the
+// leaves (and balanced subtrees) are added in order to a forest of
+// ropes, where slot i holds a rope of length [Fib(i+2),Fib(i+3));
+// concatenating the forest gives a rope whose depth is logarithmic in
+// its length.
+Rope Rope::rebalance(const Rope& src){
+  vector<shared_ptr<Rope> > forest(MAX_DEPTH + 1);
+  addToForest(src, forest);
+  shared_ptr<Rope> retVal;
+  for(size_t i = 0; i <= MAX_DEPTH; i++){
+    if(forest[i]){
+      retVal = retVal ? newRope(*forest[i], *retVal) : forest[i];
+    }
+  }
+  return(retVal ? *retVal : Rope(""));
+}
+
 // public methods
 
 size_t Rope::length() const{
-  // this should probably be cached
-  size_t tLen = sequence.length();
+  return len;
+}
+
+size_t Rope::depth() const{
+  return nodeDepth;
+}
+
+// A rope is balanced if its length is at least Fib(depth+2)
+bool Rope::isBalanced() const{
+  return((nodeDepth <= MAX_DEPTH) && (len >= minLength(nodeDepth)));
+}
+
+char Rope::charAt(size_t pos) const{
+  TREE_STAT(QUERIES, 1);
+  const Rope* node = this;
+  TREE_STAT(NODES_VISITED, 1);
+  while(node->hasChildren()){
+    TREE_STAT(NODES_VISITED, 1);
+    if(pos < node->left->len){
+      node = node->left.get();
+    } else {
+      pos -= node->left->len;
+      node = node->right.get();
+    }
+  }
+  return node->sequence[pos];
+}
+
+Rope::Iterator Rope::begin() const{
+  return Iterator(*this, 0);
+}
+
+Rope::Iterator Rope::end() const{
+  return Iterator(*this, len);
+}
+
+// an iterator starting at a given position, found in O(depth)
+Rope::Iterator Rope::iteratorAt(size_t pos) const{
+  return Iterator(*this, min(pos, len));
+}
+
+// a view of the characters in [start,start+len), truncated to the end
+// of the rope
+Rope::View Rope::view(size_t start, size_t len) const{
+  return View(*this, start, len);
+}
+
+// adds the depth of each leaf below this node (at the given level
+// below the root) to dest; leaves have no fixed capacity, so no fill
+void Rope::addShape(TreeStats& dest, size_t level) const{
+  if(!hasChildren()){
+    dest.addLeaf(level, len, 0);
+    return;
+  }
+  dest.addNode((size_t)hasLeft() + (size_t)hasRight(), 2);
   if(left){
-    tLen += left->length();
+    left->addShape(dest, level + 1);
   }
   if(right){
-    tLen += right->length();
+    right->addShape(dest, level + 1);
   }
-  return tLen;
 }
 
 Rope* Rope::getLeft() const{
@@ -209,6 +319,54 @@ Rope* Rope::getRight() const{
   return right.get();
 }
 
+// private static accessory methods
+
+// minimum length of a balanced rope of a given depth: Fib(depth+2)
+size_t Rope::minLength(size_t depth){
+  static const vector<size_t> fib = fibonacci(MAX_DEPTH + 2);
+  return fib[min(depth, MAX_DEPTH + 1)];
+}
+
+// adds the leaves of a rope to the forest, keeping balanced subtrees
+// whole
+void Rope::addToForest(const Rope& src, vector<shared_ptr<Rope> >& forest){
+  if(src.isBalanced()){
+    addBalanced(src, forest);
+  } else {
+    addToForest(*src.left, forest);
+    addToForest(*src.right, forest);
+  }
+}
+
+// Adds a balanced rope to the forest. Smaller ropes are concatenated
+// onto its left first, then the result is carried upwards until it
+// reaches an empty slot matching its length.
+void Rope::addBalanced(const Rope& src, vector<shared_ptr<Rope> >& forest){
+  if(src.len == 0){
+    return;
+  }
+  shared_ptr<Rope> tooTiny;
+  size_t i = 0;
+  for(; src.len >= minLength(i + 1); i++){
+    if(forest[i]){
+      tooTiny = tooTiny ? newRope(*forest[i], *tooTiny) : forest[i];
+      forest[i].reset();
+    }
+  }
+  shared_ptr<Rope> insertee = tooTiny ?
+    newRope(*tooTiny, src) : newRope(src);
+  for(;; i++){
+    if(forest[i]){
+      insertee = newRope(*forest[i], *insertee);
+      forest[i].reset();
+    }
+    if((i == MAX_DEPTH) || (insertee->len < minLength(i + 1))){
+      forest[i] = insertee;
+      return;
+    }
+  }
+}
+
 // private accessory methods
 
 bool Rope::isLeaf() const{
@@ -235,49 +393,189 @@ bool Rope::isConcatNode() const{
   return(hasRight());
 }
 
-size_t Rope::depth() const{
-  // We define the depth of a leaf to be 0, and the depth of a
-  // concatenation to be one plus the maximum depth of its children.
-  return((isLeaf()) ? 0 :
-    (max(left.get()->depth(),right.get()->depth())+1));
-}
-
-int main(){
-  cerr << "Testing leaf node creation...";
-  Rope a("The quick brown ");
-  Rope b("fox jumps over ");
-  Rope c("the lazy ");
-  Rope d("dog");
-  cerr << " done\n";
-  cerr << "Result[a]: " << a << endl;
-  cerr << "Result[b]: " << b << endl;
-  cerr << "Result[c]: " << c << endl;
-  cerr << "Result[d]: " << d << endl;
-  cerr << "Testing substring on simple string... ";
-  cerr << "'" << Rope::substr(a,4,5) << "' == 'quick'...";
-  cerr << " done\n";
-  cerr << "Testing concatenation of two short leaves...";
-  Rope e = Rope::concat(a,b);
-  cerr << " done\n";
-  cerr << "Result[e]: " << e << endl;
-  cerr << "Testing basic node concatenation...";
-  Rope f(a,b);
-  cerr << " done\n";
-  cerr << "Result[f]: " << f << endl;
-  cerr << "Testing substring with range [0,len(left)+1]...";
-  cerr << "'" << Rope::substr(f,0,f.getLeft()->length()+1)
-       << "' == 'The quick brown f'...";
-  cerr << " done\n";
-  cerr << "Testing substring with range [4,len(left+right)+1]...";
-  cerr << "'" << Rope::substr(f,0,f.length())
-       << "' == 'quick brown fox jumps over '...";
-  cerr << " done\n";
-  cerr << "Testing concatenation with right of left node a short leaf...";
-  Rope g = Rope::concat(f,c);
-  cerr << " done\n";
-  cerr << "Result[g]: " << g << endl;
-  cerr << "Testing non-trivial node concatenation...";
-  Rope h = Rope::concat(g,d);
-  cerr << " done\n";
-  cerr << "Result[h]: " << h << endl;
+// the leaf holding the character at pos (which should be less than
+// length()); pos becomes the position of the character in that leaf
+const Rope* Rope::leafAt(size_t& pos) const{
+  const Rope* node = this;
+  while(node->hasChildren()){
+    if(pos < node->left->len){
+      node = node->left.get();
+    } else {
+      pos -= node->left->len;
+      node = node->right.get();
+    }
+  }
+  return node;
+}
+
+// Rope::View
+
+// constructors
+
+Rope::View::View()
+  : root(NULL), start(0), len(0){
+}
+
+Rope::View::View(const Rope& src, size_t start, size_t len)
+  : root(&src), start(min(start, src.len)),
+    len(min(len, src.len - this->start)){
+}
+
+// public methods
+
+size_t Rope::View::length() const{
+  return len;
+}
+
+char Rope::View::charAt(size_t pos) const{
+  return root->charAt(start + pos);
+}
+
+// a view of [start,start+len) of this view, truncated to its end
+Rope::View Rope::View::substr(size_t start, size_t len) const{
+  View retVal;
+  if(start < this->len){
+    retVal.root = root;
+    retVal.start = this->start + start;
+    retVal.len = min(len, this->len - start);
+  }
+  return retVal;
+}
+
+Rope::View::Iterator Rope::View::begin() const{
+  return Iterator(*this, 0);
+}
+
+Rope::View::Iterator Rope::View::end() const{
+  return Iterator(*this, len);
+}
+
+Rope::View::ReverseIterator Rope::View::rbegin() const{
+  return ReverseIterator(end());
+}
+
+Rope::View::ReverseIterator Rope::View::rend() const{
+  return ReverseIterator(begin());
+}
+
+// a rope of the characters in the view (see Rope::substr)
+Rope Rope::View::materialize() const{
+  return (len > 0) ? Rope::substr(*root, start, len) : Rope("");
+}
+
+// Rope::View::Iterator
+
+// constructors
+
+Rope::View::Iterator::Iterator()
+  : root(NULL), leaf(NULL), leafStart(0), first(0), last(0), pos(0){
+}
+
+Rope::View::Iterator::Iterator(const View& src, size_t viewPos)
+  : root(src.root), leaf(NULL), leafStart(0), first(src.start),
+    last(src.start + src.len), pos(src.start + viewPos){
+  if(pos < last){
+    findLeaf();
+  }
+}
+
+// public methods
+
+char Rope::View::Iterator::operator*() const{
+  return leaf->sequence[pos - leafStart];
+}
+
+Rope::View::Iterator& Rope::View::Iterator::operator++(){
+  pos++;
+  if((pos < last) && ((pos - leafStart) >= leaf->len)){
+    findLeaf();
+  }
+  return *this;
+}
+
+Rope::View::Iterator& Rope::View::Iterator::operator--(){
+  pos--;
+  if((leaf == NULL) || (pos < leafStart) ||
+     ((pos - leafStart) >= leaf->len)){
+    findLeaf();
+  }
+  return *this;
+}
+
+bool Rope::View::Iterator::operator==(const Iterator& other) const{
+  return (pos == other.pos) && (root == other.root);
+}
+
+bool Rope::View::Iterator::operator!=(const Iterator& other) const{
+  return !(*this == other);
+}
+
+size_t Rope::View::Iterator::position() const{
+  return pos - first;
+}
+
+// private accessory methods
+
+void Rope::View::Iterator::findLeaf(){
+  size_t leafPos = pos;
+  leaf = root->leafAt(leafPos);
+  leafStart = pos - leafPos;
+}
+
+// Rope::Iterator
+
+Rope::Iterator::Iterator(const Rope& src, size_t startPos)
+  : leaf(NULL), leafPos(0), pos(startPos){
+  descend(&src, startPos);
+}
+
+char Rope::Iterator::operator*() const{
+  return leaf->sequence[leafPos];
+}
+
+// steps to the next character, climbing to the nearest ancestor with
+// an unvisited right subtree when the current leaf is used up
+Rope::Iterator& Rope::Iterator::operator++(){
+  pos++;
+  leafPos++;
+  const Rope* child = leaf;
+  while((leafPos >= leaf->len) && !path.empty()){
+    const Rope* parent = path.back();
+    if(parent->left.get() == child){
+      descend(parent->right.get(), 0);
+      child = leaf;
+    } else {
+      child = parent;
+      path.pop_back();
+    }
+  }
+  return *this;
+}
+
+// iterators compare by position, so should be from the same rope
+bool Rope::Iterator::operator==(const Iterator& other) const{
+  return pos == other.pos;
+}
+
+bool Rope::Iterator::operator!=(const Iterator& other) const{
+  return pos != other.pos;
+}
+
+size_t Rope::Iterator::position() const{
+  return pos;
+}
+
+// walks down to the leaf holding nodePos, recording the path
+void Rope::Iterator::descend(const Rope* node, size_t nodePos){
+  while(node->hasChildren()){
+    path.push_back(node);
+    if(nodePos < node->left->len){
+      node = node->left.get();
+    } else {
+      nodePos -= node->left->len;
+      node = node->right.get();
+    }
+  }
+  leaf = node;
+  leafPos = nodePos;
 }
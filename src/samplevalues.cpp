@@ -0,0 +1,94 @@
+/** <header>
+
+ * This file is part of preBowt -- a prefix-based BWT-like transform of
+ * genetic data.
+ *
+ * Copyright 2014 David Eccles (gringer) <bioinformatics@gringene.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * without any warranty; without even the implied warranty of
+ * merchantability or fitness for a particular purpose. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+</header> **/
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "samplevalues.hpp"
+
+const size_t SampleValues::LEAF_SAMPLES;
+const size_t SampleValues::CAPACITY;
+
+// constructors
+
+SampleValues::SampleValues()
+  : len(0){
+}
+
+SampleValues::SampleValues(const SampleValues& src)
+  : len(0){
+  appendSamples(src.samples, src.length());
+}
+
+// operators
+
+SampleValues& SampleValues::operator=(const SampleValues& src){
+  if(this != &src){
+    len = 0;
+    appendSamples(src.samples, src.length());
+  }
+  return *this;
+}
+
+const SeqPos& SampleValues::operator[](size_t pos) const{
+  return samples[pos];
+}
+
+// public methods
+
+// mirrors string::substr: over-length arguments are truncated
+SampleValues SampleValues::substr(size_t start, size_t len) const{
+  SampleValues retVal;
+  if(start < length()){
+    retVal.appendSamples(samples + start, min(len, length() - start));
+  }
+  return retVal;
+}
+
+void SampleValues::append(const SampleValues& src){
+  appendSamples(src.samples, src.length());
+}
+
+void SampleValues::push_back(const SeqPos& pos){
+  appendSamples(&pos, 1);
+}
+
+size_t SampleValues::length() const{
+  return len;
+}
+
+// Adds the number of samples in [0,pos) to counts[ALL]; samples have
+// no base class, so the other counts are left alone
+void SampleValues::occ(size_t pos, uint64_t* counts) const{
+  counts[PackedSeq::ALL] += pos;
+}
+
+// private accessory methods
+
+void SampleValues::appendSamples(const SeqPos* src, size_t count){
+  if(len + count > CAPACITY){
+    throw runtime_error("sample leaf overflow: " +
+                        to_string(len + count) + " samples");
+  }
+  copy(src, src + count, samples + len);
+  len += count;
+}
@@ -0,0 +1,588 @@
+/** <header>
+
+ * This file is part of preBowt -- a prefix-based BWT-like transform of
+ * genetic data.
+ *
+ * Copyright 2014 David Eccles (gringer) <bioinformatics@gringene.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * without any warranty; without even the implied warranty of
+ * merchantability or fitness for a particular purpose. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+</header> **/
+
+#include <cstring>
+#include <cerrno>
+#include <stdexcept>
+#include <algorithm>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "shardset.hpp"
+
+// Messages between RemoteShard and ShardServer are frames of a one-byte
+// code (a ShardServer::Op for requests; 0 for success or 1 for an error
+// in replies), a uint64_t payload length and the payload. Numbers are
+// in the byte order of the machine, as the socket is local.
+
+static const char REPLY_OK = 0;
+static const char REPLY_ERROR = 1;
+static const size_t FRAME_PIECE = 1 << 20; // payload bytes read at once
+
+static void putU64(vector<char>& dest, uint64_t value){
+  const char* bytes = reinterpret_cast<const char*>(&value);
+  dest.insert(dest.end(), bytes, bytes + sizeof(value));
+}
+
+static uint64_t getU64(const vector<char>& src, size_t& pos){
+  uint64_t retVal;
+  if((pos + sizeof(retVal)) > src.size()){
+    throw runtime_error("shard message is truncated");
+  }
+  memcpy(&retVal, src.data() + pos, sizeof(retVal));
+  pos += sizeof(retVal);
+  return retVal;
+}
+
+// a count of items of at least itemBytes each, checked against the
+// bytes left, so that a corrupt count cannot cause a huge allocation
+static uint64_t getCount(const vector<char>& src, size_t& pos,
+                         size_t itemBytes){
+  uint64_t retVal = getU64(src, pos);
+  if(((src.size() - pos) / itemBytes) < retVal){
+    throw runtime_error("shard message is truncated");
+  }
+  return retVal;
+}
+
+static void putStrings(vector<char>& dest, const vector<string>& src){
+  putU64(dest, src.size());
+  for(size_t i = 0; i < src.size(); i++){
+    putU64(dest, src[i].length());
+    dest.insert(dest.end(), src[i].begin(), src[i].end());
+  }
+}
+
+static vector<string> getStrings(const vector<char>& src, size_t& pos){
+  vector<string> retVal(getCount(src, pos, sizeof(uint64_t)));
+  for(size_t i = 0; i < retVal.size(); i++){
+    uint64_t len = getU64(src, pos);
+    if((src.size() - pos) < len){
+      throw runtime_error("shard message is truncated");
+    }
+    retVal[i].assign(src.data() + pos, len);
+    pos += len;
+  }
+  return retVal;
+}
+
+// encoded bases (with qualities) are sent as they are stored
+static void putSeqs(vector<char>& dest, const vector<PackedSeq>& src){
+  putU64(dest, src.size());
+  for(size_t i = 0; i < src.size(); i++){
+    putU64(dest, src[i].length());
+    const char* codes = reinterpret_cast<const char*>(src[i].data());
+    dest.insert(dest.end(), codes, codes + src[i].length());
+  }
+}
+
+static vector<PackedSeq> getSeqs(const vector<char>& src, size_t& pos){
+  vector<PackedSeq> retVal(getCount(src, pos, sizeof(uint64_t)));
+  for(size_t i = 0; i < retVal.size(); i++){
+    uint64_t len = getU64(src, pos);
+    if((src.size() - pos) < len){
+      throw runtime_error("shard message is truncated");
+    }
+    retVal[i].append(reinterpret_cast<const uint8_t*>(src.data() + pos),
+                     len);
+    pos += len;
+  }
+  return retVal;
+}
+
+static void putHits(vector<char>& dest, const vector<vector<SeqPos> >& src){
+  putU64(dest, src.size());
+  for(size_t i = 0; i < src.size(); i++){
+    putU64(dest, src[i].size());
+    for(size_t h = 0; h < src[i].size(); h++){
+      putU64(dest, src[i][h].seqId);
+      putU64(dest, src[i][h].offset);
+    }
+  }
+}
+
+static vector<vector<SeqPos> > getHits(const vector<char>& src, size_t& pos){
+  vector<vector<SeqPos> > retVal(getCount(src, pos, sizeof(uint64_t)));
+  for(size_t i = 0; i < retVal.size(); i++){
+    uint64_t hitCount = getCount(src, pos, 2 * sizeof(uint64_t));
+    retVal[i].resize(hitCount);
+    for(size_t h = 0; h < hitCount; h++){
+      retVal[i][h].seqId = getU64(src, pos);
+      retVal[i][h].offset = getU64(src, pos);
+    }
+  }
+  return retVal;
+}
+
+static void writeBytes(int fd, const char* data, size_t len){
+  while(len > 0){
+    ssize_t written = send(fd, data, len, MSG_NOSIGNAL);
+    if(written < 0){
+      if(errno == EINTR){
+        continue;
+      }
+      throw runtime_error("cannot write to shard socket");
+    }
+    data += written;
+    len -= written;
+  }
+}
+
+// returns false if the connection is closed before any bytes are read
+static bool readBytes(int fd, char* data, size_t len){
+  size_t done = 0;
+  while(done < len){
+    ssize_t got = recv(fd, data + done, len - done, 0);
+    if(got < 0){
+      if(errno == EINTR){
+        continue;
+      }
+      throw runtime_error("cannot read from shard socket");
+    }
+    if(got == 0){
+      if(done == 0){
+        return false;
+      }
+      throw runtime_error("shard message is truncated");
+    }
+    done += got;
+  }
+  return true;
+}
+
+static void sendFrame(int fd, char code, const vector<char>& payload){
+  vector<char> frame(1, code);
+  putU64(frame, payload.size());
+  frame.insert(frame.end(), payload.begin(), payload.end());
+  writeBytes(fd, frame.data(), frame.size());
+}
+
+// Returns false if the connection is closed between frames. The
+// payload is read FRAME_PIECE bytes at a time, so that memory is only
+// taken for bytes that arrive, whatever length the header gives.
+static bool receiveFrame(int fd, char& code, vector<char>& payload){
+  char header[1 + sizeof(uint64_t)];
+  if(!readBytes(fd, header, sizeof(header))){
+    return false;
+  }
+  code = header[0];
+  uint64_t len;
+  memcpy(&len, header + 1, sizeof(len));
+  payload.clear();
+  while(payload.size() < len){
+    size_t done = payload.size();
+    size_t piece = min(len - done, (uint64_t)FRAME_PIECE);
+    payload.resize(done + piece);
+    if(!readBytes(fd, payload.data() + done, piece)){
+      throw runtime_error("shard message is truncated");
+    }
+  }
+  return true;
+}
+
+// a Unix socket address for path; throws runtime_error if it is too long
+static sockaddr_un socketAddress(const string& path){
+  sockaddr_un retVal;
+  memset(&retVal, 0, sizeof(retVal));
+  retVal.sun_family = AF_UNIX;
+  if(path.length() >= sizeof(retVal.sun_path)){
+    throw runtime_error("shard socket path is too long: " + path);
+  }
+  strcpy(retVal.sun_path, path.c_str());
+  return retVal;
+}
+
+// hits in order of sequence, then offset
+static bool positionLess(const SeqPos& a, const SeqPos& b){
+  return (a.seqId < b.seqId) ||
+    ((a.seqId == b.seqId) && (a.offset < b.offset));
+}
+
+// Shard
+
+// destructor
+
+Shard::~Shard(){
+}
+
+// LocalShard
+
+// constructors
+
+LocalShard::LocalShard(size_t buildThreads, uint64_t sampleRate)
+  : shardIndex(sampleRate), buildThreads(max(buildThreads, (size_t)1)){
+}
+
+LocalShard::LocalShard(const Prebowt& index, size_t buildThreads)
+  : shardIndex(index), buildThreads(max(buildThreads, (size_t)1)){
+}
+
+// public methods
+
+uint64_t LocalShard::length(){
+  return shardIndex.length();
+}
+
+uint64_t LocalShard::sequenceCount(){
+  return shardIndex.sequenceCount();
+}
+
+void LocalShard::addSequences(const vector<PackedSeq>& seqs){
+  Prebowt added = Prebowt::build(seqs, buildThreads,
+                                 shardIndex.positionSamples().rate());
+  shardIndex = Prebowt::merge(shardIndex, added, buildThreads);
+}
+
+vector<uint64_t> LocalShard::countBatch(const vector<string>& patterns){
+  return shardIndex.countBatch(patterns);
+}
+
+vector<vector<SeqPos> >
+LocalShard::locateBatch(const vector<string>& patterns){
+  vector<vector<SeqPos> > retVal(patterns.size());
+  for(size_t i = 0; i < patterns.size(); i++){
+    retVal[i] = shardIndex.locate(patterns[i]);
+  }
+  return retVal;
+}
+
+const Prebowt& LocalShard::index() const{
+  return shardIndex;
+}
+
+// RemoteShard
+
+// constructors
+
+RemoteShard::RemoteShard(const string& socketPath)
+  : socketPath(socketPath), fd(-1){
+  sockaddr_un address = socketAddress(socketPath);
+  fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if((fd < 0) ||
+     (connect(fd, reinterpret_cast<sockaddr*>(&address),
+              sizeof(address)) != 0)){
+    if(fd >= 0){
+      close(fd);
+    }
+    throw runtime_error("cannot connect to shard socket: " + socketPath);
+  }
+}
+
+// destructor
+
+RemoteShard::~RemoteShard(){
+  close(fd);
+}
+
+// public methods
+
+uint64_t RemoteShard::length(){
+  vector<char> reply = request(ShardServer::LENGTH, vector<char>());
+  size_t pos = 0;
+  return getU64(reply, pos);
+}
+
+uint64_t RemoteShard::sequenceCount(){
+  vector<char> reply = request(ShardServer::SEQUENCE_COUNT, vector<char>());
+  size_t pos = 0;
+  return getU64(reply, pos);
+}
+
+void RemoteShard::addSequences(const vector<PackedSeq>& seqs){
+  vector<char> payload;
+  putSeqs(payload, seqs);
+  request(ShardServer::ADD, payload);
+}
+
+vector<uint64_t> RemoteShard::countBatch(const vector<string>& patterns){
+  vector<char> payload;
+  putStrings(payload, patterns);
+  vector<char> reply = request(ShardServer::COUNT, payload);
+  vector<uint64_t> retVal(patterns.size());
+  size_t pos = 0;
+  for(size_t i = 0; i < retVal.size(); i++){
+    retVal[i] = getU64(reply, pos);
+  }
+  return retVal;
+}
+
+vector<vector<SeqPos> >
+RemoteShard::locateBatch(const vector<string>& patterns){
+  vector<char> payload;
+  putStrings(payload, patterns);
+  vector<char> reply = request(ShardServer::LOCATE, payload);
+  size_t pos = 0;
+  return getHits(reply, pos);
+}
+
+void RemoteShard::shutdown(){
+  request(ShardServer::SHUTDOWN, vector<char>());
+}
+
+// private accessory methods
+
+// sends a request, and returns the payload of the reply
+vector<char> RemoteShard::request(char op, const vector<char>& payload){
+  lock_guard<mutex> guard(requestLock);
+  sendFrame(fd, op, payload);
+  char code;
+  vector<char> retVal;
+  if(!receiveFrame(fd, code, retVal)){
+    throw runtime_error("shard server closed the connection: " +
+                        socketPath);
+  }
+  if(code != REPLY_OK){
+    throw runtime_error("shard server error: " +
+                        string(retVal.begin(), retVal.end()));
+  }
+  return retVal;
+}
+
+// ShardServer
+
+// constructors
+
+// Listens on socketPath, replacing any stale socket file there. Throws
+// runtime_error if the socket cannot be set up.
+ShardServer::ShardServer(const shared_ptr<Shard>& shard,
+                         const string& socketPath)
+  : shard(shard), socketPath(socketPath), listenFd(-1){
+  sockaddr_un address = socketAddress(socketPath);
+  unlink(socketPath.c_str());
+  listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if((listenFd < 0) ||
+     (bind(listenFd, reinterpret_cast<sockaddr*>(&address),
+           sizeof(address)) != 0) ||
+     (listen(listenFd, 4) != 0)){
+    if(listenFd >= 0){
+      close(listenFd);
+    }
+    throw runtime_error("cannot listen on shard socket: " + socketPath);
+  }
+}
+
+// destructor
+
+ShardServer::~ShardServer(){
+  close(listenFd);
+  unlink(socketPath.c_str());
+}
+
+// public methods
+
+void ShardServer::serve(){
+  bool stopping = false;
+  while(!stopping){
+    int clientFd = accept(listenFd, NULL, NULL);
+    if(clientFd < 0){
+      if(errno == EINTR){
+        continue;
+      }
+      throw runtime_error("cannot accept on shard socket: " + socketPath);
+    }
+    try{
+      stopping = serveClient(clientFd);
+    } catch(const exception&){
+      // a broken connection (or a corrupt frame) only ends that client
+    }
+    close(clientFd);
+  }
+}
+
+// private accessory methods
+
+// Answers the requests of one client until it disconnects; returns
+// true if it asked the server to stop. Errors from the shard are sent
+// back to the client.
+bool ShardServer::serveClient(int clientFd){
+  char op;
+  vector<char> payload;
+  while(receiveFrame(clientFd, op, payload)){
+    vector<char> reply;
+    try{
+      size_t pos = 0;
+      switch(op){
+      case LENGTH:
+        putU64(reply, shard->length());
+        break;
+      case SEQUENCE_COUNT:
+        putU64(reply, shard->sequenceCount());
+        break;
+      case ADD:
+        shard->addSequences(getSeqs(payload, pos));
+        break;
+      case COUNT:{
+        vector<uint64_t> counts = shard->countBatch(getStrings(payload, pos));
+        for(size_t i = 0; i < counts.size(); i++){
+          putU64(reply, counts[i]);
+        }
+        break;
+      }
+      case LOCATE:
+        putHits(reply, shard->locateBatch(getStrings(payload, pos)));
+        break;
+      case SHUTDOWN:
+        sendFrame(clientFd, REPLY_OK, reply);
+        return true;
+      default:
+        throw runtime_error("unknown shard request");
+      }
+    } catch(const exception& e){
+      string message = e.what();
+      sendFrame(clientFd, REPLY_ERROR,
+                vector<char>(message.begin(), message.end()));
+      continue;
+    }
+    sendFrame(clientFd, REPLY_OK, reply);
+  }
+  return false;
+}
+
+// ShardSet
+
+// constructors
+
+ShardSet::ShardSet()
+  : nextId(0){
+}
+
+// public methods
+
+// adds a shard, numbering any sequences it already holds
+void ShardSet::addShard(const shared_ptr<Shard>& shard){
+  vector<uint64_t> ids(shard->sequenceCount());
+  for(size_t i = 0; i < ids.size(); i++){
+    ids[i] = nextId++;
+  }
+  shards.push_back(shard);
+  globalIds.push_back(ids);
+  shardLengths.push_back(shard->length());
+}
+
+size_t ShardSet::shardCount() const{
+  return shards.size();
+}
+
+uint64_t ShardSet::sequenceCount() const{
+  return nextId;
+}
+
+uint64_t ShardSet::length() const{
+  uint64_t retVal = 0;
+  for(size_t s = 0; s < shardLengths.size(); s++){
+    retVal += shardLengths[s];
+  }
+  return retVal;
+}
+
+// Gives each sequence (in order) to the shard with the fewest rows,
+// then adds the sequences of each shard as one batch, with the shards
+// in parallel. Each shard's IDs are recorded as soon as it has taken
+// its batch, so if some shards fail (the first error is rethrown) the
+// others still map their hits; the IDs of failed batches are not
+// reused. Throws runtime_error if there are no shards.
+void ShardSet::addSequences(const vector<PackedSeq>& seqs,
+                            QueryExecutor& executor){
+  if(shards.empty()){
+    throw runtime_error("no shards to add sequences to");
+  }
+  vector<vector<PackedSeq> > batches(shards.size());
+  vector<vector<uint64_t> > batchIds(shards.size());
+  vector<uint64_t> lengths = shardLengths;
+  for(size_t i = 0; i < seqs.size(); i++){
+    size_t s = min_element(lengths.begin(), lengths.end()) - lengths.begin();
+    batches[s].push_back(seqs[i]);
+    batchIds[s].push_back(nextId + i);
+    lengths[s] += seqs[i].length() + 1; // and an end marker
+  }
+  nextId += seqs.size();
+  executor.parallelFor(shards.size(), 1, [&](size_t start, size_t end){
+      for(size_t s = start; s < end; s++){
+        if(!batches[s].empty()){
+          shards[s]->addSequences(batches[s]);
+          globalIds[s].insert(globalIds[s].end(), batchIds[s].begin(),
+                              batchIds[s].end());
+          shardLengths[s] = shards[s]->length();
+        }
+      }
+    });
+}
+
+uint64_t ShardSet::count(const string& pattern,
+                         QueryExecutor& executor) const{
+  return countBatch(vector<string>(1, pattern), executor)[0];
+}
+
+vector<SeqPos> ShardSet::locate(const string& pattern,
+                                QueryExecutor& executor) const{
+  return locateBatch(vector<string>(1, pattern), executor)[0];
+}
+
+vector<uint64_t> ShardSet::countBatch(const vector<string>& patterns,
+                                      QueryExecutor& executor) const{
+  vector<vector<uint64_t> > shardCounts(shards.size());
+  executor.parallelFor(shards.size(), 1, [&](size_t start, size_t end){
+      for(size_t s = start; s < end; s++){
+        shardCounts[s] = shards[s]->countBatch(patterns);
+      }
+    });
+  vector<uint64_t> retVal(patterns.size(), 0);
+  for(size_t s = 0; s < shards.size(); s++){
+    for(size_t i = 0; i < patterns.size(); i++){
+      retVal[i] += shardCounts[s][i];
+    }
+  }
+  return retVal;
+}
+
+// hits for each pattern, with global sequence IDs, sorted by position
+vector<vector<SeqPos> >
+ShardSet::locateBatch(const vector<string>& patterns,
+                      QueryExecutor& executor) const{
+  vector<vector<vector<SeqPos> > > shardHits(shards.size());
+  executor.parallelFor(shards.size(), 1, [&](size_t start, size_t end){
+      for(size_t s = start; s < end; s++){
+        shardHits[s] = shards[s]->locateBatch(patterns);
+        for(size_t i = 0; i < shardHits[s].size(); i++){
+          for(size_t h = 0; h < shardHits[s][i].size(); h++){
+            SeqPos& hit = shardHits[s][i][h];
+            if(hit.seqId >= globalIds[s].size()){
+              throw runtime_error("shard holds sequences not added by "
+                                  "the set");
+            }
+            hit.seqId = globalIds[s][hit.seqId];
+          }
+        }
+      }
+    });
+  vector<vector<SeqPos> > retVal(patterns.size());
+  for(size_t i = 0; i < patterns.size(); i++){
+    for(size_t s = 0; s < shards.size(); s++){
+      retVal[i].insert(retVal[i].end(), shardHits[s][i].begin(),
+                       shardHits[s][i].end());
+    }
+    sort(retVal[i].begin(), retVal[i].end(), positionLess);
+  }
+  return retVal;
+}
@@ -0,0 +1,254 @@
+/** <header>
+
+ * This file is part of preBowt -- a prefix-based BWT-like transform of
+ * genetic data.
+ *
+ * Copyright 2014 David Eccles (gringer) <bioinformatics@gringene.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * without any warranty; without even the implied warranty of
+ * merchantability or fitness for a particular purpose. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+</header> **/
+
+#include <mutex>
+#include <vector>
+#include <sstream>
+#include <algorithm>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#include "treestats.hpp"
+
+static const char* COUNTER_NAMES[TreeStats::COUNTER_COUNT] = {
+  "queries", "nodes_visited", "leaf_bytes_scanned", "splits", "appends",
+  "overflows", "node_allocations"
+};
+
+static const char* HARDWARE_NAMES[TreeStats::HARDWARE_COUNT] = {
+  "cycles", "instructions", "cache_misses", "branch_misses"
+};
+
+// the blocks of running threads, and the totals of finished threads
+static mutex& blockLock(){
+  static mutex retVal;
+  return retVal;
+}
+
+static vector<atomic<uint64_t>*>& liveBlocks(){
+  static vector<atomic<uint64_t>*> retVal;
+  return retVal;
+}
+
+static TreeStats& retiredTotals(){
+  static TreeStats retVal;
+  return retVal;
+}
+
+static atomic<bool> hardwareEnabled(false);
+
+static void writeArray(ostream& out, const uint64_t* values, size_t count){
+  out << "[";
+  for(size_t i = 0; i < count; i++){
+    out << ((i == 0) ? "" : ",") << values[i];
+  }
+  out << "]";
+}
+
+// TreeStats
+
+// constructors
+
+TreeStats::TreeStats()
+  : hardwareAvailable(false){
+  fill(counters, counters + COUNTER_COUNT, 0);
+  fill(hardware, hardware + HARDWARE_COUNT, 0);
+  fill(leafDepths, leafDepths + DEPTH_MAX, 0);
+  fill(nodeFills, nodeFills + FILL_BINS, 0);
+  fill(leafFills, leafFills + FILL_BINS, 0);
+}
+
+// static public methods
+
+bool TreeStats::enabled(){
+#if PREBOWT_STATS
+  return true;
+#else
+  return false;
+#endif
+}
+
+// the counts of all threads, since the last reset()
+TreeStats TreeStats::snapshot(){
+  lock_guard<mutex> guard(blockLock());
+  TreeStats retVal = retiredTotals();
+  const vector<atomic<uint64_t>*>& blocks = liveBlocks();
+  for(size_t i = 0; i < blocks.size(); i++){
+    for(size_t c = 0; c < COUNTER_COUNT; c++){
+      retVal.counters[c] += blocks[i][c].load(memory_order_relaxed);
+    }
+  }
+  return retVal;
+}
+
+// Counts made by other threads while this runs may be lost
+void TreeStats::reset(){
+  lock_guard<mutex> guard(blockLock());
+  retiredTotals() = TreeStats();
+  const vector<atomic<uint64_t>*>& blocks = liveBlocks();
+  for(size_t i = 0; i < blocks.size(); i++){
+    for(size_t c = 0; c < COUNTER_COUNT; c++){
+      blocks[i][c].store(0, memory_order_relaxed);
+    }
+  }
+}
+
+void TreeStats::setHardwareCounting(bool enable){
+  hardwareEnabled.store(enable);
+}
+
+bool TreeStats::hardwareCounting(){
+  return hardwareEnabled.load();
+}
+
+void TreeStats::addHardware(const uint64_t* values){
+  lock_guard<mutex> guard(blockLock());
+  TreeStats& totals = retiredTotals();
+  totals.hardwareAvailable = true;
+  for(size_t h = 0; h < HARDWARE_COUNT; h++){
+    totals.hardware[h] += values[h];
+  }
+}
+
+// public methods
+
+void TreeStats::addLeaf(size_t depth, uint64_t length, uint64_t capacity){
+  leafDepths[min(depth, DEPTH_MAX - 1)]++;
+  if(capacity > 0){
+    leafFills[min(length * FILL_BINS / capacity, FILL_BINS - 1)]++;
+  }
+}
+
+void TreeStats::addNode(size_t childCount, size_t fanout){
+  nodeFills[min(childCount * FILL_BINS / fanout, FILL_BINS - 1)]++;
+}
+
+string TreeStats::json() const{
+  ostringstream out;
+  out << "{";
+  for(size_t c = 0; c < COUNTER_COUNT; c++){
+    out << "\"" << COUNTER_NAMES[c] << "\":" << counters[c] << ",";
+  }
+  out << "\"nodes_per_query\":"
+      << ((counters[QUERIES] == 0) ? 0.0 :
+          ((double)counters[NODES_VISITED] / counters[QUERIES])) << ",";
+  out << "\"hardware\":{\"available\":"
+      << (hardwareAvailable ? "true" : "false");
+  for(size_t h = 0; h < HARDWARE_COUNT; h++){
+    out << ",\"" << HARDWARE_NAMES[h] << "\":" << hardware[h];
+  }
+  out << "},\"leaf_depths\":";
+  size_t depthCount = DEPTH_MAX;
+  while((depthCount > 0) && (leafDepths[depthCount - 1] == 0)){
+    depthCount--;
+  }
+  writeArray(out, leafDepths, depthCount);
+  out << ",\"node_fills\":";
+  writeArray(out, nodeFills, FILL_BINS);
+  out << ",\"leaf_fills\":";
+  writeArray(out, leafFills, FILL_BINS);
+  out << "}";
+  return out.str();
+}
+
+// TreeStats::Block
+
+// constructors
+
+TreeStats::Block::Block(){
+  for(size_t c = 0; c < COUNTER_COUNT; c++){
+    values[c].store(0, memory_order_relaxed);
+  }
+  lock_guard<mutex> guard(blockLock());
+  liveBlocks().push_back(values);
+}
+
+// destructor
+
+// a finished thread's counts are kept in the retired totals
+TreeStats::Block::~Block(){
+  lock_guard<mutex> guard(blockLock());
+  vector<atomic<uint64_t>*>& blocks = liveBlocks();
+  blocks.erase(find(blocks.begin(), blocks.end(), values));
+  TreeStats& totals = retiredTotals();
+  for(size_t c = 0; c < COUNTER_COUNT; c++){
+    totals.counters[c] += values[c].load(memory_order_relaxed);
+  }
+}
+
+// PerfCounters
+
+// constructors
+
+PerfCounters::PerfCounters(){
+  fill(fds, fds + TreeStats::HARDWARE_COUNT, -1);
+#ifdef __linux__
+  if(!TreeStats::hardwareCounting()){
+    return;
+  }
+  static const uint64_t EVENTS[TreeStats::HARDWARE_COUNT] = {
+    PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+  };
+  for(size_t h = 0; h < TreeStats::HARDWARE_COUNT; h++){
+    perf_event_attr attr = perf_event_attr();
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = EVENTS[h];
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    fds[h] = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+  }
+  for(size_t h = 0; h < TreeStats::HARDWARE_COUNT; h++){
+    if(fds[h] >= 0){
+      ioctl(fds[h], PERF_EVENT_IOC_RESET, 0);
+      ioctl(fds[h], PERF_EVENT_IOC_ENABLE, 0);
+    }
+  }
+#endif
+}
+
+// destructor
+
+PerfCounters::~PerfCounters(){
+#ifdef __linux__
+  uint64_t values[TreeStats::HARDWARE_COUNT] = {0};
+  bool counted = false;
+  for(size_t h = 0; h < TreeStats::HARDWARE_COUNT; h++){
+    if(fds[h] >= 0){
+      ioctl(fds[h], PERF_EVENT_IOC_DISABLE, 0);
+      counted |= (read(fds[h], &values[h], sizeof(values[h])) ==
+                  (ssize_t)sizeof(values[h]));
+      close(fds[h]);
+    }
+  }
+  if(counted){
+    TreeStats::addHardware(values);
+  }
+#endif
+}